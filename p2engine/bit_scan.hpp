@@ -0,0 +1,105 @@
+//
+// bit_scan.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009, GuangZhu Wu  <guangzhuwu@gmail.com>
+//
+//This program is free software; you can redistribute it and/or modify it
+//under the terms of the GNU General Public License or any later version.
+//
+//This program is distributed in the hope that it will be useful, but
+//WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+//or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//for more details.
+//
+//You should have received a copy of the GNU General Public License along
+//with this program; if not, contact <guangzhuwu@gmail.com>.
+//
+#ifndef P2ENGINE_BIT_SCAN_HPP
+#define P2ENGINE_BIT_SCAN_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "p2engine/push_warning_option.hpp"
+#include "p2engine/config.hpp"
+#include <boost/assert.hpp>
+#include <boost/cstdint.hpp>
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#endif
+#include "p2engine/pop_warning_option.hpp"
+
+namespace p2engine {
+
+	//index of the lowest set bit, x must not be 0
+	inline int count_trailing_zeros(boost::uint64_t x)
+	{
+		BOOST_ASSERT(x);
+#if defined(__GNUC__)
+		return __builtin_ctzll(x);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64))
+		unsigned long i;
+		_BitScanForward64(&i,x);
+		return (int)i;
+#elif defined(_MSC_VER)
+		unsigned long i;
+		if (_BitScanForward(&i,(unsigned long)x))
+			return (int)i;
+		_BitScanForward(&i,(unsigned long)(x>>32));
+		return (int)i+32;
+#else
+		int n=0;
+		while (!(x&1))
+		{
+			x>>=1;
+			++n;
+		}
+		return n;
+#endif
+	}
+
+	//number of zero bits above the highest set bit, x must not be 0
+	inline int count_leading_zeros(boost::uint64_t x)
+	{
+		BOOST_ASSERT(x);
+#if defined(__GNUC__)
+		return __builtin_clzll(x);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64))
+		unsigned long i;
+		_BitScanReverse64(&i,x);
+		return 63-(int)i;
+#elif defined(_MSC_VER)
+		unsigned long i;
+		if (_BitScanReverse(&i,(unsigned long)(x>>32)))
+			return 31-(int)i;
+		_BitScanReverse(&i,(unsigned long)x);
+		return 63-(int)i;
+#else
+		int n=0;
+		while (!(x&(boost::uint64_t(1)<<63)))
+		{
+			x<<=1;
+			++n;
+		}
+		return n;
+#endif
+	}
+
+	inline int population_count(boost::uint64_t x)
+	{
+#if defined(__GNUC__)
+		return __builtin_popcountll(x);
+#else
+		//SWAR, the compiler is not allowed to assume the popcnt instruction
+		x=x-((x>>1)&0x5555555555555555ULL);
+		x=(x&0x3333333333333333ULL)+((x>>2)&0x3333333333333333ULL);
+		x=(x+(x>>4))&0x0f0f0f0f0f0f0f0fULL;
+		return (int)((x*0x0101010101010101ULL)>>56);
+#endif
+	}
+
+} // namespace p2engine
+
+#endif // P2ENGINE_BIT_SCAN_HPP
@@ -25,14 +25,151 @@
 
 #include "p2engine/push_warning_option.hpp"
 #include "p2engine/config.hpp"
+#include <cstring>
+#include <iterator>
+#include <vector>
 #include <boost/dynamic_bitset.hpp>
+#include <boost/detail/endian.hpp>
 #include <iostream>
 #include "p2engine/pop_warning_option.hpp"
 
 #include "p2engine/io.hpp"
+#include "p2engine/bit_scan.hpp"
 
 namespace p2engine{
 
+	namespace detail{
+		inline boost::uint64_t load_le_word(const uint8_t* p)
+		{
+#if defined(BOOST_LITTLE_ENDIAN)
+			boost::uint64_t w;
+			memcpy(&w,p,sizeof(w));
+			return w;
+#else
+			boost::uint64_t w=0;
+			for (int i=0;i<8;++i)
+				w|=boost::uint64_t(p[i])<<(i*8);
+			return w;
+#endif
+		}
+	}
+
+	//walks the runs of a buffer made by compressed_bitset::compress_to_buf
+	//without decompressing it. adjacent units of the same value are
+	//returned as one run. a truncated buffer ends early, the missing bits
+	//are 0.
+	class compressed_bitset_runs
+	{
+		typedef boost::uint64_t word_type;
+
+	public:
+		compressed_bitset_runs(const void* buf, std::size_t bufLen)
+			: p_((const uint8_t*)buf), end_((const uint8_t*)buf+bufLen)
+			, size_(0), pos_(0), unitPos_(0), bits_(0), acc_(0), accBits_(0)
+			, pendingValue_(false), pendingLen_(0)
+		{
+			if (bufLen<3)
+				return;
+			size_=read_uint16_ntoh(p_);//p_=p_+2; after read
+			bits_=*p_++;
+			if (bits_==0||bits_>32)
+			{
+				size_=0;
+				bits_=0;
+			}
+		}
+
+		bool is_valid()const
+		{
+			return bits_!=0;
+		}
+
+		//bits of the bitset
+		std::size_t size()const
+		{
+			return size_;
+		}
+
+		//start of the next run
+		std::size_t position()const
+		{
+			return pos_;
+		}
+
+		//return false when all runs have been read
+		bool next(bool& value, std::size_t& length)
+		{
+			if (pendingLen_>0)
+			{
+				value=pendingValue_;
+				length=pendingLen_;
+				pendingLen_=0;
+			}
+			else if (!__read_unit(value,length))
+			{
+				return false;
+			}
+			bool v;
+			std::size_t len;
+			while (__read_unit(v,len))
+			{
+				if (v!=value)
+				{
+					pendingValue_=v;
+					pendingLen_=len;
+					break;
+				}
+				length+=len;
+			}
+			pos_+=length;
+			return true;
+		}
+
+	private:
+		bool __read_unit(bool& value, std::size_t& length)
+		{
+			if (unitPos_>=size_)
+				return false;
+			if (accBits_<bits_)
+			{
+				if (end_-p_>=8)
+				{
+					std::size_t n=(63-accBits_)>>3;
+					acc_|=(detail::load_le_word(p_)&(~word_type(0)>>(64-n*8)))<<accBits_;
+					p_+=n;
+					accBits_+=n*8;
+				}
+				else
+				{
+					for (;accBits_<bits_&&p_<end_;++p_,accBits_+=8)
+						acc_|=word_type(*p_)<<accBits_;
+					if (accBits_<bits_)
+						return false;
+				}
+			}
+			word_type valueBit=word_type(1)<<(bits_-1);
+			word_type code=acc_&((valueBit<<1)-1);
+			acc_>>=bits_;
+			accBits_-=bits_;
+			value=(code&valueBit)!=0;
+			length=(std::min)((std::size_t)(code&(valueBit-1))+1,size_-unitPos_);
+			unitPos_+=length;
+			return true;
+		}
+
+	private:
+		const uint8_t* p_;
+		const uint8_t* end_;
+		std::size_t size_;
+		std::size_t pos_;
+		std::size_t unitPos_;
+		std::size_t bits_;
+		word_type acc_;
+		std::size_t accBits_;
+		bool pendingValue_;
+		std::size_t pendingLen_;
+	};
+
 	//һѹλΪnbitÿѹλĵ1bitʾһ<ԭBITλ>TrueFalse
 	//<ԭBITλ>ͬʱѹʾģn-1bitʾĸ
 	//n=8ʱ
@@ -43,142 +180,290 @@ namespace p2engine{
 	{
 	public:
 		typedef boost::dynamic_bitset<uint8_t> dynamic_bitset;
+		static const std::size_t npos=static_cast<std::size_t>(-1);
 
 	private:
-		inline void _set_bit(const void *data,uint32_t bitIdx, uint8_t bitVal)
+		typedef boost::uint64_t word_type;
+		enum{MIN_CODE_BITS=2,MAX_CODE_BITS=8,HEADER_SIZE=3};
+
+		//bit i of the bitset is bit (i&63) of words[i>>6]
+		static void _to_words(const dynamic_bitset& bitset, std::vector<word_type>& words)
 		{
-			uint8_t* p=(uint8_t *)data+(bitIdx>>3);//(uint8_t *)data+bitIdx/8
-			if (bitVal == 0)
-				(*p) &= ~(0x01 << (bitIdx % 8));
-			else
-				(*p) |= (0x01 << (bitIdx % 8));
+			std::vector<uint8_t> bytes;
+			bytes.reserve(bitset.num_blocks()+8);
+			boost::to_block_range(bitset,std::back_inserter(bytes));
+			words.resize((bytes.size()+7)/8);
+			bytes.resize(words.size()*8,0);
+			for (std::size_t i=0;i<words.size();++i)
+				words[i]=detail::load_le_word(&bytes[i*8]);
 		}
 
-		inline void _set_bits(const void *data,uint32_t bitIdx, 
-			uint32_t bitCnt, uint32_t val)
+		void _from_words(const std::vector<word_type>& words, std::size_t bitsetSize)
 		{
-			for(uint32_t i = bitIdx; i < bitIdx + bitCnt; ++ i)
+			std::vector<uint8_t> bytes((bitsetSize+7)/8);
+			for (std::size_t i=0;i<bytes.size();++i)
+				bytes[i]=(uint8_t)(words[i>>3]>>((i&7)*8));
+			bitset_.clear();
+			bitset_.append(bytes.begin(),bytes.end());
+			bitset_.resize(bitsetSize);
+		}
+
+		//length of the run of equal bits starting at pos
+		static std::size_t _run_length(const std::vector<word_type>& words,
+			std::size_t bitsetSize, std::size_t pos, bool value)
+		{
+			word_type flip=value?~word_type(0):word_type(0);
+			std::size_t w=pos>>6;
+			word_type x=(words[w]^flip)>>(pos&63);
+			std::size_t i=pos;
+			while (!x)
 			{
-				_set_bit(data, i, (uint8_t)(val & 0x1));
-				val >>= 1;
+				i=(++w)<<6;
+				if (w>=words.size())
+					return bitsetSize-pos;
+				x=words[w]^flip;
 			}
+			return (std::min)(i+count_trailing_zeros(x),bitsetSize)-pos;
 		}
 
-		inline uint8_t _get_bit(const void *data,uint32_t bitIdx)
+		//set bits [pos, pos+len)
+		static void _fill_ones(std::vector<word_type>& words, std::size_t pos, std::size_t len)
 		{
-			uint8_t byteVal = *((uint8_t *)data + bitIdx / 8);
-			return (byteVal >> (bitIdx % 8)) & 0x01;
+			std::size_t last=pos+len-1;
+			std::size_t w=pos>>6;
+			std::size_t lastW=last>>6;
+			word_type head=~word_type(0)<<(pos&63);
+			word_type tail=~word_type(0)>>(63-(last&63));
+			if (w==lastW)
+			{
+				words[w]|=head&tail;
+				return;
+			}
+			words[w++]|=head;
+			for (;w<lastW;++w)
+				words[w]=~word_type(0);
+			words[lastW]|=tail;
+		}
+
+		//set bits in [pos, pos+len), the bits beyond words are 0
+		static std::size_t _count_ones(const std::vector<word_type>& words,
+			std::size_t pos, std::size_t len)
+		{
+			std::size_t end=(std::min)(pos+len,words.size()*64);
+			if (pos>=end)
+				return 0;
+			std::size_t last=end-1;
+			std::size_t w=pos>>6;
+			std::size_t lastW=last>>6;
+			word_type head=~word_type(0)<<(pos&63);
+			word_type tail=~word_type(0)>>(63-(last&63));
+			if (w==lastW)
+				return population_count(words[w]&head&tail);
+			std::size_t n=population_count(words[w++]&head);
+			for (;w<lastW;++w)
+				n+=population_count(words[w]);
+			return n+population_count(words[lastW]&tail);
 		}
 
-		inline uint32_t _get_bits(const void *data, uint32_t bitIdx, 
-			unsigned int bitCnt)
+		//first 0 bit in [pos, pos+len), the bits beyond words are 0
+		static std::size_t _find_zero(const std::vector<word_type>& words,
+			std::size_t pos, std::size_t len)
 		{
-			uint32_t res = 0;
-			for(unsigned int i = bitIdx; i < bitIdx + bitCnt; ++ i)
+			std::size_t end=pos+len;
+			for (std::size_t i=pos;i<end;)
+			{
+				std::size_t w=i>>6;
+				if (w>=words.size())
+					return i;
+				word_type x=~words[w]&(~word_type(0)<<(i&63));
+				if (x)
+				{
+					std::size_t found=(w<<6)+count_trailing_zeros(x);
+					return found<end?found:npos;
+				}
+				i=(w+1)<<6;
+			}
+			return npos;
+		}
+
+		//a unit of n bits holds at most 2^(n-1) equal bits
+		static std::size_t _code_count(std::size_t runLength, std::size_t bits)
+		{
+			return ((runLength-1)>>(bits-1))+1;
+		}
+
+		static void _add_codes(std::size_t codes[], std::size_t runLength)
+		{
+			for (std::size_t b=MIN_CODE_BITS;b<=MAX_CODE_BITS;++b)
+				codes[b]+=_code_count(runLength,b);
+		}
+
+		//same choice as encoding with every width from 8 down to 2: the
+		//smallest result shorter than stop bytes, stop at the first width
+		//worse than the best one.
+		static bool _choose_bits(const std::size_t codes[], std::size_t stop,
+			std::size_t& bits)
+		{
+			std::size_t bestSize=0;
+			bool comped=false;
+			bits=1;
+			for (std::size_t b=MAX_CODE_BITS;b>=MIN_CODE_BITS;--b)
 			{
-				res |= (_get_bit(data, i) << (i - bitIdx));
+				std::size_t bufSize=HEADER_SIZE+(codes[b]*b+7)/8;
+				if (codes[b]>0&&bufSize>=stop)
+					continue;
+				if (comped&&bestSize<bufSize)
+					break;
+				if (!comped||bestSize>bufSize)
+				{
+					bestSize=bufSize;
+					bits=b;
+					comped=true;
+				}
 			}
-			return res;
+			return comped;
 		}
-		//ѹ
+
 		template<class T>
-		bool _commpless_to_buf(T&compressedBuf,std::size_t bits,std::size_t stop)
+		static void _encode(T&compressedBuf, const std::vector<uint32_t>& runs,
+			bool firstValue, std::size_t bits, std::size_t bitsetSize)
 		{
-			BOOST_STATIC_ASSERT(sizeof(T::value_type)==1);
-			int k=0;
+			typedef typename T::value_type value_type;
+			const uint32_t maxRun=1<<(bits-1);
 			compressedBuf.clear();
-			//ǰֽеֽڱʾbitsetĳȣʾѹλ
-			compressedBuf.resize(3,0);
-			for(std::size_t i=0;i<bitset_.size();)
-			{
-				bool velue=bitset_[i];
-				uint32_t x=velue?(1<<(bits-1)):0;
-				uint32_t maxLen=(0xffffffff)>>(32-bits+1);//ܱʾbitһλѾʶ
-				uint32_t j=0;
-				i++;
-				while(i<bitset_.size()&&j<maxLen&&bitset_[i]==velue)
+			//2 bytes bitset size and 1 byte unit bits
+			compressedBuf.resize(HEADER_SIZE,0);
+			word_type acc=0;
+			std::size_t accBits=0;
+			bool value=firstValue;
+			for (std::size_t i=0;i<runs.size();++i,value=!value)
+			{
+				for (uint32_t len=runs[i];len>0;)
 				{
-					x++;
-					j++;
-					i++;
+					uint32_t n=(std::min)(len,maxRun);
+					acc|=word_type((value?maxRun:0)|(n-1))<<accBits;
+					accBits+=bits;
+					len-=n;
+					if (accBits>=32)
+					{
+						for (int k=0;k<4;++k,acc>>=8)
+							compressedBuf.push_back((value_type)(acc&0xff));
+						accBits-=32;
+					}
 				}
-				while(k+bits>(compressedBuf.size()-3)*8)
+			}
+			for (;accBits>0;acc>>=8)
+			{
+				compressedBuf.push_back((value_type)(acc&0xff));
+				accBits=(accBits>8?accBits-8:0);
+			}
+			char* p=(char*)&compressedBuf[0];
+			write_int16_hton(bitsetSize,p);
+			compressedBuf[2]=(value_type)bits;
+		}
+
+		struct _and_op{bool operator()(bool a,bool b)const{return a&&b;}};
+		struct _or_op{bool operator()(bool a,bool b)const{return a||b;}};
+		struct _and_not_op{bool operator()(bool a,bool b)const{return a&&!b;}};
+
+		//merge the runs of a and b, the shorter one is extended by 0
+		template<class T, class Op>
+		static void _merge(T& out, const void* a, std::size_t aLen,
+			const void* b, std::size_t bLen, Op op)
+		{
+			compressed_bitset_runs ra(a,aLen);
+			compressed_bitset_runs rb(b,bLen);
+			std::size_t bitsetSize=(std::max)(ra.size(),rb.size());
+			std::vector<uint32_t> runs;
+			bool firstValue=false;
+			bool lastValue=false;
+			bool va=false, vb=false;
+			std::size_t la=0, lb=0;
+			for (std::size_t pos=0;pos<bitsetSize;)
+			{
+				if (la==0&&!ra.next(va,la))
 				{
-					compressedBuf.push_back(0);
-					if(compressedBuf.size()>=stop)
-						return false;
+					va=false;
+					la=bitsetSize-pos;
+				}
+				if (lb==0&&!rb.next(vb,lb))
+				{
+					vb=false;
+					lb=bitsetSize-pos;
 				}
-				_set_bits(&compressedBuf[0]+3,k,bits,x);
-				k+=bits;
+				std::size_t n=(std::min)(la,lb);
+				bool v=op(va,vb);
+				if (runs.empty())
+					firstValue=v;
+				if (runs.empty()||v!=lastValue)
+					runs.push_back((uint32_t)n);
+				else
+					runs.back()+=(uint32_t)n;
+				lastValue=v;
+				la-=n;
+				lb-=n;
+				pos+=n;
 			}
-			char* p=(char*)&compressedBuf[0];
-			write_int16_hton(bitset_.size(),p);
-				compressedBuf[2]=bits;
-			return true;
+			std::size_t codes[MAX_CODE_BITS+1]={0};
+			for (std::size_t i=0;i<runs.size();++i)
+				_add_codes(codes,runs[i]);
+			std::size_t bits;
+			_choose_bits(codes,npos,bits);
+			_encode(out,runs,firstValue,bits,bitsetSize);
 		}
+
 	public:
 		compressed_bitset(std::size_t n=0)
 			:bitset_(n)
 		{
 		}
 	public:
-		//ע̰߳ȫģ
+		//the runs are found a word at a time and the encoded size of every
+		//unit width is counted in the same pass, only the best one is encoded.
 		template<class T>
 		bool compress_to_buf(T&compressedBuf,std::size_t& bits)
 		{
-			BOOST_STATIC_ASSERT(sizeof(T::value_type)==1);
+			BOOST_STATIC_ASSERT(sizeof(typename T::value_type)==1);
 			assert(bitset_.size()<0xffff);
-			bool comped=false;
-			std::size_t bytes=(bitset_.size()+7)/8;
-			T tmp;
-			tmp.reserve(bytes);
-			bits=1;
-			for(std::size_t i=8;i>1;i--)
+			const std::size_t bitsetSize=bitset_.size();
+			std::vector<word_type> words;
+			_to_words(bitset_,words);
+
+			std::vector<uint32_t> runs;
+			std::size_t codes[MAX_CODE_BITS+1]={0};
+			bool firstValue=(bitsetSize>0&&bitset_[0]);
+			bool value=firstValue;
+			for (std::size_t i=0;i<bitsetSize;value=!value)
 			{
-				if(_commpless_to_buf(tmp,i,bytes))
-				{
-					if (comped&&compressedBuf.size()<tmp.size())
-					{
-						break;
-					}
-					if(!comped||compressedBuf.size()>tmp.size())
-					{
-						compressedBuf.clear();
-						compressedBuf.assign(tmp.begin(),tmp.end());
-						bits=i;
-						comped=true;
-					}
-				}
-				tmp.clear();
+				std::size_t len=_run_length(words,bitsetSize,i,value);
+				runs.push_back((uint32_t)len);
+				_add_codes(codes,len);
+				i+=len;
 			}
+
+			bool comped=_choose_bits(codes,(bitsetSize+7)/8,bits);
+			if (comped)
+				_encode(compressedBuf,runs,firstValue,bits,bitsetSize);
 			return comped;
 		}
 
 		void decompress(const void* buf,const std::size_t bufLen)
 		{
 			bitset_.clear();
-			if (bufLen<3)
-				return;
-
-			const uint8_t* p=(const uint8_t* )buf;
-			uint32_t bitsetSize=read_uint16_ntoh(p);//p=p+2; after read
-			uint8_t bits=*p;
-			p+=1;
-			if ((bitsetSize/bits+7)/8+3>bufLen)
+			compressed_bitset_runs runs(buf,bufLen);
+			if (!runs.is_valid())
 				return;
-
-			bitset_.resize(bitsetSize);
-			int j=0;
-			for(std::size_t i=0;i<bitset_.size();)
+			std::vector<word_type> words((runs.size()+63)/64,0);
+			bool value;
+			std::size_t len;
+			std::size_t pos=0;
+			while (runs.next(value,len))
 			{
-				uint32_t num=(uint32_t)_get_bits(p,j,bits);
-				uint32_t v=num&(1<<(bits-1));
-				num&=~v;
-				bitset_[i++]=(v!=0);
-				for(uint32_t k=0;k<num&&i<bitset_.size();k++)
-					bitset_[i++]=(v!=0);
-				j+=bits;
+				if (value)
+					_fill_ones(words,pos,len);
+				pos+=len;
 			}
+			_from_words(words,runs.size());
 		}
 
 		const boost::dynamic_bitset<uint8_t>& bitset()const
@@ -191,9 +476,244 @@ namespace p2engine{
 			return bitset_;
 		}
 
+	public:
+		//operations on the compressed buffers, nothing is decompressed.
+		//the result of a binary operation has the size of the longer
+		//operand and is always encoded, even if larger than the raw bitset.
+
+		//number of set bits
+		static std::size_t count(const void* buf, std::size_t bufLen)
+		{
+			compressed_bitset_runs runs(buf,bufLen);
+			std::size_t n=0;
+			bool value;
+			std::size_t len;
+			while (runs.next(value,len))
+			{
+				if (value)
+					n+=len;
+			}
+			return n;
+		}
+
+		//first set bit at or after pos, npos if none
+		static std::size_t find_next(const void* buf, std::size_t bufLen,
+			std::size_t pos=0)
+		{
+			compressed_bitset_runs runs(buf,bufLen);
+			bool value;
+			std::size_t len;
+			while (runs.next(value,len))
+			{
+				if (value&&runs.position()>pos)
+					return (std::max)(runs.position()-len,pos);
+			}
+			return npos;
+		}
+
+		template<class T>
+		static void bitwise_and(T& out, const void* a, std::size_t aLen,
+			const void* b, std::size_t bLen)
+		{
+			_merge(out,a,aLen,b,bLen,_and_op());
+		}
+
+		template<class T>
+		static void bitwise_or(T& out, const void* a, std::size_t aLen,
+			const void* b, std::size_t bLen)
+		{
+			_merge(out,a,aLen,b,bLen,_or_op());
+		}
+
+		//a&~b
+		template<class T>
+		static void bitwise_and_not(T& out, const void* a, std::size_t aLen,
+			const void* b, std::size_t bLen)
+		{
+			_merge(out,a,aLen,b,bLen,_and_not_op());
+		}
+
+		//number of bits set in buf but not in have, e.g. the pieces a peer
+		//can offer us. the runs of buf are counted with popcount over the
+		//words of have.
+		static std::size_t count_and_not(const void* buf, std::size_t bufLen,
+			const dynamic_bitset& have)
+		{
+			std::vector<word_type> words;
+			_to_words(have,words);
+			compressed_bitset_runs runs(buf,bufLen);
+			std::size_t n=0;
+			bool value;
+			std::size_t len;
+			while (runs.next(value,len))
+			{
+				if (value)
+					n+=len-_count_ones(words,runs.position()-len,len);
+			}
+			return n;
+		}
+
+		//first bit at or after pos set in buf but not in have, npos if none
+		static std::size_t find_next_and_not(const void* buf, std::size_t bufLen,
+			const dynamic_bitset& have, std::size_t pos=0)
+		{
+			std::vector<word_type> words;
+			_to_words(have,words);
+			compressed_bitset_runs runs(buf,bufLen);
+			bool value;
+			std::size_t len;
+			while (runs.next(value,len))
+			{
+				std::size_t end=runs.position();
+				if (!value||end<=pos)
+					continue;
+				std::size_t start=(std::max)(end-len,pos);
+				std::size_t found=_find_zero(words,start,end-start);
+				if (found!=npos)
+					return found;
+			}
+			return npos;
+		}
+
 	private:
+		friend class compressed_bitset_availability;
 		boost::dynamic_bitset<uint8_t> bitset_;
 	};
+
+	//how many peers have each bit, for rarest-first selection over
+	//hundreds of peers. a peer is added or removed in the compressed form
+	//at the cost of its runs: each run updates a difference array, and the
+	//counts are summed once when they are next read.
+	class compressed_bitset_availability
+	{
+		typedef boost::uint64_t word_type;
+
+	public:
+		typedef compressed_bitset::dynamic_bitset dynamic_bitset;
+		static const std::size_t npos=compressed_bitset::npos;
+
+		explicit compressed_bitset_availability(std::size_t n=0)
+			: counts_(n,0), diff_(n+1,0), dirty_(false)
+		{
+		}
+
+		std::size_t size()const
+		{
+			return counts_.size();
+		}
+
+		void resize(std::size_t n)
+		{
+			__sum();
+			counts_.resize(n,0);
+			diff_.assign(n+1,0);
+		}
+
+		void clear()
+		{
+			counts_.assign(counts_.size(),0);
+			diff_.assign(diff_.size(),0);
+			dirty_=false;
+		}
+
+		void add(const void* buf, std::size_t bufLen)
+		{
+			__update(buf,bufLen,1);
+		}
+
+		void remove(const void* buf, std::size_t bufLen)
+		{
+			__update(buf,bufLen,-1);
+		}
+
+		const std::vector<int>& counts()
+		{
+			__sum();
+			return counts_;
+		}
+
+		int count(std::size_t i)
+		{
+			__sum();
+			return counts_[i];
+		}
+
+		//the bit set in buf but not in have that the fewest peers have,
+		//the lowest index wins a tie. npos if none.
+		std::size_t rarest(const void* buf, std::size_t bufLen, const dynamic_bitset& have)
+		{
+			__sum();
+			std::vector<word_type> words;
+			compressed_bitset::_to_words(have,words);
+			compressed_bitset_runs runs(buf,bufLen);
+			std::size_t best=npos;
+			bool value;
+			std::size_t len;
+			while (runs.next(value,len))
+			{
+				std::size_t end=(std::min)(runs.position(),counts_.size());
+				if (!value)
+					continue;
+				for (std::size_t i=runs.position()-len;i<end;)
+				{
+					std::size_t w=i>>6;
+					//skip the bits we have a word at a time
+					word_type want=(w<words.size()?~words[w]:~word_type(0))
+						&(~word_type(0)<<(i&63));
+					std::size_t wordEnd=(std::min)((w+1)<<6,end);
+					while (want)
+					{
+						std::size_t j=(w<<6)+count_trailing_zeros(want);
+						if (j>=wordEnd)
+							break;
+						if (best==npos||counts_[j]<counts_[best])
+							best=j;
+						want&=want-1;
+					}
+					i=wordEnd;
+				}
+			}
+			return best;
+		}
+
+	private:
+		void __update(const void* buf, std::size_t bufLen, int delta)
+		{
+			compressed_bitset_runs runs(buf,bufLen);
+			bool value;
+			std::size_t len;
+			while (runs.next(value,len))
+			{
+				std::size_t end=(std::min)(runs.position(),counts_.size());
+				std::size_t start=runs.position()-len;
+				if (!value||start>=end)
+					continue;
+				diff_[start]+=delta;
+				diff_[end]-=delta;
+				dirty_=true;
+			}
+		}
+
+		void __sum()
+		{
+			if (!dirty_)
+				return;
+			int sum=0;
+			for (std::size_t i=0;i<counts_.size();++i)
+			{
+				sum+=diff_[i];
+				diff_[i]=0;
+				counts_[i]+=sum;
+			}
+			diff_[counts_.size()]=0;
+			dirty_=false;
+		}
+
+	private:
+		std::vector<int> counts_;
+		std::vector<int> diff_;
+		bool dirty_;
+	};
 }
 
 #endif//P2ENGINE_COMPRESSED_BITSET_HPP
@@ -29,6 +29,7 @@
 #include "p2engine/shared_access.hpp"
 #include "p2engine/contrib.hpp"
 #include "p2engine/time.hpp"
+#include "p2engine/send_watermark.hpp"
 
 namespace p2engine {
 
@@ -47,6 +48,7 @@ namespace p2engine {
 
 	class basic_connection_base
 		:public basic_engine_object
+		,public send_watermark
 		,public fssignal::trackable
 	{
 		typedef basic_connection_base this_type;
@@ -109,6 +111,24 @@ namespace p2engine {
 		//reliable is not confirmed.
 		virtual void async_send_semireliable(const safe_buffer& buf, message_type msgType)=0;
 
+		//reliable send on a sub-stream. messages of one stream keep their 
+		//order, a connection without sub-streams sends them as 
+		//async_send_reliable.
+		virtual void async_send_on_stream(const safe_buffer& buf, message_type msgType,
+			stream_id_type streamId)
+		{
+			UNUSED_PARAMETER(streamId);
+			async_send_reliable(buf,msgType);
+		}
+		//the stream of the higher priority is sent first, streams of one
+		//priority share the bandwidth by weight.
+		virtual void stream_priority(stream_id_type streamId, int priority, int weight=1)
+		{
+			UNUSED_PARAMETER(streamId);
+			UNUSED_PARAMETER(priority);
+			UNUSED_PARAMETER(weight);
+		}
+
 		virtual void keep_async_receiving()=0;
 		virtual void block_async_receiving()=0;
 
@@ -139,6 +159,9 @@ namespace p2engine {
 
 		virtual uint32_t session_id()const=0;
 
+		//bytes queued but not yet sent out (or not acked for urdp)
+		virtual std::size_t overstocked_send_size()const=0;
+
 	public:
 		bool is_real_time_usage()const
 		{
@@ -157,6 +157,11 @@ ConversionResult ConvertUTF32toUTF16 (
 
 Boolean isLegalUTF8Sequence(const UTF8 *source, const UTF8 *sourceEnd);
 
+P2ENGINE_DECL Boolean isLegalUTF8String(const UTF8 *source, const UTF8 *sourceEnd);
+
+/* number of bytes before the first non-ASCII byte */
+P2ENGINE_DECL size_t asciiPrefixLength(const UTF8 *source, const UTF8 *sourceEnd);
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,8 +37,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "p2engine/config.hpp"
 #include <vector>
 #include <set>
+#include <boost/scoped_ptr.hpp>
 #include "p2engine/pop_warning_option.hpp"
 
+#include "p2engine/fssignal.hpp"
+#include "p2engine/mutex.hpp"
+#include "p2engine/time.hpp"
+
 namespace p2engine{
 
 	struct ip_interface
@@ -78,13 +83,92 @@ namespace p2engine{
 	bool in_subnet(address const& addr, ip_interface const& iface);
 
 	// returns true if the specified address is on the same
-	// local network as us
+	// local network as us, answered by network_topology_service
 	bool in_local_network(io_service& ios, address const& addr
 		, error_code& ec);
 
+	// answered by network_topology_service
 	address get_default_gateway(io_service& ios, error_code& ec);
 
 	void get_available_address_v4(io_service& ios,std::set<address>& addr);
+
+	// interfaces and routes of the machine, cached per io_service.
+	// the tables are loaded on first use and kept until they change: on
+	// linux a rtnetlink socket subscribed to link, address and route
+	// events marks them stale, on other systems they are reloaded at most
+	// every REFRESH_INTERVAL ms. changed_signal() is fired in the
+	// io_service thread when a reload finds the tables changed.
+	class network_topology_service
+		: public boost::asio::detail::service_base<network_topology_service>
+	{
+		typedef network_topology_service this_type;
+
+	public:
+		typedef fssignal::signal<void()> changed_signal_type;
+
+		static network_topology_service& get(io_service& ios)
+		{
+			return boost::asio::use_service<network_topology_service>(ios);
+		}
+
+		explicit network_topology_service(io_service& ios);
+		virtual ~network_topology_service();
+
+		std::vector<ip_interface> interfaces(error_code& ec);
+		std::vector<ip_route> routes(error_code& ec);
+
+		bool in_local_network(address const& addr, error_code& ec);
+
+		// the interface that addr is in the subnet of
+		bool find_interface(address const& addr, ip_interface& iface
+			, error_code& ec);
+
+		address default_gateway(error_code& ec);
+
+		// mtu of the interface that packets to addr leave from: the
+		// interface addr is in the subnet of, or the one of the default
+		// route. 0 if not known.
+		int mtu_to(address const& addr, error_code& ec);
+
+		// largest mtu of the interfaces other than loopback, 0 if not known
+		int max_mtu(error_code& ec);
+
+		// drop the tables, next query reloads them
+		void invalidate();
+
+		// only bind it in the io_service thread
+		changed_signal_type& changed_signal()
+		{
+			return changed_signal_;
+		}
+
+	private:
+		virtual void shutdown_service();
+		void __load_if_stale();
+		void __async_watch();
+		void __handle_watch(const error_code& ec, std::size_t len);
+		void __reload();
+		void __notify_changed();
+
+	private:
+		enum{REFRESH_INTERVAL=30*1000};
+
+		struct watcher;
+
+		fast_mutex mutex_;
+		std::vector<ip_interface> interfaces_;
+		std::vector<ip_route> routes_;
+		address default_gateway_;
+		error_code interfaces_ec_;
+		error_code routes_ec_;
+		tick_type load_time_;
+		bool loaded_;
+		bool stale_;
+		bool reload_posted_;
+		bool notify_posted_;
+		boost::scoped_ptr<watcher> watcher_;
+		changed_signal_type changed_signal_;
+	};
 	
 }
 
@@ -42,6 +42,9 @@ POSSIBILITY OF SUCH DAMAGE.
 namespace p2engine
 {
 
+	// returns -1 if gzip header is invalid or the header size in bytes
+	P2ENGINE_DECL int gzip_header(const char* buf, int size);
+
 	P2ENGINE_DECL bool inflate_gzip(
 		char const* in, int size
 		, std::vector<char>& buffer
@@ -0,0 +1,231 @@
+//
+// gzip_stream.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009, GuangZhu Wu  <guangzhuwu@gmail.com>
+//
+//This program is free software; you can redistribute it and/or modify it
+//under the terms of the GNU General Public License or any later version.
+//
+//This program is distributed in the hope that it will be useful, but
+//WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+//or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//for more details.
+//
+//You should have received a copy of the GNU General Public License along
+//with this program; if not, contact <guangzhuwu@gmail.com>.
+//
+#ifndef P2ENGINE_GZIP_STREAM_HPP
+#define P2ENGINE_GZIP_STREAM_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "p2engine/push_warning_option.hpp"
+#include "p2engine/config.hpp"
+#include <string>
+#include <vector>
+#include <boost/crc.hpp>
+#include "p2engine/pop_warning_option.hpp"
+
+#include "p2engine/safe_buffer_io.hpp"
+
+namespace p2engine{
+
+	//incremental gzip decoder. compressed data can be fed in fragments of
+	//any size, only the 32K history window and the input bytes of an
+	//unfinished huffman symbol (or block header) are kept between calls.
+	class gzip_inflater
+	{
+		typedef gzip_inflater this_type;
+
+	public:
+		gzip_inflater();
+
+		void reset();
+
+		//inflate [in, in+len) and append the output to out.
+		//return false if the stream is corrupt, the error is kept until reset.
+		bool inflate(const char* in, std::size_t len, safe_buffer& out,
+			std::string& error);
+		bool inflate(const safe_buffer& in, safe_buffer& out, std::string& error)
+		{
+			return inflate(buffer_cast<const char*>(in),in.length(),out,error);
+		}
+
+		//the gzip trailer has been received and verified
+		bool is_done()const
+		{
+			return state_==DONE;
+		}
+
+	private:
+		enum{
+			WINDOW_SIZE=32768,
+			MAX_HEADER_SIZE=64*1024,
+			STEP_INPUT_SIZE=1024,
+			MAX_BITS=15,
+			MAX_LCODES=286,
+			MAX_DCODES=30,
+			FIX_LCODES=288
+		};
+		enum state_type{
+			GZIP_HEADER,
+			BLOCK_HEADER,
+			STORED_BLOCK,
+			HUFFMAN_BLOCK,
+			GZIP_TRAILER,
+			DONE,
+			BAD
+		};
+		enum step_result{
+			STEP_OK,
+			STEP_NEED_MORE,
+			STEP_ERROR
+		};
+		struct huffman
+		{
+			boost::int16_t count[MAX_BITS+1];
+			boost::int16_t symbol[FIX_LCODES];
+		};
+
+		bool __run(const unsigned char* in, std::size_t len, std::string& error);
+		step_result __step();
+		step_result __error(const char* msg)
+		{
+			error_=msg;
+			return STEP_ERROR;
+		}
+		step_result __header();
+		step_result __block_header();
+		step_result __stored();
+		step_result __codes();
+		step_result __dynamic_tables();
+		step_result __trailer();
+
+		bool __need(int n)
+		{
+			while (bitcnt_<n)
+			{
+				if (in_==in_end_)
+					return false;
+				bitbuf_|=(boost::uint32_t)(*in_++)<<bitcnt_;
+				bitcnt_+=8;
+			}
+			return true;
+		}
+		int __bits(int n)
+		{
+			BOOST_ASSERT(bitcnt_>=n);
+			int v=(int)(bitbuf_&((1UL<<n)-1));
+			bitbuf_>>=n;
+			bitcnt_-=n;
+			return v;
+		}
+		//return -1 need more input, -2 invalid code
+		int __decode(const huffman& h);
+		static int __construct(huffman& h, const short* length, int n);
+
+		void __put(unsigned char c)
+		{
+			window_[wpos_++]=c;
+			++total_out_;
+			if (wpos_==WINDOW_SIZE)
+				__flush();
+		}
+		void __flush();
+
+	private:
+		state_type state_;
+		const char* error_;
+		bool last_block_;
+		std::size_t stored_remain_;
+		boost::uint64_t total_out_;
+
+		//bit reader of the current step
+		const unsigned char* in_;
+		const unsigned char* in_end_;
+		boost::uint32_t bitbuf_;
+		int bitcnt_;
+
+		//input not consumed by an unfinished step
+		std::string pending_;
+
+		huffman lencode_;
+		huffman distcode_;
+
+		std::vector<unsigned char> window_;
+		std::size_t wpos_;
+		std::size_t flush_pos_;
+		safe_buffer* out_;
+
+		boost::crc_32_type crc_;
+	};
+
+	//incremental gzip encoder. uses LZ77 with hash chains over a 32K
+	//window and fixed huffman codes, every deflate() call emits one block.
+	//the bits of the last unfinished byte are kept until next call or
+	//finish().
+	class gzip_deflater
+	{
+		typedef gzip_deflater this_type;
+
+	public:
+		gzip_deflater();
+
+		void reset();
+
+		void deflate(const char* in, std::size_t len, safe_buffer& out);
+		void deflate(const safe_buffer& in, safe_buffer& out)
+		{
+			deflate(buffer_cast<const char*>(in),in.length(),out);
+		}
+
+		//write the final block and gzip trailer.
+		void finish(safe_buffer& out);
+
+	private:
+		enum{
+			WINDOW_SIZE=32768,
+			WINDOW_MASK=WINDOW_SIZE-1,
+			HASH_BITS=15,
+			HASH_SIZE=1<<HASH_BITS,
+			MIN_MATCH=3,
+			MAX_MATCH=258,
+			MAX_CHAIN=32
+		};
+
+		void __compress(std::size_t end);
+		void __slide();
+		std::size_t __hash(std::size_t pos)const;
+		void __insert_hash(std::size_t pos);
+		std::size_t __longest_match(std::size_t pos, std::size_t& dist)const;
+		void __put_literal(int c);
+		void __put_match(std::size_t len, std::size_t dist);
+		void __put_bits(boost::uint32_t v, int n);
+		//huffman codes are packed starting from the most significant bit
+		void __put_code(boost::uint32_t code, int n);
+		void __put_header();
+		void __flush_to(safe_buffer& out);
+
+	private:
+		std::vector<unsigned char> window_;
+		std::size_t window_len_;
+		std::size_t pos_;
+		std::vector<int> head_;
+		std::vector<int> prev_;
+
+		//bytes produced by current call
+		std::vector<char> obuf_;
+		boost::uint32_t bitbuf_;
+		int bitcnt_;
+		bool header_written_;
+		boost::uint64_t total_in_;
+
+		boost::crc_32_type crc_;
+	};
+
+}
+
+#endif // P2ENGINE_GZIP_STREAM_HPP
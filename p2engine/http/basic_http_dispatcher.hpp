@@ -36,6 +36,7 @@ namespace p2engine { namespace http {
 
 		typedef fssignal::signal<void(const request&)>		received_request_header_signal_type;
 		typedef fssignal::signal<void(const response&)>		received_response_header_signal_type;
+		typedef fssignal::signal<void()>					received_data_end_signal_type;
 
 		SHARED_ACCESS_DECLARE;
 
@@ -79,6 +80,15 @@ namespace p2engine { namespace http {
 		{
 			return s_msg_handler_;
 		}
+		//the last chunk of a chunked body has been received
+		received_data_end_signal_type& received_data_end_signal() 
+		{
+			return data_end_handler_;
+		}
+		const received_data_end_signal_type& received_data_end_signal()const
+		{
+			return data_end_handler_;
+		}
 		using basic_dispatcher::connected_signal;
 		using basic_dispatcher::disconnected_signal;
 		using basic_dispatcher::writable_signal;
@@ -89,6 +99,7 @@ namespace p2engine { namespace http {
 
 			request_handler_.disconnect_all_slots();
 			response_handler_.disconnect_all_slots();
+			data_end_handler_.disconnect_all_slots();
 		}
 		
 		using basic_dispatcher::dispatch_connected;
@@ -98,10 +109,15 @@ namespace p2engine { namespace http {
 
 		bool dispatch_request(request& buf);
 		bool dispatch_response(response& buf);
+		void dispatch_data_end()
+		{
+			data_end_handler_();
+		}
 
 	public:
 		received_request_header_signal_type request_handler_;
 		received_response_header_signal_type response_handler_;
+		received_data_end_signal_type data_end_handler_;
 
 		static received_request_header_signal_type s_request_handler_;
 		static received_response_header_signal_type s_response_handler_;
@@ -0,0 +1,95 @@
+//
+// chunked.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009, GuangZhu Wu  <guangzhuwu@gmail.com>
+//
+//This program is free software; you can redistribute it and/or modify it
+//under the terms of the GNU General Public License or any later version.
+//
+//This program is distributed in the hope that it will be useful, but
+//WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+//or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//for more details.
+//
+//You should have received a copy of the GNU General Public License along
+//with this program; if not, contact <guangzhuwu@gmail.com>.
+//
+#ifndef P2ENGINE_HTTP_CHUNKED_HPP
+#define P2ENGINE_HTTP_CHUNKED_HPP
+
+#include "p2engine/push_warning_option.hpp"
+#include "p2engine/config.hpp"
+#include <cstring>
+#include "p2engine/pop_warning_option.hpp"
+
+#include "p2engine/safe_buffer_io.hpp"
+
+namespace p2engine { namespace http{
+
+	//incremental decoder of "Transfer-Encoding: chunked" body.
+	//the decoder keeps no data, only the parse state, so the body can be
+	//fed in any fragment size.
+	class chunked_decoder
+	{
+	public:
+		chunked_decoder()
+		{
+			reset();
+		}
+
+		void reset();
+
+		//decode [begin, begin+len), the payload is appended to body.
+		//return the bytes consumed, or -1 if the input is malformed.
+		//less than len is consumed only when the last chunk and trailer
+		//have been parsed, the rest belongs to the next message.
+		int decode(const char* begin, std::size_t len, safe_buffer& body);
+
+		bool is_done()const
+		{
+			return state_==DONE;
+		}
+
+	private:
+		enum Limits
+		{
+			MAX_LINE_LENGTH  = 4096
+		};
+		enum DecodeState
+		{
+			CHUNK_SIZE,
+			CHUNK_EXT,
+			CHUNK_SIZE_LF,
+			CHUNK_DATA,
+			CHUNK_DATA_CR,
+			CHUNK_DATA_LF,
+			TRAILER_LINE_BEGIN,
+			TRAILER_LINE,
+			TRAILER_LF,
+			DONE
+		};
+
+		DecodeState state_;
+		uint64_t chunk_remain_;
+		std::size_t line_len_;
+		int digit_num_;
+	};
+
+	//chunked writer. a chunk is sent as [header,data,tailer] so that
+	//the data buffer is never copied.
+	class chunked_encoder
+	{
+	public:
+		//"size-in-hex CRLF"
+		static safe_buffer chunk_header(std::size_t len);
+		//CRLF after chunk data
+		static safe_buffer chunk_tailer();
+		//"0 CRLF CRLF"
+		static safe_buffer last_chunk();
+	};
+
+}
+}
+
+#endif // P2ENGINE_HTTP_CHUNKED_HPP
@@ -23,9 +23,36 @@
 #include "p2engine/coroutine.hpp"
 #include "p2engine/operation_mark.hpp"
 #include "p2engine/handler_allocator.hpp"
+#include "p2engine/io_service_pool.hpp"
+#include "p2engine/atomic.hpp"
 
 namespace p2engine { namespace http {
 
+	namespace detail{
+
+		//connections living on one io_service of the pool
+		struct io_service_load
+		{
+			io_service_load(io_service& ios):ios_(ios){}
+
+			io_service& ios_;
+			atomic<boost::int32_t> connection_count_;
+			atomic<boost::int32_t> accepted_count_;
+		};
+
+		struct io_service_load_releaser
+		{
+			io_service_load_releaser(const boost::shared_ptr<io_service_load>& load)
+				:load_(load)
+			{}
+			void operator()(void*)const
+			{
+				--load_->connection_count_;
+			}
+			boost::shared_ptr<io_service_load> load_;
+		};
+	}
+
 	template<typename ConnectionType, typename ConnectionBaseType>
 	class basic_http_acceptor 
 		:public http_acceptor_base<ConnectionBaseType>
@@ -48,14 +75,42 @@ namespace p2engine { namespace http {
 				);
 		}
 
+		//accept on the first io_service of pool, and hand every accepted
+		//connection to the io_service that has the least connections.
+		//accepted_signal is dispatched in the thread of the connection's
+		//io_service, so the slots must be thread safe. pool must outlive
+		//the acceptor.
+		static shared_ptr create(io_service_pool& pool,bool  enableSsl=false)
+		{
+			return shared_ptr(new this_type(pool,enableSsl),
+				shared_access_destroy<this_type>()
+				);
+		}
+
 	protected:
 		basic_http_acceptor(io_service&ios,bool enableSsl=false)
 			:http_acceptor_base<ConnectionBaseType>(ios)
 			,is_accepting_(false)
 			,enable_ssl_(enableSsl)
 			,block_async_accepting_(true)
+			,next_load_(0)
 			,acceptor_(ios)
 		{}
+		basic_http_acceptor(io_service_pool& pool,bool enableSsl=false)
+			:http_acceptor_base<ConnectionBaseType>(pool.get_io_service(0))
+			,is_accepting_(false)
+			,enable_ssl_(enableSsl)
+			,block_async_accepting_(true)
+			,next_load_(0)
+			,acceptor_(pool.get_io_service(0))
+		{
+			for (std::size_t i=0;i<pool.size();++i)
+			{
+				loads_.push_back(boost::shared_ptr<detail::io_service_load>(
+					new detail::io_service_load(pool.get_io_service(i))
+					));
+			}
+		}
 		virtual ~basic_http_acceptor()
 		{
 			set_cancel();
@@ -125,14 +180,7 @@ namespace p2engine { namespace http {
 			{
 				is_accepting_=true;
 				block_async_accepting_=false;
-				boost::shared_ptr<connection_type> conn
-					=connection_type::create(this->get_io_service(),enable_ssl_,true);
-				error_code ec;
-				conn->open(endpoint(),ec);
-				acceptor_.async_accept(conn->lowest_layer(),
-					make_alloc_handler(boost::bind(&this_type::__accept_handler,
-					SHARED_OBJ_FROM_THIS,_1,conn,this->op_stamp()))
-					);
+				__async_accept(this->op_stamp());
 			}
 		}
 		virtual void block_async_accepting()
@@ -165,6 +213,25 @@ namespace p2engine { namespace http {
 			return acceptor_;
 		}
 
+		//io_services that the accepted connections are spread on, 0 if the
+		//acceptor is not created on a pool.
+		std::size_t io_service_count()const
+		{
+			return loads_.size();
+		}
+		//connections living on the i-th io_service
+		std::size_t connection_count(std::size_t i)const
+		{
+			BOOST_ASSERT(i<loads_.size());
+			return (std::size_t)(boost::int32_t)loads_[i]->connection_count_;
+		}
+		//connections ever accepted on the i-th io_service
+		std::size_t accepted_count(std::size_t i)const
+		{
+			BOOST_ASSERT(i<loads_.size());
+			return (std::size_t)(boost::int32_t)loads_[i]->accepted_count_;
+		}
+
 	protected:
 		void __accept_handler(error_code ec,
 			boost::shared_ptr<connection_type> conn, op_stamp_t stamp)
@@ -178,23 +245,76 @@ namespace p2engine { namespace http {
 				accepted_ec_=ec;
 				return;
 			}
+			for (std::size_t i=0;!ec&&i<loads_.size();++i)
+			{
+				if (&loads_[i]->ios_==&conn->get_io_service())
+				{
+					++loads_[i]->accepted_count_;
+					break;
+				}
+			}
+			if (&conn->get_io_service()==&this->get_io_service())
+			{
+				__dispatch_accepted(ec,conn,stamp);
+			}
+			else
+			{
+				conn->get_io_service().post(
+					make_alloc_handler(boost::bind(&this_type::__dispatch_accepted,
+					SHARED_OBJ_FROM_THIS,ec,conn,stamp))
+					);
+			}
+			if (acceptor_.is_open()&&!block_async_accepting_)
+			{
+				is_accepting_=true;
+				__async_accept(stamp);
+			}
+		}
+
+		void __dispatch_accepted(error_code ec,
+			boost::shared_ptr<connection_type> conn, op_stamp_t stamp)
+		{
+			if (this->is_canceled_op(stamp))
+				return;
 			if (ec) 
 				conn->close();
 			else 
 				conn->keep_async_receiving();
-			dispatch_accepted(conn,ec);
-			if (acceptor_.is_open()&&!block_async_accepting_)
+			this->dispatch_accepted(conn,ec);
+		}
+
+		void __async_accept(op_stamp_t stamp)
+		{
+			boost::shared_ptr<connection_type> conn;
+			if (loads_.empty())
 			{
-				is_accepting_=true;
-				boost::shared_ptr<connection_type> conn=
-					connection_type::create(this->get_io_service(),enable_ssl_,true);
-				error_code ec;
-				conn->open(endpoint(),ec);
-				acceptor_.async_accept(conn->lowest_layer(),
-					make_alloc_handler(boost::bind(&this_type::__accept_handler,
-					SHARED_OBJ_FROM_THIS,_1,conn,stamp))
-					);
+				conn=connection_type::create(this->get_io_service(),enable_ssl_,true);
 			}
+			else
+			{
+				//least loaded, ties are broken round robin
+				std::size_t best=next_load_;
+				for (std::size_t i=1;i<loads_.size();++i)
+				{
+					std::size_t j=(next_load_+i)%loads_.size();
+					if ((boost::int32_t)loads_[j]->connection_count_
+						<(boost::int32_t)loads_[best]->connection_count_)
+						best=j;
+				}
+				next_load_=(best+1)%loads_.size();
+
+				const boost::shared_ptr<detail::io_service_load>& load=loads_[best];
+				conn=connection_type::create(load->ios_,enable_ssl_,true);
+				++load->connection_count_;
+				conn->set_load_token(boost::shared_ptr<void>((void*)0,
+					detail::io_service_load_releaser(load)));
+			}
+			error_code ec;
+			conn->open(endpoint(),ec);
+			acceptor_.async_accept(conn->lowest_layer(),
+				make_alloc_handler(boost::bind(&this_type::__accept_handler,
+				SHARED_OBJ_FROM_THIS,_1,conn,stamp))
+				);
 		}
 		
 		error_code __to_close_stat(error_code& ec)
@@ -216,6 +336,9 @@ namespace p2engine { namespace http {
 		error_code accepted_ec_;
 		endpoint local_endpoint_;
 
+		std::vector<boost::shared_ptr<detail::io_service_load> > loads_;
+		std::size_t next_load_;
+
 		tcp::acceptor acceptor_;
 	};
 
@@ -95,6 +95,19 @@ namespace p2engine { namespace http {
 				impl_->async_send(buf);
 		}
 
+		virtual void async_send_chunk(const safe_buffer& buf)
+		{
+			BOOST_ASSERT(impl_);
+			if (impl_)
+				impl_->async_send_chunk(buf);
+		}
+		virtual void async_send_last_chunk()
+		{
+			BOOST_ASSERT(impl_);
+			if (impl_)
+				impl_->async_send_last_chunk();
+		}
+
 		virtual void keep_async_receiving()
 		{
 			BOOST_ASSERT(impl_);
@@ -14,6 +14,7 @@
 #include "p2engine/variant_endpoint.hpp"
 #include "p2engine/basic_dispatcher.hpp"
 #include "p2engine/basic_engine_object.hpp"
+#include "p2engine/send_watermark.hpp"
 
 #include "p2engine/http/response.hpp"
 #include "p2engine/http/request.hpp"
@@ -24,6 +25,7 @@ namespace p2engine { namespace http {
 	namespace detail{
 
 		class basic_http_connection_base
+			:public send_watermark
 		{
 			typedef basic_http_connection_base this_type;
 			SHARED_ACCESS_DECLARE;
@@ -37,6 +39,7 @@ namespace p2engine { namespace http {
 		protected:
 			basic_http_connection_base(bool enable_ssl,bool isPassive)
 				:is_passive_(isPassive),enable_ssl_(enable_ssl)
+				,auto_inflate_gzip_(false),deflate_chunked_body_(false)
 			{}
 			virtual ~basic_http_connection_base(){};
 
@@ -62,6 +65,12 @@ namespace p2engine { namespace http {
 			//reliable send
 			virtual void async_send(const safe_buffer& buf)=0;
 
+			//send body in "Transfer-Encoding: chunked", the header with
+			//chunked_transfer_encoding(true) must be sent by async_send first.
+			//empty buf is ignored, as a zero-size chunk terminates the body.
+			virtual void async_send_chunk(const safe_buffer& buf)=0;
+			virtual void async_send_last_chunk()=0;
+
 			virtual void keep_async_receiving()=0;
 			virtual void block_async_receiving()=0;
 
@@ -77,11 +86,27 @@ namespace p2engine { namespace http {
 			bool is_passive()const {return is_passive_;}
 			bool enable_ssl()const {return enable_ssl_;}
 
+			//inflate "Content-Encoding: gzip" body before dispatching it
+			void auto_inflate_gzip(bool enable){auto_inflate_gzip_=enable;}
+			bool auto_inflate_gzip()const {return auto_inflate_gzip_;}
+
+			//gzip the data of async_send_chunk, the header must be sent with
+			//"Content-Encoding: gzip"
+			void deflate_chunked_body(bool enable){deflate_chunked_body_=enable;}
+			bool deflate_chunked_body()const {return deflate_chunked_body_;}
+
 			virtual std::size_t overstocked_send_size()const=0;
 
+			//the token is released with the connection. the acceptor uses it
+			//to count the connections living on each io_service of a pool.
+			void set_load_token(const boost::shared_ptr<void>& token){load_token_=token;}
+
 		protected:
 			bool is_passive_;
 			bool enable_ssl_;
+			bool auto_inflate_gzip_;
+			bool deflate_chunked_body_;
+			boost::shared_ptr<void> load_token_;
 		};
 	}
 
@@ -24,6 +24,8 @@
 #include "p2engine/handler_allocator.hpp"
 #include "p2engine/safe_buffer.hpp"
 #include "p2engine/http/http_connection_base.hpp"
+#include "p2engine/http/chunked.hpp"
+#include "p2engine/gzip_stream.hpp"
 #include "p2engine/ssl_stream_wrapper.hpp"
 
 
@@ -73,6 +75,9 @@ namespace p2engine { namespace http { namespace  detail{
 		//reliable send
 		void async_send(const safe_buffer& buf);
 
+		void async_send_chunk(const safe_buffer& buf);
+		void async_send_last_chunk();
+
 		void keep_async_receiving();
 
 		void block_async_receiving()
@@ -124,6 +129,8 @@ namespace p2engine { namespace http { namespace  detail{
 			error_code err=error_code(), resolver_iterator itr=resolver_iterator());
 
 
+		void __do_async_send(op_stamp_t stamp);
+		void __async_send_chunk(const safe_buffer& buf);
 		void __async_send_handler(error_code ec, std::size_t len,op_stamp_t);
 
 		void __async_recv_handler(error_code ec, std::size_t len,op_stamp_t);
@@ -131,6 +138,7 @@ namespace p2engine { namespace http { namespace  detail{
 		void __allert_connected(error_code ec, op_stamp_t stamp);
 
 		void __dispatch_packet(safe_buffer& buf,op_stamp_t  stamp);
+		bool __dispatch_body(op_stamp_t  stamp);
 
 	private:
 		static void __on_shutdown(boost::shared_ptr<ssl_stream_wrapper<tcp::socket> > sock, 
@@ -143,6 +151,9 @@ namespace p2engine { namespace http { namespace  detail{
 			}
 		}
 	protected:
+		//max buffers gathered in one async_write
+		enum{MAX_GATHER_BUF_CNT=64};
+
 		boost::shared_ptr<ssl_stream_wrapper<tcp::socket> > socket_impl_;
 		http_connection_base* connection_;
 		enum{INIT, OPENED, CONNECTING, CONNECTED,CLOSING, CLOSED} state_;
@@ -155,9 +166,13 @@ namespace p2engine { namespace http { namespace  detail{
 		boost::scoped_ptr<resolver_query> resolver_query_;
 		endpoint_type remote_edp_;
 		endpoint_type local_edp_;
-		std::queue<safe_buffer> send_bufs_;
+		std::deque<safe_buffer> send_bufs_;
+		std::vector<asio_const_buffer> sending_bufs_;
 		std::size_t send_bufs_len_;
 		asio::streambuf recv_buf_;
+		chunked_decoder chunked_decoder_;
+		boost::scoped_ptr<gzip_inflater> inflater_;
+		boost::scoped_ptr<gzip_deflater> deflater_;
 		time_duration time_out_;
 
 		bool sending_:1;
@@ -166,6 +181,8 @@ namespace p2engine { namespace http { namespace  detail{
 		bool is_recv_blocked_:1;
 		bool is_header_recvd_:1;
 		bool is_gzip_:1;
+		bool is_chunked_:1;
+		bool is_inflating_:1;
 	};
 
 } // namespace detail 
@@ -30,6 +30,8 @@
 #include <boost/multi_index/identity.hpp>
 #include <boost/multi_index/member.hpp>
 #include <boost/unordered_set.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/iterator.hpp>
 
 #include "p2engine/time.hpp"
@@ -583,6 +585,270 @@ namespace p2engine
 		}
 	};
 
+
+	namespace detail{
+
+		//hash index plus a coarse timing wheel. the expiry of a lookup is
+		//exact, the wheel only reclaims expired entries in bulk: every slot
+		//covers RESOLUTION ms and is swept once its time has passed, entries
+		//whose timeout is beyond the wheel span stay in their slot for the
+		//next round. a slot entry of an erased or rekept key is left as is
+		//and dropped when its slot is swept.
+		template<class _Derived, class _Key, class _Value, class _Hash, class _Pred>
+		class basic_wheel_keeper
+		{
+			typedef basic_wheel_keeper<_Derived,_Key,_Value,_Hash,_Pred> this_type;
+
+		public:
+			typedef _Key	key_type;
+			typedef _Hash	hasher;
+			typedef _Pred	key_equal;
+
+			enum{WHEEL_SIZE=256,RESOLUTION=16};
+
+		protected:
+			struct eliment{
+				_Value value;
+				tick_type outTime;
+				tick_type keepTime;
+			};
+			struct slot_eliment{
+				key_type key;
+				tick_type outTime;
+			};
+			typedef boost::unordered_map<key_type,eliment,hasher,key_equal> eliment_map;
+			typedef std::vector<slot_eliment> slot_type;
+			typedef std::vector<std::pair<key_type,_Value> > expired_vector;
+
+			basic_wheel_keeper()
+				: wheel_(WHEEL_SIZE)
+				, nextSlot_(tick_now()/RESOLUTION)
+			{
+			}
+
+		public:
+			bool is_keeped(const key_type& id)
+			{
+				tick_type now=tick_now();
+				clear_timeout(now);
+				return __find(id,now)!=NULL;
+			}
+
+			time_duration expires_time(const key_type& id)
+			{
+				tick_type now=tick_now();
+				clear_timeout(now);
+				const eliment* elm=__find(id,now);
+				if (elm)
+					return  millisec(now-elm->keepTime);
+				return boost::posix_time::neg_infin;
+			}
+
+			time_duration remain_time(const key_type& id)
+			{
+				tick_type now=tick_now();
+				clear_timeout(now);
+				const eliment* elm=__find(id,now);
+				if (elm)
+					return  millisec(elm->outTime-now);
+				return boost::posix_time::neg_infin;
+			}
+
+			void erase(const key_type& id)
+			{
+				clear_timeout();
+				elimentMap_.erase(id);
+			}
+
+			//the entries expired in the current slot are not swept yet
+			std::size_t size_befor_clear()
+			{
+				return elimentMap_.size();
+			}
+			std::size_t size()
+			{
+				clear_timeout();
+				return elimentMap_.size();
+			}
+			void clear()
+			{
+				elimentMap_.clear();
+				for (std::size_t i=0;i<wheel_.size();++i)
+					slot_type().swap(wheel_[i]);
+			}
+			void clear_timeout()
+			{
+				clear_timeout(tick_now());
+			}
+
+		protected:
+			tick_type tick_now()
+			{
+				return system_time::tick_count();
+			}
+
+			bool __keep(const key_type& id, const _Value& v, const time_duration& t)
+			{
+				tick_type now=tick_now();
+				clear_timeout(now);
+				if (__find(id,now))
+					return false;
+				eliment& elm=elimentMap_[id];
+				elm.value=v;
+				elm.outTime=now+t.total_milliseconds();
+				elm.keepTime=now;
+
+				tick_type slot=(std::max)(elm.outTime/RESOLUTION,nextSlot_);
+				slot_eliment slotElm;
+				slotElm.key=id;
+				slotElm.outTime=elm.outTime;
+				wheel_[(std::size_t)(slot%WHEEL_SIZE)].push_back(slotElm);
+				return true;
+			}
+
+			eliment* __find(const key_type& id, tick_type now)
+			{
+				typename eliment_map::iterator itr=elimentMap_.find(id);
+				if (itr==elimentMap_.end())
+					return NULL;
+				if (itr->second.outTime<=now)
+				{
+					std::pair<key_type,_Value> expired(itr->first,itr->second.value);
+					elimentMap_.erase(itr);
+					static_cast<_Derived*>(this)->__on_expired(expired);
+					return NULL;
+				}
+				return &itr->second;
+			}
+
+			void clear_timeout(tick_type now)
+			{
+				tick_type target=now/RESOLUTION;
+				if (target<=nextSlot_)
+					return;
+				tick_type cnt=(std::min)(target-nextSlot_,(tick_type)WHEEL_SIZE);
+				expired_vector expired;
+				for (tick_type i=0;i<cnt;++i)
+					__sweep(wheel_[(std::size_t)((nextSlot_+i)%WHEEL_SIZE)],now,expired);
+				nextSlot_=target;
+
+				//signal after sweeping, a slot may keep new entries
+				for (std::size_t i=0;i<expired.size();++i)
+					static_cast<_Derived*>(this)->__on_expired(expired[i]);
+			}
+
+			void __sweep(slot_type& slot, tick_type now, expired_vector& expired)
+			{
+				std::size_t keepCnt=0;
+				for (std::size_t i=0;i<slot.size();++i)
+				{
+					typename eliment_map::iterator itr=elimentMap_.find(slot[i].key);
+					if (itr==elimentMap_.end()||itr->second.outTime!=slot[i].outTime)
+						continue;
+					if (itr->second.outTime<=now)
+					{
+						expired.push_back(std::make_pair(itr->first,itr->second.value));
+						elimentMap_.erase(itr);
+						continue;
+					}
+					if (keepCnt!=i)
+						slot[keepCnt]=slot[i];
+					++keepCnt;
+				}
+				slot.resize(keepCnt);
+			}
+
+		protected:
+			eliment_map elimentMap_;
+			std::vector<slot_type> wheel_;
+			tick_type nextSlot_;
+		};
+
+		struct wheel_keeper_null_value{};
+	}
+
+	//same as timed_keeper_set, but try_keep/is_keeped cost one hash lookup
+	//and the expiry is reclaimed by a timing wheel instead of an ordered
+	//index. no ordered iteration is provided.
+	template<class _Key, class _Hash = boost::hash<_Key>, class _Pred = std::equal_to<_Key> >
+	class timed_wheel_keeper_set
+		: public detail::basic_wheel_keeper<timed_wheel_keeper_set<_Key,_Hash,_Pred>,
+		_Key,detail::wheel_keeper_null_value,_Hash,_Pred>
+	{
+		typedef timed_wheel_keeper_set<_Key,_Hash,_Pred> this_type;
+		typedef detail::basic_wheel_keeper<this_type,_Key,
+			detail::wheel_keeper_null_value,_Hash,_Pred> base_type;
+		friend class detail::basic_wheel_keeper<this_type,_Key,
+			detail::wheel_keeper_null_value,_Hash,_Pred>;
+
+	public:
+		typedef _Key	key_type;
+
+		bool try_keep(const key_type& id, const time_duration& t)
+		{
+			return this->__keep(id,detail::wheel_keeper_null_value(),t);
+		}
+
+		typedef fssignal::signal<void(const _Key&)> expires_signal_type;
+		expires_signal_type& expires_signal()
+		{
+			return expires_signal_;
+		}
+
+	protected:
+		void __on_expired(const std::pair<key_type,detail::wheel_keeper_null_value>& elm)
+		{
+			expires_signal_(elm.first);
+		}
+
+	protected:
+		expires_signal_type expires_signal_;
+	};
+
+	template<class _Key,class _Value, class _Hash = boost::hash<_Key>, class _Pred = std::equal_to<_Key> >
+	class timed_wheel_keeper_map
+		: public detail::basic_wheel_keeper<timed_wheel_keeper_map<_Key,_Value,_Hash,_Pred>,
+		_Key,_Value,_Hash,_Pred>
+	{
+		typedef timed_wheel_keeper_map<_Key,_Value,_Hash,_Pred> this_type;
+		typedef detail::basic_wheel_keeper<this_type,_Key,_Value,_Hash,_Pred> base_type;
+		friend class detail::basic_wheel_keeper<this_type,_Key,_Value,_Hash,_Pred>;
+
+	public:
+		typedef _Key	key_type;
+		typedef _Value  mapped_type;
+		typedef std::pair<key_type,mapped_type> pair_type;
+
+		bool try_keep(const pair_type& id, const time_duration& t)
+		{
+			return this->__keep(id.first,id.second,t);
+		}
+
+		//return NULL if id is not keeped
+		mapped_type* find(const key_type& id)
+		{
+			tick_type now=this->tick_now();
+			this->clear_timeout(now);
+			typename base_type::eliment* elm=this->__find(id,now);
+			return elm?&elm->value:NULL;
+		}
+
+		typedef fssignal::signal<void(const std::pair<key_type,mapped_type>&)> expires_signal_type;
+		expires_signal_type& expires_signal()
+		{
+			return expires_signal_;
+		}
+
+	protected:
+		void __on_expired(const pair_type& elm)
+		{
+			expires_signal_(elm);
+		}
+
+	protected:
+		expires_signal_type expires_signal_;
+	};
+
 }
 
 #include "p2engine/pop_warning_option.hpp"
@@ -36,6 +36,8 @@
 
 #include "p2engine/push_warning_option.hpp"
 #include "p2engine/config.hpp"
+#include <deque>
+#include <vector>
 #include <boost/unordered_set.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -43,6 +45,7 @@
 #include <boost/multi_index/identity.hpp>
 
 #include "p2engine/basic_object.hpp"
+#include "p2engine/bit_scan.hpp"
 
 namespace p2engine {
 
@@ -135,6 +138,179 @@ namespace p2engine {
 		int low_water_mark_;
 	};
 
+	//same as basic_local_id_allocator, but the reusable ids are kept in a
+	//two level bitmap, so alloc_id/release_id are a few word operations
+	//instead of a tree insertion. the released ids wait in a FIFO until
+	//more than low_water_mark ids are released after them, then the lowest
+	//reusable id is allocated first.
+	template<typename IdType>
+	class basic_bitmap_id_allocator 
+		: public basic_object
+	{
+		typedef basic_bitmap_id_allocator<IdType> this_type;
+		SHARED_ACCESS_DECLARE;
+
+		typedef boost::uint64_t word_type;
+		enum{WORD_BITS=64,WORD_SHIFT=6,WORD_MASK=63};
+
+	public:
+		static shared_ptr create(bool reuse_id=false, int  low_water_mark=0)
+		{
+			return shared_ptr(new this_type(reuse_id,low_water_mark),
+				shared_access_destroy<this_type>());
+		}
+
+		basic_bitmap_id_allocator(bool reuse_id = false, int  low_water_mark=0) 
+			:summary_hint_(0), start_id_(IdType()), tail_id_(IdType())
+			,reuse_id_(reuse_id), low_water_mark_(low_water_mark)
+		{
+			this->set_obj_desc("basic_bitmap_id_allocator");
+		};
+
+		virtual ~basic_bitmap_id_allocator()
+		{
+		};
+
+	public:
+		//the released ids are dropped
+		void set_start_id(const IdType& start_id)
+		{
+			__clear();
+			start_id_=start_id;
+			tail_id_=start_id;
+		}
+		void add_reserved_id(const IdType& reserved_id)
+		{
+			reserved_id_set_.insert(reserved_id);
+			if (reserved_id>=start_id_&&reserved_id<tail_id_)
+			{
+				std::size_t index=(std::size_t)(reserved_id-start_id_);
+				__reset_bit(pending_words_,index);
+				if (__reset_bit(free_words_,index))
+					__update_summary(index>>WORD_SHIFT);
+			}
+		};
+
+		IdType alloc_id()
+		{
+			std::size_t index;
+			if(reuse_id_&&__pop_lowest(index))
+				return start_id_+(IdType)index;
+			while(reserved_id_set_.find(tail_id_) != reserved_id_set_.end())
+			{
+				++tail_id_;
+			}
+			return tail_id_++;
+		}
+
+		void release_id(const IdType& released_id)
+		{
+			if (!reuse_id_) return;
+			if (released_id<start_id_||released_id>=tail_id_) return;
+			std::size_t index=(std::size_t)(released_id-start_id_);
+			if (__test_bit(pending_words_,index)||__test_bit(free_words_,index))
+				return;
+			if (reserved_id_set_.find(released_id) != reserved_id_set_.end()) return;
+
+			__set_bit(pending_words_,index);
+			pending_ids_.push_back(index);
+			while (pending_ids_.size()>(std::size_t)low_water_mark_)
+			{
+				std::size_t freeIndex=pending_ids_.front();
+				pending_ids_.pop_front();
+				//reset by add_reserved_id when not set
+				if (__reset_bit(pending_words_,freeIndex))
+				{
+					__set_bit(free_words_,freeIndex);
+					__update_summary(freeIndex>>WORD_SHIFT);
+				}
+			}
+		}
+
+		void reset()
+		{
+			__clear();
+			start_id_=IdType();
+			tail_id_=IdType();
+		}
+
+	protected:
+		void __clear()
+		{
+			pending_ids_.clear();
+			pending_words_.clear();
+			free_words_.clear();
+			summary_words_.clear();
+			summary_hint_=0;
+		}
+		bool __pop_lowest(std::size_t& index)
+		{
+			while (summary_hint_<summary_words_.size()&&!summary_words_[summary_hint_])
+				++summary_hint_;
+			if (summary_hint_==summary_words_.size())
+				return false;
+			std::size_t w=(summary_hint_<<WORD_SHIFT)
+				+count_trailing_zeros(summary_words_[summary_hint_]);
+			index=(w<<WORD_SHIFT)+count_trailing_zeros(free_words_[w]);
+			__reset_bit(free_words_,index);
+			__update_summary(w);
+			return true;
+		}
+		void __update_summary(std::size_t w)
+		{
+			std::size_t s=w>>WORD_SHIFT;
+			if (summary_words_.size()<=s)
+				summary_words_.resize(s+1,0);
+			word_type bit=word_type(1)<<(w&WORD_MASK);
+			if (free_words_[w])
+			{
+				summary_words_[s]|=bit;
+				if (s<summary_hint_)
+					summary_hint_=s;
+			}
+			else
+			{
+				summary_words_[s]&=~bit;
+			}
+		}
+		static bool __test_bit(const std::vector<word_type>& words, std::size_t index)
+		{
+			std::size_t w=index>>WORD_SHIFT;
+			return w<words.size()
+				&&(words[w]&(word_type(1)<<(index&WORD_MASK)))!=0;
+		}
+		static void __set_bit(std::vector<word_type>& words, std::size_t index)
+		{
+			std::size_t w=index>>WORD_SHIFT;
+			if (words.size()<=w)
+				words.resize(w+1,0);
+			words[w]|=word_type(1)<<(index&WORD_MASK);
+		}
+		//return true if the bit was set
+		static bool __reset_bit(std::vector<word_type>& words, std::size_t index)
+		{
+			if (!__test_bit(words,index))
+				return false;
+			words[index>>WORD_SHIFT]&=~(word_type(1)<<(index&WORD_MASK));
+			return true;
+		}
+
+	protected:
+		//ids released but not reusable yet, and the bitmap of them
+		std::deque<std::size_t> pending_ids_;
+		std::vector<word_type> pending_words_;
+		//bit i of free_words_[w] is id start_id_+w*64+i,
+		//bit j of summary_words_[s] is set when free_words_[s*64+j]!=0
+		std::vector<word_type> free_words_;
+		std::vector<word_type> summary_words_;
+		std::size_t summary_hint_;//no summary word below is nonzero
+		boost::unordered_set<IdType> reserved_id_set_;
+		IdType start_id_;
+		IdType tail_id_;
+		bool reuse_id_;
+		int low_water_mark_;
+	};
+
 } // namespace p2engine
 
 #include "p2engine/pop_warning_option.hpp"
@@ -25,6 +25,7 @@
 
 #include "p2engine/push_warning_option.hpp"
 #include "p2engine/config.hpp"
+#include <cstdlib>
 #include <queue>
 #include <vector>
 #include <list>
@@ -56,6 +57,14 @@ namespace p2engine { namespace urdp{
 
 		BOOST_STATIC_CONSTANT(std::size_t, mtu_size=MTU_SIZE+128);
 
+	public:
+		//bytes the layer adds in front of every urdp packet
+#ifdef RUDP_SCRAMBLE
+		BOOST_STATIC_CONSTANT(std::size_t, datagram_overhead=8);
+#else
+		BOOST_STATIC_CONSTANT(std::size_t, datagram_overhead=0);
+#endif
+
 	public:
 		typedef asio::ip::udp::endpoint endpoint_type;
 		typedef asio::ip::udp::socket	udp_socket_type;
@@ -98,7 +107,7 @@ namespace p2engine { namespace urdp{
 		typedef boost::unordered_map<int,std::list<safe_buffer> >  linger_send_container;
 		typedef std::map<endpoint_type, this_type*>			this_type_container;
 
-		typedef basic_local_id_allocator<uint32_t> local_id_allocator;
+		typedef basic_bitmap_id_allocator<uint32_t> local_id_allocator;
 
 	public:
 		enum{INIT,STARTED,STOPED};
@@ -143,6 +152,86 @@ namespace p2engine { namespace urdp{
 				shared_layer->unregister_acceptor(acceptor);
 			}
 		};
+
+		//what is known about the path to one remote endpoint. all the flows
+		//to that endpoint share it: they feed it rtt and lost rate samples,
+		//a new flow starts with its warm estimates, and a single flow is
+		//enough to keep the path (and the NAT mapping on it) alive.
+		//times are the tick of the flows, srtt==0 and lost_rate<0 mean unknown.
+		//flows of different threads touch it, so the times are atomic and the
+		//estimates are kept under a mutex. the last release takes it out of
+		//the layer under path_mutex_, so path_to never hands out a dying one.
+		struct remote_path:basic_object
+		{
+			typedef remote_path this_type;
+			typedef boost::intrusive_ptr<this_type> smart_ptr;
+
+			shared_layer_sptr shared_layer;
+			const endpoint_type remote_endpoint;
+			atomic<int32_t> t_lastsend;
+			atomic<int32_t> t_lastrecv;
+
+			remote_path(const endpoint_type& edp,const shared_layer_sptr& udpLayer,
+				int32_t now)
+				:shared_layer(udpLayer),remote_endpoint(edp)
+				,t_lastsend(now),t_lastrecv(now),ref_count_(0)
+				,srtt_(0),rttvar_(0),lost_rate_(-1.0)
+			{
+				set_obj_desc("basic_shared_udp_layer::remote_path");
+			}
+
+			void update_rtt(int32_t rtt)
+			{
+				fast_mutex::scoped_lock lock(mutex_);
+				if (srtt_==0)
+				{
+					srtt_=rtt;
+					rttvar_=rtt/2;
+				}
+				else
+				{
+					rttvar_=((3*rttvar_+std::abs(rtt-srtt_))>>2);
+					srtt_=((7*srtt_+rtt)>>3);
+				}
+			}
+			void rtt(int32_t& srtt, int32_t& rttvar)const
+			{
+				fast_mutex::scoped_lock lock(mutex_);
+				srtt=srtt_;
+				rttvar=rttvar_;
+			}
+
+			double lost_rate()const
+			{
+				fast_mutex::scoped_lock lock(mutex_);
+				return lost_rate_;
+			}
+			void lost_rate(double rate)
+			{
+				fast_mutex::scoped_lock lock(mutex_);
+				lost_rate_=rate;
+			}
+
+			friend void intrusive_ptr_add_ref(const remote_path* p)
+			{
+				++p->ref_count_;
+			}
+			friend void intrusive_ptr_release(const remote_path* p)
+			{
+				p->release();
+			}
+
+		private:
+			void release()const;
+
+		private:
+			friend class basic_shared_udp_layer;
+			mutable atomic<int32_t> ref_count_;
+			mutable fast_mutex mutex_;
+			int32_t srtt_;
+			int32_t rttvar_;
+			double lost_rate_;
+		};
 	
 	public:
 		//called by urdp to connect a remote endpoint
@@ -172,6 +261,11 @@ namespace p2engine { namespace urdp{
 			error_code& ec
 			);
 
+		//called by flow to share the path state with the other flows to
+		//the same remote endpoint, the path is created if it is not there.
+		remote_path::smart_ptr path_to(const endpoint_type& remote_edp,
+			int32_t now);
+
 	protected:
 		static shared_ptr create(io_service& ios, 
 			const endpoint_type& local_edp, error_code& ec
@@ -263,6 +357,17 @@ namespace p2engine { namespace urdp{
 		std::size_t async_send_to(const ConstBuffers& bufs,
 			const endpoint_type& ep,error_code& ec);
 
+		//grow SO_RCVBUF so that the kernel does not drop the window of a flow
+		//that uses a receive buffer of n bytes, it never shrinks.
+		void reserve_receive_buffer(std::size_t n);
+
+		//send one datagram with DF set and wait for the kernel to take it.
+		//used by path mtu probes, a probe bigger than the local interface
+		//allows fails here with message_size. it goes by a socket of its 
+		//own on the same address, so it comes from another port.
+		std::size_t send_probe_to(const safe_buffer& header,
+			const safe_buffer& padding,const endpoint_type& ep,error_code& ec);
+
 	protected:
 		void __release_flow_id(int id);
 
@@ -284,25 +389,48 @@ namespace p2engine { namespace urdp{
 				return remoteEndpoint<rhs.remoteEndpoint;
 			}
 		};
+		//a client resuming a session sends before it knows its flow id 
+		//here, such packets are routed by where they come from.
+		struct early_data_uuid{
+			endpoint_type remoteEndpoint;
+			uint32_t session;
+			uint32_t flow_id;
+			bool operator <(const early_data_uuid& rhs)const
+			{
+				if (session!=rhs.session)
+					return session<rhs.session;
+				return remoteEndpoint<rhs.remoteEndpoint;
+			}
+		};
+
+		typedef std::map<endpoint_type, remote_path*> path_container;
 
 		udp_socket_type socket_;
+		//DF is kept on here, never on socket_ that every flow sends by
+		boost::scoped_ptr<udp_socket_type> probe_socket_;
+		fast_mutex probe_mutex_;
 		endpoint_type local_endpoint_;
 		safe_buffer recv_buffer_;
 		endpoint_type sender_endpoint_;
 		timed_keeper_set<request_uuid> request_uuid_keeper_;
+		timed_keeper_set<early_data_uuid> early_data_uuid_keeper_;
 		local_id_allocator id_allocator_;
 		std::list<int> released_id_catch_;
 		timed_keeper_set<int> released_id_keeper_;
 		timed_keeper_set<endpoint_type> unreachable_endpoint_keeper_;
 		acceptor_container	  acceptors_;
 		flow_container        flows_;
+		path_container        paths_;
 		int                   flows_cnt_;
 		linger_send_container lingerSends_;
 		fast_mutex flow_mutex_;
 		fast_mutex acceptor_mutex_;
+		fast_mutex path_mutex_;
 		//rough_timer_shared_ptr lingerSendTimer_;
 		int state_;
 		int	continuous_recv_cnt_;
+		std::size_t recv_size_;
+		std::size_t socket_recv_buf_size_;
 
 		//recv handler(for performance)
 		
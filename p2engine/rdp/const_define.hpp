@@ -34,6 +34,10 @@ namespace p2engine{
 	static const uint32_t	 INVALID_FLOWID=0xffffff;
 	static const uint16_t    INVALID_MSGTYPE=(uint16_t)0xffff;
 	static const std::size_t MTU_SIZE=1450;
+	static const std::size_t IPV4_UDP_HEADER_SIZE=20+8;
+	static const std::size_t IPV6_UDP_HEADER_SIZE=40+8;
+	static const std::size_t MAX_UDP_PAYLOAD_SIZE=65535-IPV4_UDP_HEADER_SIZE;
+	static const int32_t     RESUME_TICKET_LIFETIME=30*60*1000;//msec
 
 }
 
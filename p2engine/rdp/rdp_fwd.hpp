@@ -25,6 +25,7 @@
 
 #include "p2engine/basic_dispatcher.hpp"
 #include "p2engine/connection.hpp"
+#include "p2engine/safe_buffer_chain.hpp"
 
 namespace p2engine{
 
@@ -92,6 +93,11 @@ namespace p2engine{
 		virtual void on_disconnected(const error_code&)=0;
 		virtual void on_writeable()=0;
 		virtual void on_received(const safe_buffer&)=0;
+		//a flow that delivers the received segments as they are
+		virtual void on_received(const safe_buffer_chain& bufs)
+		{
+			on_received(bufs.to_safe_buffer());
+		}
 		virtual void set_flow(flow_sptr sock)=0;
 	};
 
@@ -120,6 +126,16 @@ namespace p2engine{
 		//this will be called by flow when a passive flow is established
 		virtual void accept_flow(flow_sptr flow)=0;
 		virtual const std::string& get_domain()const=0;
+
+		//a resume ticket lets a client that connected before send data
+		//without waiting for the handshake. a ticket is redeemed once only,
+		//an acceptor that does not support resumption issues 0.
+		virtual uint64_t issue_resume_ticket(){return 0;}
+		virtual bool redeem_resume_ticket(uint64_t ticket)
+		{
+			UNUSED_PARAMETER(ticket);
+			return false;
+		}
 	};
 
 }
@@ -124,20 +124,29 @@ namespace p2engine{ namespace trdp{
 		virtual void async_send_reliable(const safe_buffer& buf, message_type msgType)
 		{
 			if (flow_)
+			{
 				flow_->async_send_reliable(buf,msgType);
+				this->check_send_high_watermark(flow_->overstocked_send_size());
+			}
 		}
 		//unreliable send
 		virtual void async_send_unreliable(const safe_buffer& buf, message_type msgType)
 		{
 			if (flow_)
+			{
 				flow_->async_send_unreliable(buf,msgType);
+				this->check_send_high_watermark(flow_->overstocked_send_size());
+			}
 		}
 		//partial reliable send. message will be send for twice within about 100ms.
 		//reliable is not confirmed.
 		virtual void async_send_semireliable(const safe_buffer& buf, message_type msgType)
 		{
 			if (flow_)
+			{
 				flow_->async_send_semireliable(buf,msgType);
+				this->check_send_high_watermark(flow_->overstocked_send_size());
+			}
 		}
 
 		virtual void keep_async_receiving()
@@ -270,6 +279,13 @@ namespace p2engine{ namespace trdp{
 			return INVALID_FLOWID;
 		}
 
+		virtual std::size_t overstocked_send_size()const
+		{
+			if (flow_)
+				return flow_->overstocked_send_size();
+			return 0;
+		}
+
 	protected:
 		virtual void set_flow(flow_sptr flow)
 		{
@@ -303,7 +319,8 @@ namespace p2engine{ namespace trdp{
 		}
 		virtual void on_writeable()
 		{
-			this->writable_signal()();
+			if (this->check_send_low_watermark(overstocked_send_size()))
+				this->writable_signal()();
 		}
 
 	protected:
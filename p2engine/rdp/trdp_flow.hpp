@@ -207,6 +207,11 @@ namespace p2engine{ namespace trdp{
 			__send(buffer,(char)DATA_PKT,true,&msgType);
 		}
 
+		std::size_t overstocked_send_size()const
+		{
+			return (std::size_t)qued_sending_size_;
+		}
+
 		bool is_open() const 
 		{
 			return socket_impl_.is_open();
@@ -356,7 +361,9 @@ namespace p2engine{ namespace trdp{
 
 		std::queue<send_emlment> send_bufs_;
 		bool sending_;
+		//bytes in send_bufs_ and being written
 		int qued_sending_size_;
+		int sending_size_;
 
 		uint32_t flowid_;
 
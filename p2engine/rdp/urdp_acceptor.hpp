@@ -33,6 +33,8 @@
 #include "p2engine/shared_access.hpp"
 #include "p2engine/fssignal.hpp"
 #include "p2engine/timer.hpp"
+#include "p2engine/keeper.hpp"
+#include "p2engine/random.hpp"
 #include "p2engine/safe_buffer.hpp"
 #include "p2engine/wrappable_integer.hpp"
 #include "p2engine/acceptor.hpp"
@@ -72,6 +74,7 @@ namespace p2engine { namespace urdp{
 
 	protected:
 		enum state{CLOSED,LISTENING};
+		enum{MAX_RESUME_TICKETS=4096};
 
 	public:
 		static shared_ptr create(io_service& ios,bool realTimeUsage)
@@ -198,6 +201,29 @@ namespace p2engine { namespace urdp{
 			return this->domain();
 		}
 
+		virtual uint64_t issue_resume_ticket()
+		{
+			if (resume_tickets_.size()>=MAX_RESUME_TICKETS)
+				return 0;
+			uint64_t ticket;
+			do{
+				ticket=((uint64_t)random()<<32)|random();
+			}while(!ticket||resume_tickets_.is_keeped(ticket));
+			resume_tickets_.try_keep(ticket,milliseconds(RESUME_TICKET_LIFETIME));
+			return ticket;
+		}
+
+		//the ticket is forgotten once redeemed, so a replayed CONNECT has
+		//to go through the handshake before its data is accepted
+		virtual bool redeem_resume_ticket(uint64_t ticket)
+		{
+			typename timed_keeper_set<uint64_t>::iterator itr=resume_tickets_.find(ticket);
+			if (itr==resume_tickets_.end())
+				return false;
+			resume_tickets_.erase(itr);
+			return true;
+		}
+
 	protected:
 		void do_async_accept()
 		{
@@ -293,6 +319,7 @@ namespace p2engine { namespace urdp{
 	private:
 		token_sptr token_;
 		std::queue<flow_sptr> pending_flows_;
+		timed_keeper_set<uint64_t> resume_tickets_;
 
 		state state_;
 		bool b_keep_accepting_;
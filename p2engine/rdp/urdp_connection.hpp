@@ -72,6 +72,9 @@ namespace p2engine{ namespace urdp{
 
 		typedef typename BaseConnectionType::connection_t connection_t;
 
+		typedef fssignal::signal<void(safe_buffer_chain)> chain_received_signal_type;
+		typedef boost::unordered_map<message_type,chain_received_signal_type> chain_dispatch_map;
+
 	protected:
 		friend class urdp_flow;
 		template<typename Socket,typename SocketBase> friend class basic_urdp_acceptor;
@@ -166,7 +169,26 @@ namespace p2engine{ namespace urdp{
 		virtual void async_send_reliable(const safe_buffer& buf, message_type msgType)
 		{
 			if (flow_)
+			{
 				flow_->async_send(buf,msgType,true);
+				this->check_send_high_watermark(flow_->overstocked_send_size(),
+					send_queue_limit());
+			}
+		}
+		virtual void async_send_on_stream(const safe_buffer& buf, message_type msgType,
+			stream_id_type streamId)
+		{
+			if (flow_)
+			{
+				flow_->async_send(buf,msgType,true,streamId);
+				this->check_send_high_watermark(flow_->overstocked_send_size(),
+					send_queue_limit());
+			}
+		}
+		virtual void stream_priority(stream_id_type streamId, int priority, int weight=1)
+		{
+			if (flow_)
+				flow_->stream_priority(streamId,priority,weight);
 		}
 		//unreliable send
 		virtual void async_send_unreliable(const safe_buffer& buf, message_type msgType)
@@ -221,6 +243,130 @@ namespace p2engine{ namespace urdp{
 			return seconds(0xffffffffUL);
 		}
 
+		//see urdp_flow::receive_buffer_size
+		void receive_buffer_size(std::size_t n)
+		{
+			if (flow_) flow_->receive_buffer_size(n);
+		}
+		std::size_t receive_buffer_size()const
+		{
+			if (flow_)
+				return flow_->receive_buffer_size();
+			return 0;
+		}
+
+		//see urdp_flow::send_buffer_size
+		void send_buffer_size(std::size_t n)
+		{
+			if (flow_)
+			{
+				flow_->send_buffer_size(n);
+				this->check_send_high_watermark(flow_->overstocked_send_size(),
+					send_queue_limit());
+			}
+		}
+		std::size_t send_buffer_size()const
+		{
+			if (flow_)
+				return flow_->send_buffer_size();
+			return 0;
+		}
+		//the send watermarks are kept within the send buffer of the flow
+		std::size_t send_queue_limit()const
+		{
+			if (flow_)
+				return flow_->send_buffer_size();
+			return (std::numeric_limits<std::size_t>::max)();
+		}
+
+		//see urdp_flow::fec_enabled
+		void fec_enabled(bool enable)
+		{
+			if (flow_) flow_->fec_enabled(enable);
+		}
+		bool fec_enabled()const
+		{
+			if (flow_)
+				return flow_->fec_enabled();
+			return false;
+		}
+
+		//see urdp_flow::session_resumption, open the connection first
+		void session_resumption(bool enable)
+		{
+			if (flow_) flow_->session_resumption(enable);
+		}
+		bool session_resumption()const
+		{
+			if (flow_)
+				return flow_->session_resumption();
+			return false;
+		}
+		//see urdp_flow::session_resumed
+		bool session_resumed()const
+		{
+			if (flow_)
+				return flow_->session_resumed();
+			return false;
+		}
+
+		//see urdp_flow::scatter_delivery, open the connection first
+		void scatter_delivery(bool enable)
+		{
+			if (flow_) flow_->scatter_delivery(enable);
+		}
+		bool scatter_delivery()const
+		{
+			if (flow_)
+				return flow_->scatter_delivery();
+			return false;
+		}
+		//messages of msgType in scatter delivery, the message type is 
+		//trimmed as in received_signal. messages of a type with no slot 
+		//here are put together and go to received_signal.
+		chain_received_signal_type& chain_received_signal(const message_type& msgType)
+		{
+			return chain_msg_handler_map_[msgType];
+		}
+
+		//see urdp_flow::add_local_path
+		void add_local_path(const endpoint& localEdp, error_code& ec)
+		{
+			if (flow_)
+				flow_->add_local_path(localEdp, ec);
+			else
+				ec=asio::error::not_socket;
+		}
+		std::size_t path_count()const
+		{
+			if (flow_)
+				return flow_->path_count();
+			return 0;
+		}
+
+		//see urdp_flow::message_priority
+		void message_priority(message_type msgType, int priority)
+		{
+			if (flow_) flow_->message_priority(msgType, priority);
+		}
+		int message_priority(message_type msgType)const
+		{
+			if (flow_)
+				return flow_->message_priority(msgType);
+			return 0;
+		}
+
+		void message_lifetime(message_type msgType, const time_duration& lifetime)
+		{
+			if (flow_) flow_->message_lifetime(msgType, lifetime);
+		}
+		time_duration message_lifetime(message_type msgType)const
+		{
+			if (flow_)
+				return flow_->message_lifetime(msgType);
+			return milliseconds(0);
+		}
+
 		virtual endpoint local_endpoint(error_code& ec)const
 		{
 			if (flow_)
@@ -336,6 +482,14 @@ namespace p2engine{ namespace urdp{
 			return INVALID_FLOWID;
 		}
 
+		//reliable data not acked, unreliable data is never queued
+		virtual std::size_t overstocked_send_size()const
+		{
+			if (flow_)
+				return flow_->overstocked_send_size();
+			return 0;
+		}
+
 	public:
 		virtual const std::string& get_domain()const
 		{
@@ -382,9 +536,27 @@ namespace p2engine{ namespace urdp{
 			this->extract_and_dispatch_message(buf);
 		}
 
+		void on_received(const safe_buffer_chain& bufs)
+		{
+			if (!chain_msg_handler_map_.empty()&&bufs.size()>=sizeof(message_type))
+			{
+				safe_buffer_chain msg(bufs);
+				message_type msgType;
+				msg>>msgType;
+				typename chain_dispatch_map::iterator itr=chain_msg_handler_map_.find(msgType);
+				if (itr!=chain_msg_handler_map_.end()&&!itr->second.empty())
+				{
+					(itr->second)(msg);
+					return;
+				}
+			}
+			this->extract_and_dispatch_message(bufs.to_safe_buffer());
+		}
+
 		void on_writeable()
 		{
-			if (state_!=CLOSED)
+			if (state_!=CLOSED
+				&&this->check_send_low_watermark(overstocked_send_size(),send_queue_limit()))
 				this->writable_signal()();
 		}
 
@@ -404,10 +576,16 @@ namespace p2engine{ namespace urdp{
 			}
 			state_=CLOSED;
 			this->disconnect_all_slots();
+			while(!chain_msg_handler_map_.empty())
+			{
+				chain_msg_handler_map_.begin()->second.disconnect_all_slots();
+				chain_msg_handler_map_.erase(chain_msg_handler_map_.begin());
+			}
 		}
 
 	private:
 		boost::shared_ptr<flow_type> flow_;
+		chain_dispatch_map chain_msg_handler_map_;
 		std::string domain_;
 		int state_;
 		endpoint cached_remote_endpoint_;
@@ -26,6 +26,10 @@
 #include "p2engine/push_warning_option.hpp"
 #include "p2engine/config.hpp"
 #include <set>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/array.hpp>
 #include <boost/logic/tribool.hpp>
 #include <boost/optional.hpp>
 #include "p2engine/pop_warning_option.hpp"
@@ -33,6 +37,7 @@
 #include "p2engine/fast_stl.hpp"
 #include "p2engine/packet.hpp"
 #include "p2engine/keeper.hpp"
+#include "p2engine/mutex.hpp"
 #include "p2engine/timer.hpp"
 #include "p2engine/speed_meter.hpp"
 #include "p2engine/operation_mark.hpp"
@@ -74,6 +79,8 @@ namespace p2engine { namespace urdp{
 
 		typedef boost::shared_ptr<shared_layer_type> shared_layer_sptr;
 		typedef flow_token_type::smart_ptr flow_token_sptr;
+		typedef shared_layer_type::remote_path remote_path_type;
+		typedef remote_path_type::smart_ptr remote_path_sptr;
 		typedef boost::shared_ptr<acceptor_type> acceptor_sptr;
 		typedef boost::shared_ptr<connection_type>  connection_sptr;
 		typedef boost::shared_ptr<timer_type> timer_sptr;
@@ -89,7 +96,13 @@ namespace p2engine { namespace urdp{
 		enum TcpState {INIT, LISTEN, SYN_SENT, SYN_RCVD, ESTABLISHED, CLOSING,
 			WATING_FIN_ACK, CLOSED};
 		enum SendFlags { sfNone, sfDelayedAck, sfImmediateAck};
-		enum {RECV_BUF_SIZE = 0xffff+16*1024,SND_BUF_SIZE =RECV_BUF_SIZE*3/2};
+		enum PmtuState {PMTU_DISABLED, PMTU_SEARCHING, PMTU_SEARCH_COMPLETE};
+		enum {
+			DEFAULT_RECV_BUF_SIZE = 0xffff+16*1024,
+			DEFAULT_SND_BUF_SIZE = DEFAULT_RECV_BUF_SIZE*3/2,
+			MIN_BUF_SIZE = 2*MTU_SIZE,
+			MAX_BUF_SIZE = 16*1024*1024
+		};
 
 	public:
 		static shared_ptr create_for_active_connect(connection_sptr sock,
@@ -134,8 +147,22 @@ namespace p2engine { namespace urdp{
 			const time_duration& time_out=boost::date_time::pos_infin
 			);
 
+		//reliable messages are sent on streamId, messages of one stream keep
+		//their order, see stream_priority.
 		void async_send(const safe_buffer& buf, message_type msgType
-			,boost::logic::tribool reliable);
+			,boost::logic::tribool reliable, stream_id_type streamId=0);
+
+		//reliable messages of the stream with the highest priority are sent
+		//first, streams of one priority share the window by weight. only
+		//the messages waiting for the window are reordered, so a small
+		//message of a high priority stream is not queued behind a bulk 
+		//transfer. a message is never split between streams.
+		void stream_priority(stream_id_type streamId, int priority, int weight=1);
+
+		std::size_t overstocked_send_size()const
+		{
+			return m_slen+m_stream_qlen;
+		}
 
 		void keep_async_receiving();
 		void block_async_receiving()
@@ -157,6 +184,90 @@ namespace p2engine { namespace urdp{
 		{
 			return milliseconds(m_srtt);
 		}
+		//bytes the remote may send before we read them, it is the window 
+		//advertised to the remote. may be changed at any time, the window
+		//is scaled when the remote supports it so up to MAX_BUF_SIZE can be
+		//used, otherwise the window stays below 64K.
+		void receive_buffer_size(std::size_t n);
+		std::size_t receive_buffer_size()const
+		{
+			return m_rcv_buf_size;
+		}
+		//bytes of reliable messages queued for sending before the connection
+		//is send blocked, it works as a high watermark below the one of the
+		//connection. messages sent beyond it are still queued.
+		void send_buffer_size(std::size_t n);
+		std::size_t send_buffer_size()const
+		{
+			return m_snd_buf_size;
+		}
+		//send a xor parity for every group of unreliable and semireliable
+		//packets when the remote can decode it, a single lost packet of the
+		//group is recovered by the remote. the group is smaller when more
+		//packets are lost. off by default.
+		void fec_enabled(bool enable)
+		{
+			m_fec_enabled=enable;
+		}
+		bool fec_enabled()const
+		{
+			return m_fec_enabled;
+		}
+		//keep the resume ticket the remote issues and use it on the next
+		//connect to the same endpoint and domain: that flow is connected at
+		//once, sends its data right behind CONNECT and starts from the last
+		//rtt, cwnd and path mtu. the remote delivers the data before the
+		//handshake ends only if the ticket has not been used yet. set it 
+		//before async_connect, off by default.
+		void session_resumption(bool enable)
+		{
+			m_session_resumption=enable;
+		}
+		bool session_resumption()const
+		{
+			return m_session_resumption;
+		}
+		//the connection was made by a resume ticket and its first data went
+		//with CONNECT. on the server it means the ticket was taken and the
+		//data delivered before the handshake ended.
+		bool session_resumed()const
+		{
+			return b_session_resumed_;
+		}
+		//deliver every message as the list of the segments it came in, 
+		//by on_received(const safe_buffer_chain&) of the connection. a large
+		//segment keeps the datagram it was received in instead of a copy,
+		//so a message only forwarded is never copied. off by default.
+		void scatter_delivery(bool enable)
+		{
+			m_scatter_delivery=enable;
+		}
+		bool scatter_delivery()const
+		{
+			return m_scatter_delivery;
+		}
+		//of unreliable and semireliable messages of msgType. the messages
+		//due at the same time are sent in order of priority, the higher 
+		//first. a message is not sent again once lifetime has passed since 
+		//it was sent, a lifetime of 0 means no limit.
+		void message_priority(message_type msgType, int priority);
+		int message_priority(message_type msgType)const;
+		void message_lifetime(message_type msgType, const time_duration& lifetime);
+		time_duration message_lifetime(message_type msgType)const;
+
+		//largest payload of a reliable packet on the current path mtu
+		std::size_t mss() const
+		{
+			return m_mss;
+		}
+		//send over one more local endpoint as well, such as the address of
+		//another interface found by enum_net_interfaces. the flow must be
+		//connected to a remote that supports it. new segments are spread
+		//over the paths by their rtt and loss rate, the remote puts them in
+		//order by sequence.
+		void add_local_path(const endpoint_type& localEdp, error_code& ec);
+		//paths that have been joined, including the one connected by
+		std::size_t path_count()const;
 		double alive_probability()const;
 		double local_to_remote_speed()const
 		{
@@ -214,8 +325,10 @@ namespace p2engine { namespace urdp{
 			uint32_t seq;
 			int8_t xmit;
 			uint8_t ctrlType;
+			uint8_t subpath;//sent over it last time
+			time32_type t_sent;
 			SSegment(uint32_t s,uint8_t c) 
-				: seq(s),xmit(0), ctrlType(c) 
+				: seq(s),xmit(0), ctrlType(c), subpath(0), t_sent(0)
 			{ }
 		};
 
@@ -232,37 +345,143 @@ namespace p2engine { namespace urdp{
 			safe_buffer buf;
 			int32_t id;
 			time32_type timeout;
+			time32_type deadline;//0 means none
 			uint16_t pktID;
 			uint16_t msgType;
 			int8_t remainXmit;
+			int8_t priority;
 			uint8_t control;
 
-			SUnraliableSegment(){
+			SUnraliableSegment():deadline(0),priority(0){
 				static int32_t id_seed__=0;
 				id=id_seed__++;
 			}
-
-			bool operator <(const SUnraliableSegment& rhs)const{
-				if (timeout!=rhs.timeout)
-					return mod_less(timeout,rhs.timeout);
-				return mod_less(id,rhs.id);
+		};
+		//heap order of the unreliable scheduler, the top is the earliest 
+		//timeout and of one timeout the highest priority
+		struct SUnraliableSegmentLater {
+			bool operator()(const SUnraliableSegment& lhs, 
+				const SUnraliableSegment& rhs)const{
+				if (lhs.timeout!=rhs.timeout)
+					return mod_less(rhs.timeout,lhs.timeout);
+				if (lhs.priority!=rhs.priority)
+					return lhs.priority<rhs.priority;
+				return mod_less(rhs.id,lhs.id);
 			}
 		};
+		struct SMessagePolicy {
+			int8_t priority;
+			time32_type lifetime;//0 means no deadline
+			SMessagePolicy():priority(0),lifetime(0){}
+		};
+
+		struct SStreamMessage {
+			safe_buffer buf;
+			uint16_t msgType;
+			SStreamMessage(const safe_buffer& b, uint16_t t):buf(b),msgType(t){}
+		};
+		struct SStream {
+			std::deque<SStreamMessage> msgs;
+			uint64_t vtime;//start-time fair queuing among one priority
+			int8_t priority;
+			uint16_t weight;
+			SStream():vtime(0),priority(0),weight(1){}
+		};
+
+		enum{FEC_RECV_SLOTS=64};
+		struct RFecPacket {
+			safe_buffer buf;//msgType and data
+			time32_type time;
+			uint16_t pktID;
+			uint8_t control;
+			bool valid;
+			RFecPacket():time(0),pktID(0),control(0),valid(false){}
+		};
+		struct RFecParity {
+			safe_buffer buf;//xor of the data
+			time32_type time;
+			uint16_t base;
+			uint8_t count;
+			uint16_t semiMask;
+			uint16_t lenXor;
+			uint16_t typeXor;
+		};
 
 		typedef std::deque<SSegment> SSegmentList;
 		typedef std::set<RSegment> RSegmentList;
 		typedef std::deque<safe_buffer> RUnraliablePacketList;
-		typedef std::set<SUnraliableSegment> SUnraliableSegmentList;
+		typedef std::vector<SUnraliableSegment> SUnraliableSegmentHeap;
+		typedef std::map<message_type, SMessagePolicy> MessagePolicyMap;
+		typedef std::deque<RFecParity> RFecParityList;
+		typedef std::map<stream_id_type, SStream> StreamMap;
+
+		//what a client remembers of a server to resume a session with it
+		struct SResumeTicket {
+			uint64_t ticket;
+			time32_type time;//when the ticket was received
+			time32_type srtt, rttvar;
+			uint32_t cwnd;
+			uint32_t pmtu;//0 if it was not searched
+		};
+		typedef std::pair<shared_layer_type::endpoint_type, std::string> ResumeTicketKey;
+		typedef std::map<ResumeTicketKey, SResumeTicket> ResumeTicketMap;
+
+		//a way to the remote, the first one is the way the flow connected by
+		struct SSubpath {
+			flow_token_sptr token;//NULL to send by m_token
+			endpoint_type remote_endpoint;
+			uint32_t remote_peer_id;
+			uint64_t nonce;//ours in PATH_JOIN or in PATH_JOIN_ACK
+			uint64_t remote_nonce;//the remote's in PATH_JOIN or PATH_JOIN_ACK
+			time32_type t_join;//time to resend PATH_JOIN(_ACK), 0 if none
+			uint8_t join_xmit;
+			bool joiner;//we sent PATH_JOIN
+			bool validated;
+			time32_type srtt;
+			double lost_rate;
+			int64_t weight_current;//smooth weighted round robin
+			SSubpath():remote_peer_id(0),nonce(0),remote_nonce(0),t_join(0),join_xmit(0)
+				,joiner(false),validated(false),srtt(0),lost_rate(0)
+				,weight_current(0){}
+		};
+		typedef std::vector<SSubpath> SubpathList;
 
 		void __async_receive(op_stamp_t mark);
 		int  __recv(safe_buffer& buf,error_code& ec);
+		int  __recv(safe_buffer_chain& bufs,error_code& ec);
+		int  __can_recv(error_code& ec);
+		void __update_rcv_wnd();
 		int  __send(safe_buffer buf,uint16_t msgType, boost::logic::tribool reliable,
-			error_code& ec);
+			stream_id_type streamId, error_code& ec);
+		void __fill_from_streams(uint32_t len);
 		void __close(bool graceful);
 
 		int __packet_as_reliable_and_sendout(uint32_t seq, uint8_t control,
-			const safe_buffer* data, time32_type now);
+			const safe_buffer* data, time32_type now, std::size_t subpath=0);
+		void __fill_reliable_header(packet<reliable_packet_format_type>& urdp_header,
+			uint32_t seq, uint8_t control, time32_type now);
+		void __fill_unreliable_header(packet<unreliable_packet_format_type>& urdp_header,
+			uint8_t control);
+		void __on_syn_options(uint16_t options);
+		uint16_t __ack_frequency_request()const;
+		uint32_t __ack_frequency_packets()const;
+		void __on_ack_frequency(uint16_t request);
+		uint16_t __advertised_window(uint8_t control)const;
+		uint32_t __remote_window(uint32_t window, uint8_t control)const;
 		int __packet_as_unreliable_and_sendout(SUnraliableSegment& seg, time32_type now); 
+		void __schedule_unreliable(SUnraliableSegment& seg);
+		void __send_due_unreliable(time32_type now);
+		bool __keep_unreliable(const safe_buffer& pkt, uint16_t pktID, uint8_t control,
+			time32_type now);
+
+		bool __fec_active()const;
+		uint8_t __fec_group_size()const;
+		void __fec_add(const SUnraliableSegment& seg, time32_type now);
+		void __fec_send_parity(time32_type now);
+		bool __fec_received(uint16_t pktID, time32_type now)const;
+		bool __fec_on_parity(const safe_buffer& body, time32_type now);
+		bool __fec_try_recover(time32_type now);
+		bool __fec_recover(const RFecParity& parity, uint8_t missing, time32_type now);
 		uint32_t __queue(const char * data, std::size_t len, uint8_t ctrlType,
 			std::size_t reserveLen=0);
 		bool __transmit(const SSegmentList::iterator& seg, time32_type now);
@@ -277,8 +496,51 @@ namespace p2engine { namespace urdp{
 		void __on_clock(VC9_BIND_BUG_PARAM_DECLARE);
 
 		void __adjust_mtu();
+		void __resegment(SSegmentList& slist);
+
+		//path mtu discovery
+		void __pmtu_start(time32_type now);
+		void __pmtu_search(uint32_t low, time32_type now);
+		void __pmtu_on_timer(time32_type now);
+		void __pmtu_next_probe(time32_type now);
+		void __pmtu_send_probe(uint32_t size, time32_type now);
+		void __pmtu_on_probe(const char* data, uint32_t dataLen, uint32_t pktLen,
+			time32_type now);
+		void __pmtu_on_probe_ack(const char* data, uint32_t dataLen, time32_type now);
+		void __pmtu_black_hole(time32_type now);
+		uint32_t __pmtu_ceiling();
+
+		bool __path_on_moved_packet(const safe_buffer& sbuf, const endpoint_type& from,
+			time32_type now);
+		bool __path_in_window(uint32_t seqno, uint32_t ackno)const;
+		void __path_send_challenge(time32_type now);
+		void __path_on_challenge(const char* data, uint32_t dataLen, 
+			const endpoint_type& from, time32_type now);
+		void __path_on_timer(time32_type now);
+		void __path_migrate(time32_type now);
+
+		std::size_t __select_subpath();
+		std::size_t __best_subpath()const;
+		int64_t __subpath_weight(const SSubpath& sp)const;
+		SSubpath* __find_subpath(const endpoint_type& remoteEdp);
+		void __subpath_send(std::size_t idx, uint8_t control, const char* data,
+			std::size_t len, time32_type now);
+		void __subpath_send_join(std::size_t idx, time32_type now);
+		void __subpath_on_join(const char* data, uint32_t dataLen, 
+			const endpoint_type& from, time32_type now);
+		void __subpath_on_join_ack(const char* data, uint32_t dataLen, time32_type now);
+		void __subpath_on_timer(time32_type now);
+		void __subpath_on_lost(std::size_t idx);
+		void __subpath_on_acked(std::size_t idx);
+		void __subpath_on_rtt(std::size_t idx, time32_type rtt);
+		uint32_t __dup_ack_threshold()const;
 		void __incress_rto();
 		void __updata_rtt(long msec);
+		void __attach_path(time32_type now);
+		bool __take_resume_ticket(time32_type now);
+		void __keep_resume_ticket(bool refreshOnly);
+		time32_type __ping_base_time(time32_type now)const;
+		time32_type __idle_deadline()const;
 
 		void __schedule_timer(time32_type now,bool calledInOnClock=false);
 
@@ -288,6 +550,7 @@ namespace p2engine { namespace urdp{
 		void __allert_connected(const error_code&);
 		void __allert_disconnected(const error_code&);
 		void __allert_received(const safe_buffer& buf);
+		void __allert_received(const safe_buffer_chain& bufs);
 		void __allert_readable();
 		void __allert_writeable();
 		void __allert_accepted();
@@ -304,10 +567,23 @@ namespace p2engine { namespace urdp{
 	protected:
 		//йunreliable
 		RUnraliablePacketList m_unreliable_rlist;
-		SUnraliableSegmentList m_unreliable_slist;
-		timed_keeper_set<uint16_t> m_unreliable_rkeeper;
+		SUnraliableSegmentHeap m_unreliable_sheap;
+		MessagePolicyMap m_message_policy;
+		timed_wheel_keeper_set<uint16_t> m_unreliable_rkeeper;
 
 		uint16_t m_unreliable_pktid;
+
+		//forward error correction, the group being sent and what is kept
+		//for recovering the lost packets of the remote's groups
+		bool m_fec_enabled;
+		bool m_scatter_delivery;
+		uint16_t m_fec_base;
+		uint8_t m_fec_count, m_fec_group_size;
+		uint16_t m_fec_semi_mask, m_fec_len_xor, m_fec_type_xor;
+		std::vector<char> m_fec_xor;
+		time32_type m_t_fec_flush;
+		boost::array<RFecPacket, FEC_RECV_SLOTS> m_fec_rpkts;
+		RFecParityList m_fec_rparity;
 		//host& m_host;
 		ShutdownMode m_shutdown;
 
@@ -320,12 +596,19 @@ namespace p2engine { namespace urdp{
 
 		// Incoming data
 		RSegmentList m_rlist;
-		uint32_t m_rcv_nxt, m_rcv_wnd, m_rlen;
+		uint32_t m_rcv_nxt, m_rcv_wnd, m_rlen, m_rcv_buf_size;
+		uint8_t m_rcv_wscale;
 
 		// Outgoing data
 		SSegmentList m_slist,m_retrans_slist;
-		uint32_t m_snd_nxt, m_snd_wnd, m_slen,m_snd_una;
+		uint32_t m_snd_nxt, m_snd_wnd, m_slen,m_snd_una, m_snd_buf_size;
+		uint8_t m_snd_wscale;
 		uint32_t m_mss;
+
+		// Reliable messages waiting for the window, by stream
+		StreamMap m_streams;
+		uint32_t m_stream_qlen;
+		uint64_t m_stream_vtime;
 		time32_type m_t_rto_base;
 
 		// Timestamp tracking
@@ -343,10 +626,42 @@ namespace p2engine { namespace urdp{
 		uint32_t m_recover;
 		time32_type m_t_ack;
 		uint8_t  m_dup_acks;
+		uint32_t m_ack_pending;//data packets received since the last ACK
+		uint32_t m_ack_frequency;//packets the remote lets us ACK at once
+		time32_type m_ack_delay;
 
 		uint32_t m_remote_peer_id;
 		time32_type m_ping_interval;
 
+		// Path mtu discovery, sizes are of whole urdp packets
+		uint16_t m_remote_syn_options;
+		uint8_t m_pmtu_state;
+		uint8_t m_pmtu_probe_count;
+		uint32_t m_pmtu, m_pmtu_low, m_pmtu_high, m_pmtu_probe_size;
+		uint32_t m_pmtu_retry_size;//a probe the socket could not send yet
+		time32_type m_t_pmtu;
+
+		// Connection migration, the endpoint the remote seems to have moved 
+		// to and the nonce it has to echo before the flow follows it
+		endpoint_type m_probing_endpoint;
+		uint64_t m_path_challenge;
+		uint8_t m_path_challenge_xmit;
+		time32_type m_t_path_challenge;
+
+		// Multipath, empty until another path has joined
+		SubpathList m_subpaths;
+		time32_type m_t_subpath;
+
+		// Session resumption, the ticket to send with CONNECT and then the
+		// one received in CONNECT_ACK
+		bool m_session_resumption;
+		uint64_t m_resume_ticket;
+		time32_type m_t_resume_ticket;
+		uint32_t m_resume_pmtu;
+		std::string m_resume_domain;
+		static ResumeTicketMap s_resume_tickets;
+		static fast_mutex s_resume_tickets_mutex;
+
 	protected:
 		shared_ptr m_self_holder;
 		endpoint_type m_remote_endpoint;
@@ -354,6 +669,7 @@ namespace p2engine { namespace urdp{
 		timer_sptr m_timer;
 		connection_type*    m_socket;
 		flow_token_sptr m_token;
+		remote_path_sptr m_path;
 		boost::weak_ptr<acceptor_type> m_acceptor;
 
 		int m_dissconnect_reason;
@@ -365,6 +681,8 @@ namespace p2engine { namespace urdp{
 		bool b_active_:1;
 		bool b_timer_posted_:1;
 		bool b_close_called_:1;
+		bool b_resuming_:1;//connected by a resume ticket, waiting for CONNECT_ACK
+		bool b_session_resumed_:1;
 
 	protected:
 		rough_speed_meter in_speed_meter_;
@@ -58,9 +58,73 @@ namespace p2engine { namespace urdp{
 
 		CTRL_RST,
 		CTRL_FIN,
-		CTRL_FIN_ACK
+		CTRL_FIN_ACK,
+
+		//path mtu probe, only sent to a peer that has SYN_OPT_PMTU_PROBE
+		CTRL_PMTU_PROBE,
+		CTRL_PMTU_PROBE_ACK,
+
+		//xor parity of a group of unreliable and semireliable packets,
+		//only sent to a peer that has SYN_OPT_FEC
+		CTRL_FEC_PARITY,
+
+		//a nonce sent to the new endpoint of a peer that has 
+		//SYN_OPT_MIGRATION, the response echoes it from that endpoint
+		CTRL_PATH_CHALLENGE,
+		CTRL_PATH_RESPONSE,
+
+		//another local socket of a peer that has SYN_OPT_MULTIPATH joins
+		//the flow: PATH_JOIN carries a nonce and the flow id on that socket,
+		//PATH_JOIN_ACK echoes the nonce with one of its own, which the 
+		//joiner echoes by CTRL_PATH_RESPONSE
+		CTRL_PATH_JOIN,
+		CTRL_PATH_JOIN_ACK
 	};
 
+	//CONNECT and CONNECT_ACK carry the options a peer supports in the
+	//bandwidth_recving field, old peers leave it 0.
+	enum urdp_syn_option
+	{
+		SYN_OPT_PMTU_PROBE=(1<<0),
+
+		//the window field of the sender is in units of (1<<shift) bytes
+		//once both peers have sent this, shift is kept in bits 8-11.
+		//the window of CONNECT and CONNECT_ACK is never scaled.
+		SYN_OPT_WINDOW_SCALE=(1<<1),
+		SYN_OPT_WINDOW_SHIFT_OFFSET=8,
+		SYN_OPT_WINDOW_SHIFT_MASK=(0x0f<<8),
+
+		//the sender decodes CTRL_FEC_PARITY
+		SYN_OPT_FEC=(1<<2),
+
+		//the sender of CONNECT wants a resume ticket, CONNECT_ACK carries
+		//it after the flow id
+		SYN_OPT_RESUME=(1<<3),
+
+		//the last RESUME_TICKET_SIZE bytes of CONNECT are a resume ticket.
+		//the sender goes on without waiting for CONNECT_ACK, what it sends 
+		//before CONNECT_ACK has the invalid peer_id.
+		SYN_OPT_EARLY_DATA=(1<<4),
+
+		//the sender answers CTRL_PATH_CHALLENGE
+		SYN_OPT_MIGRATION=(1<<5),
+
+		//the bandwidth_recving field of CTRL_DATA from the sender asks for
+		//an ACK every (field&0xff) packets and at most (field>>8)*
+		//ACK_FREQUENCY_DELAY_UNIT msec after the first unacked one.
+		//0 leaves it as it was.
+		SYN_OPT_ACK_FREQUENCY=(1<<6),
+
+		//the sender takes CTRL_PATH_JOIN
+		SYN_OPT_MULTIPATH=(1<<7)
+	};
+
+	static const std::size_t RESUME_TICKET_SIZE=8;
+	static const std::size_t PATH_CHALLENGE_SIZE=8;
+	static const std::size_t PATH_JOIN_SIZE=12;
+	static const std::size_t PATH_JOIN_ACK_SIZE=16;
+	static const uint32_t ACK_FREQUENCY_DELAY_UNIT=4;//msec
+
 	//////////////////////////////////////////////////////////////////////
 	//    urdp_packet_basic_format
 	//    0                   1                   2                   3   
@@ -209,7 +273,14 @@ struct get_demain_name_vistor<urdp::urdp_packet_basic_format>
 			if (is_conn_request_vistor<header_format>()(h))
 			{
 				safe_buffer domainBuf=buf.buffer_ref(urdp::urdp_packet_reliable_format::format_size());
-				return std::string(buffer_cast<const char*>(domainBuf),domainBuf.length());
+				std::size_t len=domainBuf.length();
+				if (h.get_bandwidth_recving()&urdp::SYN_OPT_EARLY_DATA)
+				{
+					if (len<urdp::RESUME_TICKET_SIZE)
+						return get_invalid_domain_vistor<header_format>()();
+					len-=urdp::RESUME_TICKET_SIZE;
+				}
+				return std::string(buffer_cast<const char*>(domainBuf),len);
 			}
 		}
 		return get_invalid_domain_vistor<header_format>()();
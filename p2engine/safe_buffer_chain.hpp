@@ -0,0 +1,222 @@
+//
+// safe_buffer_chain.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009, GuangZhu Wu  <guangzhuwu@gmail.com>
+//
+//This program is free software; you can redistribute it and/or modify it
+//under the terms of the GNU General Public License or any later version.
+//
+//This program is distributed in the hope that it will be useful, but
+//WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+//or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//for more details.
+//
+//You should have received a copy of the GNU General Public License along
+//with this program; if not, contact <guangzhuwu@gmail.com>.
+//
+#ifndef P2ENGINE_SAFE_BUFFER_CHAIN_HPP
+#define P2ENGINE_SAFE_BUFFER_CHAIN_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "p2engine/push_warning_option.hpp"
+#include "p2engine/config.hpp"
+#include <vector>
+#include <cstring>
+#include "p2engine/pop_warning_option.hpp"
+
+#include "p2engine/io.hpp"
+#include "p2engine/safe_buffer.hpp"
+#include "p2engine/safe_buffer_io.hpp"
+
+namespace p2engine {
+
+	//a message held as a list of the buffers it was received in, nothing
+	//is copied to put it together. the buffers may share memory with
+	//other messages, they are to be read only.
+	class safe_buffer_chain
+	{
+		typedef safe_buffer_chain this_type;
+
+	public:
+		typedef std::vector<safe_buffer> buffers_type;
+		typedef buffers_type::value_type value_type;
+		typedef buffers_type::const_iterator const_iterator;
+
+	public:
+		safe_buffer_chain():size_(0)
+		{}
+		explicit safe_buffer_chain(const safe_buffer& buf):size_(0)
+		{
+			push_back(buf);
+		}
+
+		void push_back(const safe_buffer& buf)
+		{
+			if (buf.empty())
+				return;
+			buffers_.push_back(buf);
+			size_+=buf.size();
+		}
+
+		void clear()
+		{
+			buffers_.clear();
+			size_=0;
+		}
+
+		void swap(safe_buffer_chain& other)
+		{
+			buffers_.swap(other.buffers_);
+			std::swap(size_, other.size_);
+		}
+
+		//bytes in all buffers
+		std::size_t size()const
+		{
+			return size_;
+		}
+		std::size_t length()const
+		{
+			return size_;
+		}
+		bool empty()const
+		{
+			return size_==0;
+		}
+
+		std::size_t buffer_count()const
+		{
+			return buffers_.size();
+		}
+		const buffers_type& buffers()const
+		{
+			return buffers_;
+		}
+		const_iterator begin()const
+		{
+			return buffers_.begin();
+		}
+		const_iterator end()const
+		{
+			return buffers_.end();
+		}
+
+		//drop n bytes from the front
+		void consume(std::size_t n)
+		{
+			n=(std::min)(n, size_);
+			size_-=n;
+			std::size_t i=0;
+			for (;n>0&&n>=buffers_[i].size();++i)
+				n-=buffers_[i].size();
+			buffers_.erase(buffers_.begin(), buffers_.begin()+i);
+			if (n>0)
+				buffers_.front()=buffers_.front().buffer_ref(n);
+		}
+
+		//copy up to len bytes from the front and consume them
+		std::size_t read(void* buf, std::size_t len)
+		{
+			len=(std::min)(len, size_);
+			char* p=(char*)buf;
+			std::size_t copied=0;
+			for (const_iterator itr=begin();copied<len;++itr)
+			{
+				std::size_t n=(std::min)(len-copied, itr->size());
+				memcpy(p+copied, buffer_cast<const char*>(*itr), n);
+				copied+=n;
+			}
+			consume(len);
+			return len;
+		}
+
+		//take up to len bytes from the front, they are copied only when
+		//they span more than one buffer
+		std::size_t read(safe_buffer& buf, std::size_t len)
+		{
+			len=(std::min)(len, size_);
+			if (len==0)
+				return 0;
+			if (buffers_.front().size()>=len)
+			{
+				buf=buffers_.front().buffer_ref(0, len);
+				consume(len);
+				return len;
+			}
+			buf.recreate(len);
+			return read(buffer_cast<char*>(buf), len);
+		}
+
+		//the whole message in one buffer, copied unless it is in one already
+		safe_buffer to_safe_buffer()const
+		{
+			if (buffers_.size()==1)
+				return buffers_.front();
+			safe_buffer buf;
+			safe_buffer_io io(&buf);
+			io.prepare(size_);
+			for (const_iterator itr=begin();itr!=end();++itr)
+				io.write(*itr);
+			return buf;
+		}
+
+		//for gather writes, the asio buffers hold the memory until the
+		//operation completes
+		std::vector<asio_const_buffer> to_asio_const_buffers()const
+		{
+			std::vector<asio_const_buffer> asioBuffers;
+			p2engine::to_asio_const_buffers(buffers_, asioBuffers);
+			return asioBuffers;
+		}
+
+		template<typename T>
+		friend safe_buffer_chain& operator >> (safe_buffer_chain&, T& value);
+
+	protected:
+		template <typename IntType>
+		IntType _read()
+		{
+			BOOST_STATIC_ASSERT(boost::is_integral<IntType>::value);
+
+			BOOST_ASSERT(size()>=sizeof(IntType));
+			if (size()<sizeof(IntType))
+			{
+				consume(size());
+				return IntType();
+			}
+			//the value may span two buffers
+			char bytes[sizeof(IntType)];
+			read(bytes, sizeof(IntType));
+			const char* p=bytes;
+			return read_int_ntoh<IntType>(p);
+		}
+
+	private:
+		buffers_type buffers_;
+		std::size_t size_;
+	};
+
+	template<typename T>
+	inline safe_buffer_chain& operator >> (safe_buffer_chain& bufs, T& value)
+	{
+		value = bufs._read<T>();
+		return bufs;
+	}
+
+	//append a chain to a contiguous buffer
+	template<>
+	inline safe_buffer_io& operator << (safe_buffer_io&io,const safe_buffer_chain& value)
+	{
+		io.prepare(value.size());
+		for (safe_buffer_chain::const_iterator itr=value.begin();itr!=value.end();++itr)
+			io.write(*itr);
+		return io;
+	}
+
+} // namespace p2engine
+
+#endif // P2ENGINE_SAFE_BUFFER_CHAIN_HPP
@@ -0,0 +1,118 @@
+//
+// send_watermark.hpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009, GuangZhu Wu  <guangzhuwu@gmail.com>
+//
+//This program is free software; you can redistribute it and/or modify it
+//under the terms of the GNU General Public License or any later version.
+//
+//This program is distributed in the hope that it will be useful, but
+//WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+//or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//for more details.
+//
+//You should have received a copy of the GNU General Public License along
+//with this program; if not, contact <guangzhuwu@gmail.com>.
+//
+#ifndef P2ENGINE_SEND_WATERMARK_HPP
+#define P2ENGINE_SEND_WATERMARK_HPP
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif // defined(_MSC_VER) && (_MSC_VER >= 1200)
+
+#include "p2engine/push_warning_option.hpp"
+#include "p2engine/config.hpp"
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/assert.hpp>
+#include "p2engine/pop_warning_option.hpp"
+
+namespace p2engine {
+
+	//high/low watermarks of a connection's send queue.
+	//a connection is blocked when the queued bytes reach the high watermark,
+	//and writable_signal is dispatched once they drain to the low watermark.
+	//senders should wait for writable_signal while is_send_blocked().
+	class send_watermark
+	{
+	public:
+		enum{
+			DEFAULT_SEND_LOW_WATERMARK=32*1024,
+			DEFAULT_SEND_HIGH_WATERMARK=128*1024
+		};
+
+		send_watermark()
+			:send_low_watermark_(DEFAULT_SEND_LOW_WATERMARK)
+			,send_high_watermark_(DEFAULT_SEND_HIGH_WATERMARK)
+			,is_send_blocked_(false)
+		{}
+
+	public:
+		void set_send_watermark(std::size_t lowMark, std::size_t highMark)
+		{
+			BOOST_ASSERT(lowMark<=highMark);
+			send_low_watermark_=lowMark;
+			send_high_watermark_=(highMark<lowMark?lowMark:highMark);
+		}
+		std::size_t send_low_watermark()const
+		{
+			return send_low_watermark_;
+		}
+		std::size_t send_high_watermark()const
+		{
+			return send_high_watermark_;
+		}
+		//the marks in effect for a queue of queueLimit bytes
+		std::size_t send_high_watermark(std::size_t queueLimit)const
+		{
+			return (std::min)(send_high_watermark_, queueLimit);
+		}
+		std::size_t send_low_watermark(std::size_t queueLimit)const
+		{
+			if (queueLimit>=send_high_watermark_)
+				return send_low_watermark_;
+			return (std::size_t)((boost::uint64_t)send_low_watermark_*queueLimit
+				/send_high_watermark_);
+		}
+		bool is_send_blocked()const
+		{
+			return is_send_blocked_;
+		}
+
+		//called by the transport after data is queued. a transport whose
+		//queue has a limit of its own passes it, the connection is blocked
+		//at whichever is lower.
+		void check_send_high_watermark(std::size_t queuedSize, 
+			std::size_t queueLimit=(std::numeric_limits<std::size_t>::max)())
+		{
+			if (!is_send_blocked_&&queuedSize>=send_high_watermark(queueLimit))
+				is_send_blocked_=true;
+		}
+		//called by the transport after queued data is sent out, with the 
+		//same limit as check_send_high_watermark. a limit below the high
+		//watermark scales the low watermark down with it.
+		//return true if writable_signal should be dispatched.
+		bool check_send_low_watermark(std::size_t queuedSize, 
+			std::size_t queueLimit=(std::numeric_limits<std::size_t>::max)())
+		{
+			if (is_send_blocked_&&queuedSize<=send_low_watermark(queueLimit))
+			{
+				is_send_blocked_=false;
+				return true;
+			}
+			return false;
+		}
+
+	protected:
+		std::size_t send_low_watermark_;
+		std::size_t send_high_watermark_;
+		bool is_send_blocked_;
+	};
+
+} // namespace p2engine
+
+#endif // P2ENGINE_SEND_WATERMARK_HPP
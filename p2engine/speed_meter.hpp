@@ -27,6 +27,9 @@
 #include "p2engine/config.hpp"
 #include <deque>
 #include <list>
+#include <vector>
+#include <cmath>
+#include <algorithm>
 #include <iostream>
 #include "p2engine/pop_warning_option.hpp"
 
@@ -186,11 +189,228 @@ namespace p2engine{
 		mutable bool			needRecalc_;
 	};
 
-	typedef basic_speed_meter<rough_tick_time>   rough_speed_meter;
-	typedef basic_speed_meter<precise_tick_time> precise_speed_meter;
+	//speed meter on a fixed ring of time buckets. each bucket sums the
+	//bytes of one resolution interval, buckets older than the window are
+	//cleared when time advances. memory is allocated only in constructor,
+	//operator+= and bytes_per_second() are O(1) amortized.
+	template <typename TimeTraitsType,typename MutexType=null_mutex>
+	class basic_bucket_speed_meter
+	{
+	public:
+		typedef TimeTraitsType time_traits_type;
+		typedef MutexType mutex_type;
+		typedef typename mutex_type::scoped_lock scoped_lock_type;
+
+		BOOST_STATIC_CONSTANT(int,default_bucket_count=16);
+
+	private:
+		BOOST_STATIC_CONSTANT(tick_type,min_time_threshold_usec=100);
+
+	public:
+		//the window is split into default_bucket_count buckets
+		basic_bucket_speed_meter(const time_duration& timewindow)
+		{
+			__init(timewindow.total_milliseconds(),
+				timewindow.total_milliseconds()/default_bucket_count);
+		}
+		basic_bucket_speed_meter(const time_duration& timewindow,
+			const time_duration& resolution)
+		{
+			__init(timewindow.total_milliseconds(),resolution.total_milliseconds());
+		}
+
+		double bytes_per_second()const
+		{
+			tick_type curTick=time_traits_type::now_tick_count();
+
+			scoped_lock_type lock(mutex_);
+
+			if (-1==timestart_)
+			{
+				timestart_=curTick;
+				curSlot_=curTick/resolution_;
+				return 0;
+			}
+			__advance(curTick);
+
+			//the oldest bucket is full, the newest one is partial
+			tick_type window=(bucketCnt_-1)*resolution_+(curTick-curSlot_*resolution_)+1;
+			window=(std::min)(curTick-timestart_,window);
+			if (min_time_threshold_usec>window)
+				window=min_time_threshold_usec;
+			return quedBytes_*1000.0/window;
+		}
+
+		void reset(bool releasMemory=true)
+		{
+			(void)releasMemory;//no memory is allocated after construction
+			scoped_lock_type lock(mutex_);
+			std::fill(buckets_.begin(),buckets_.end(),0);
+			curSlot_=0;
+			timestart_=-1;
+			totalBytes_=0;
+			totalCnt_=0;
+			quedBytes_=0;
+		}
+
+		void operator+=(std::size_t bytes)const
+		{
+			scoped_lock_type lock(mutex_);
+
+			tick_type curTick=time_traits_type::now_tick_count();
+			if (-1==timestart_)
+			{
+				timestart_=curTick;
+				curSlot_=curTick/resolution_;
+			}
+			else
+			{
+				__advance(curTick);
+			}
+			buckets_[(std::size_t)(curSlot_%bucketCnt_)]+=(int64_t)bytes;
+			quedBytes_+=(int64_t)bytes;
+			totalBytes_+=bytes;
+			totalCnt_+=1;
+		}
+
+		int64_t total_bytes() const { return totalBytes_;}
+		int64_t total_count() const { return totalCnt_;}
+
+	private:
+		void __init(tick_type timeWindow, tick_type resolution)
+		{
+			BOOST_ASSERT(timeWindow>min_time_threshold_usec);
+			BOOST_STATIC_ASSERT(sizeof(tick_type)==8);
+			resolution_=(std::max)(resolution,tick_type(1));
+			bucketCnt_=(std::max)((timeWindow+resolution_-1)/resolution_,tick_type(2));
+			buckets_.assign((std::size_t)bucketCnt_,0);
+			curSlot_=0;
+			timestart_=-1;
+			quedBytes_=0;
+			totalBytes_=0;
+			totalCnt_=0;
+		}
+
+		//clear the buckets that have slid out of the window
+		void __advance(tick_type now)const
+		{
+			tick_type slot=now/resolution_;
+			if (slot<=curSlot_)
+				return;
+			if (slot-curSlot_>=bucketCnt_)
+			{
+				std::fill(buckets_.begin(),buckets_.end(),0);
+				quedBytes_=0;
+			}
+			else
+			{
+				for (tick_type s=curSlot_+1;s<=slot;++s)
+				{
+					int64_t& bucket=buckets_[(std::size_t)(s%bucketCnt_)];
+					quedBytes_-=bucket;
+					bucket=0;
+				}
+				BOOST_ASSERT(quedBytes_>=0);
+			}
+			curSlot_=slot;
+		}
+
+	private:
+		mutable std::vector<int64_t> buckets_;
+		mutable int64_t			quedBytes_;
+		mutable tick_type		resolution_;
+		mutable tick_type		bucketCnt_;
+		mutable tick_type		curSlot_;
+		mutable tick_type		timestart_;
+		mutable int64_t			totalBytes_;
+		mutable int64_t			totalCnt_;
+		mutable mutex_type      mutex_;
+	};
+
+	//exponentially weighted moving average of speed. every byte counted
+	//decays with exp(-age/timewindow), so only the current rate and the
+	//last update time are kept. the value ramps up during the first window.
+	template <typename TimeTraitsType,typename MutexType=null_mutex>
+	class basic_ewma_speed_meter
+	{
+	public:
+		typedef TimeTraitsType time_traits_type;
+		typedef MutexType mutex_type;
+		typedef typename mutex_type::scoped_lock scoped_lock_type;
+
+	public:
+		basic_ewma_speed_meter(const time_duration& timewindow)
+			:tau_((double)timewindow.total_milliseconds())
+			,rate_(0)
+			,lastTick_(-1)
+			,totalBytes_(0)
+			,totalCnt_(0)
+		{
+			BOOST_ASSERT(tau_>0);
+		}
+
+		double bytes_per_second()const
+		{
+			tick_type curTick=time_traits_type::now_tick_count();
+
+			scoped_lock_type lock(mutex_);
+			__decay(curTick);
+			return rate_;
+		}
+
+		void reset(bool releasMemory=true)
+		{
+			(void)releasMemory;
+			scoped_lock_type lock(mutex_);
+			rate_=0;
+			lastTick_=-1;
+			totalBytes_=0;
+			totalCnt_=0;
+		}
+
+		void operator+=(std::size_t bytes)const
+		{
+			scoped_lock_type lock(mutex_);
+
+			tick_type curTick=time_traits_type::now_tick_count();
+			__decay(curTick);
+			rate_+=bytes*1000.0/tau_;
+			totalBytes_+=bytes;
+			totalCnt_+=1;
+		}
+
+		int64_t total_bytes() const { return totalBytes_;}
+		int64_t total_count() const { return totalCnt_;}
+
+	private:
+		void __decay(tick_type now)const
+		{
+			if (-1==lastTick_)
+				lastTick_=now;
+			else if (now>lastTick_)
+			{
+				rate_*=std::exp(-(now-lastTick_)/tau_);
+				lastTick_=now;
+			}
+		}
+
+	private:
+		double					tau_;
+		mutable double			rate_;
+		mutable tick_type		lastTick_;
+		mutable int64_t			totalBytes_;
+		mutable int64_t			totalCnt_;
+		mutable mutex_type      mutex_;
+	};
+
+	typedef basic_bucket_speed_meter<rough_tick_time>   rough_speed_meter;
+	typedef basic_bucket_speed_meter<precise_tick_time> precise_speed_meter;
+
+	typedef basic_bucket_speed_meter<rough_tick_time,fast_mutex>   threadsafe_rough_speed_meter;
+	typedef basic_bucket_speed_meter<precise_tick_time,fast_mutex> threadsafe_precise_speed_meter;
 
-	typedef basic_speed_meter<rough_tick_time,fast_mutex>   threadsafe_rough_speed_meter;
-	typedef basic_speed_meter<precise_tick_time,fast_mutex> threadsafe_precise_speed_meter;
+	typedef basic_ewma_speed_meter<rough_tick_time>   rough_ewma_speed_meter;
+	typedef basic_ewma_speed_meter<precise_tick_time> precise_ewma_speed_meter;
 
 	PTR_TYPE_DECLARE(rough_speed_meter);
 	PTR_TYPE_DECLARE(precise_speed_meter);
@@ -28,8 +28,101 @@
 #include "p2engine/singleton.hpp"
 #include "p2engine/atomic.hpp"
 
+#include "p2engine/push_warning_option.hpp"
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
+#include "p2engine/pop_warning_option.hpp"
+
 namespace p2engine{
 
+	//speed meter sharded by thread. every thread is bound to one shard on
+	//its first update, so threads of an io_service_pool do not contend for
+	//one lock. readers sum all shards on demand.
+	template<typename SpeedMeterType>
+	class basic_sharded_speed_meter
+	{
+		typedef basic_sharded_speed_meter<SpeedMeterType> this_type;
+
+		enum{SHARD_COUNT=16,CACHE_LINE_SIZE=64};
+
+		//padding keeps the hot fields of two shards off one cache line
+		struct shard
+		{
+			shard(const time_duration& timewindow):meter(timewindow){}
+
+			char padding_front[CACHE_LINE_SIZE];
+			SpeedMeterType meter;
+			char padding_back[CACHE_LINE_SIZE];
+		};
+
+	public:
+		basic_sharded_speed_meter(const time_duration& timewindow)
+		{
+			shards_.reserve(SHARD_COUNT);
+			for (int i=0;i<SHARD_COUNT;++i)
+				shards_.push_back(boost::shared_ptr<shard>(new shard(timewindow)));
+		}
+
+		double bytes_per_second()const
+		{
+			double speed=0;
+			for (std::size_t i=0;i<shards_.size();++i)
+				speed+=shards_[i]->meter.bytes_per_second();
+			return speed;
+		}
+
+		void reset(bool releasMemory=true)
+		{
+			for (std::size_t i=0;i<shards_.size();++i)
+				shards_[i]->meter.reset(releasMemory);
+		}
+
+		void operator+=(std::size_t bytes)const
+		{
+			shards_[__shard_index()]->meter+=bytes;
+		}
+
+		int64_t total_bytes() const
+		{
+			int64_t total=0;
+			for (std::size_t i=0;i<shards_.size();++i)
+				total+=shards_[i]->meter.total_bytes();
+			return total;
+		}
+		int64_t total_count() const
+		{
+			int64_t total=0;
+			for (std::size_t i=0;i<shards_.size();++i)
+				total+=shards_[i]->meter.total_count();
+			return total;
+		}
+
+	private:
+		static std::size_t __shard_index()
+		{
+			std::size_t* index=s_shard_index_.get();
+			if (!index)
+			{
+				index=new std::size_t((uint32_t)(s_next_shard_++)%SHARD_COUNT);
+				s_shard_index_.reset(index);
+			}
+			return *index;
+		}
+
+	private:
+		std::vector<boost::shared_ptr<shard> > shards_;
+
+		static boost::thread_specific_ptr<std::size_t> s_shard_index_;
+		static atomic<uint32_t> s_next_shard_;
+	};
+	template<typename SpeedMeterType>
+	boost::thread_specific_ptr<std::size_t> basic_sharded_speed_meter<SpeedMeterType>::s_shard_index_;
+	template<typename SpeedMeterType>
+	atomic<uint32_t> basic_sharded_speed_meter<SpeedMeterType>::s_next_shard_;
+
+	typedef basic_sharded_speed_meter<threadsafe_rough_speed_meter> sharded_rough_speed_meter;
+
 	class trafic_statistics
 	{
 		SINGLETON_ACCESS_DECLARE;
@@ -61,11 +154,11 @@ namespace p2engine{
 		{
 			remote_to_local_lost_rate_=(int32_t)(v*trafic_statistics_pricition);
 		}
-		threadsafe_rough_speed_meter& local_to_remote_speed_meter()
+		sharded_rough_speed_meter& local_to_remote_speed_meter()
 		{
 			return local_to_remote_speed_meter_;
 		}
-		threadsafe_rough_speed_meter& remote_to_local_speed_meter()
+		sharded_rough_speed_meter& remote_to_local_speed_meter()
 		{
 			return remote_to_local_speed_meter_;
 		}
@@ -73,15 +166,15 @@ namespace p2engine{
 	private:
 		atomic<int32_t> local_to_remote_lost_rate_;
 		atomic<int32_t> remote_to_local_lost_rate_;
-		threadsafe_rough_speed_meter local_to_remote_speed_meter_;
-		threadsafe_rough_speed_meter remote_to_local_speed_meter_;
+		sharded_rough_speed_meter local_to_remote_speed_meter_;
+		sharded_rough_speed_meter remote_to_local_speed_meter_;
 	};
 
-	inline threadsafe_rough_speed_meter& global_local_to_remote_speed_meter()
+	inline sharded_rough_speed_meter& global_local_to_remote_speed_meter()
 	{
 		return singleton<trafic_statistics>::instance().local_to_remote_speed_meter();
 	}
-	inline threadsafe_rough_speed_meter& global_remote_to_local_speed_meter()
+	inline sharded_rough_speed_meter& global_remote_to_local_speed_meter()
 	{
 		return singleton<trafic_statistics>::instance().remote_to_local_speed_meter();
 	}
@@ -88,6 +88,7 @@ namespace p2engine
 
 	//type used by p2engine
 	typedef	uint16_t message_type;
+	typedef	uint16_t stream_id_type;
 
 }//namespace p2engine
 
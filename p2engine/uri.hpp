@@ -13,13 +13,267 @@
 
 #include "p2engine/push_warning_option.hpp"
 #include "p2engine/config.hpp"
+#include <cstring>
 #include <string>
 #include <map>
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/system/error_code.hpp>
 #include "p2engine/pop_warning_option.hpp"
 
 
 namespace p2engine {
 
+	/// A range of characters in the string a @c uri_view was parsed from.
+	class uri_piece
+	{
+	public:
+		uri_piece()
+			: begin_(0), end_(0)
+		{
+		}
+
+		uri_piece(const char* b, const char* e)
+			: begin_(b), end_(e)
+		{
+		}
+
+		const char* begin() const
+		{
+			return begin_;
+		}
+
+		const char* end() const
+		{
+			return end_;
+		}
+
+		std::size_t size() const
+		{
+			return end_-begin_;
+		}
+
+		bool empty() const
+		{
+			return begin_==end_;
+		}
+
+		std::string to_string() const
+		{
+			return std::string(begin_,end_);
+		}
+
+		/// Compares with a null terminated string.
+		bool equals(const char* s) const
+		{
+			std::size_t n=std::strlen(s);
+			return n==size()&&std::memcmp(begin_,s,n)==0;
+		}
+
+	private:
+		const char* begin_;
+		const char* end_;
+	};
+
+	/// Parses a URL without copying it.
+	/**
+	* Each component is kept as a @c uri_piece of the parsed string, which
+	* must outlive the view. Nothing is unescaped or allocated while parsing,
+	* the path and query values are only checked to be validly escaped;
+	* unescaping is done on demand with @c unescape.
+	*
+	* @par Example
+	* @code
+	* p2engine::uri_view v;
+	* if (v.parse(req.url()))
+	* {
+	*   for (p2engine::uri_view::query_iterator itr = v.query_begin();
+	*     itr != v.query_end(); ++itr)
+	*   {
+	*     std::string value;
+	*     p2engine::uri_view::unescape(itr->value, value);
+	*   }
+	* }
+	* @endcode
+	*/
+	class uri_view
+	{
+	public:
+		/// A name=value parameter of the query, both escaped.
+		struct query_param
+		{
+			uri_piece name;
+			uri_piece value;
+		};
+
+		/// Iterates the parameters of a query, empty parameters are skipped.
+		class query_iterator
+			: public boost::iterator_facade<
+			query_iterator,
+			const query_param,
+			boost::forward_traversal_tag
+			>
+		{
+		public:
+			query_iterator()
+				: pos_(0), end_(0)
+			{
+			}
+
+			explicit query_iterator(const uri_piece& query)
+				: pos_(query.begin()), end_(query.end())
+			{
+				__load();
+			}
+
+		private:
+			friend class boost::iterator_core_access;
+
+			void increment()
+			{
+				pos_=param_.value.end();
+				if (pos_!=end_)
+					++pos_;//'&'
+				__load();
+			}
+
+			bool equal(const query_iterator& other) const
+			{
+				return pos_==other.pos_;
+			}
+
+			const query_param& dereference() const
+			{
+				return param_;
+			}
+
+			void __load();
+
+			const char* pos_;
+			const char* end_;
+			query_param param_;
+		};
+
+	public:
+		uri_view()
+			: path_(default_path(), default_path()+1), ipv6_host_(false)
+		{
+		}
+
+		/// Parses a URL, returns false if it is invalid.
+		bool parse(const char* s, std::size_t len);
+
+		bool parse(const char* s)
+		{
+			return parse(s,std::strlen(s));
+		}
+
+		bool parse(const std::string& s)
+		{
+			return parse(s.data(),s.size());
+		}
+
+		/// Gets the protocol component of the URL, not lower cased.
+		const uri_piece& protocol() const
+		{
+			return protocol_;
+		}
+
+		const uri_piece& user_info() const
+		{
+			return user_info_;
+		}
+
+		const uri_piece& user_name() const
+		{
+			return user_name_;
+		}
+
+		const uri_piece& user_password() const
+		{
+			return user_password_;
+		}
+
+		const uri_piece& host() const
+		{
+			return host_;
+		}
+
+		bool ipv6_host() const
+		{
+			return ipv6_host_;
+		}
+
+		/// Gets the port of the URL, the default port of the protocol if
+		/// not specified.
+		unsigned short port() const;
+
+		/// Gets the port component as written in the URL.
+		const uri_piece& port_piece() const
+		{
+			return port_;
+		}
+
+		/// Gets the escaped path of the URL, "/" if there is none.
+		const uri_piece& path() const
+		{
+			return path_;
+		}
+
+		/// Unescapes the path.
+		void path(std::string& out) const
+		{
+			unescape(path_,out);
+		}
+
+		/// Gets the escaped query string.
+		const uri_piece& query() const
+		{
+			return query_;
+		}
+
+		query_iterator query_begin() const
+		{
+			return query_iterator(query_);
+		}
+
+		query_iterator query_end() const
+		{
+			return query_iterator(uri_piece(query_.end(),query_.end()));
+		}
+
+		/// Finds the first query parameter of name, the value is escaped.
+		bool find_query(const char* name, uri_piece& value) const;
+
+		const uri_piece& fragment() const
+		{
+			return fragment_;
+		}
+
+		/// Unescapes %XX sequences, returns false if in is not validly escaped.
+		static bool unescape(const uri_piece& in, std::string& out);
+
+		/// Checks the %XX sequences and that all characters are URL characters.
+		static bool is_valid_escaped(const uri_piece& in);
+
+	private:
+		static const char* default_path()
+		{
+			return "/";
+		}
+
+	private:
+		uri_piece protocol_;
+		uri_piece user_info_;
+		uri_piece user_name_;
+		uri_piece user_password_;
+		uri_piece host_;
+		uri_piece port_;
+		uri_piece path_;
+		uri_piece query_;
+		uri_piece fragment_;
+		bool ipv6_host_;
+	};
+
 	/// The class @c url enables parsing and accessing the components of URLs.
 	/**
 	* @par Example
@@ -60,7 +314,7 @@ namespace p2engine {
 		* 0.
 		*/
 		uri()
-			: ipv6_host_(false)
+			: ipv6_host_(false), query_map_built_(false)
 		{
 		}
 
@@ -71,7 +325,7 @@ namespace p2engine {
 		* @throws boost::system::system_error Thrown when the URL string is invalid.
 		*/
 		uri(const char* s)
-			: ipv6_host_(false)
+			: ipv6_host_(false), query_map_built_(false)
 		{
 			boost::system::error_code ec;
 			from_string(*this,s,ec);
@@ -86,7 +340,7 @@ namespace p2engine {
 		* @throws boost::system::system_error Thrown when the URL string is invalid.
 		*/
 		uri(const std::string& s)
-			: ipv6_host_(false)
+			: ipv6_host_(false), query_map_built_(false)
 		{
 			boost::system::error_code ec;
 			from_string(*this,s.c_str(),ec);
@@ -181,13 +435,18 @@ namespace p2engine {
 			return query_;
 		}
 
+		/// Gets the unescaped query parameters, built on first use.
 		const std::map<std::string,std::string>& query_map()const
 		{
+			if (!query_map_built_)
+				build_query_map();
 			return query_map_;
 		}
 
 		std::map<std::string,std::string>& query_map()
 		{
+			if (!query_map_built_)
+				build_query_map();
 			return query_map_;
 		}
 
@@ -329,9 +588,10 @@ namespace p2engine {
 	private:
 		static bool unescape_path(const std::string& in, std::string& out);
 		static void from_string(uri& result, const char* p, boost::system::error_code& ec);
+		void build_query_map()const;
 
 	private:
-		std::map<std::string,std::string> query_map_;
+		mutable std::map<std::string,std::string> query_map_;
 		std::string protocol_;
 		std::string user_info_;
 		std::string user_name_;
@@ -342,6 +602,7 @@ namespace p2engine {
 		std::string query_;
 		std::string fragment_;
 		bool ipv6_host_;
+		mutable bool query_map_built_;
 	};
 
 } // namespace url
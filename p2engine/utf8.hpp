@@ -37,6 +37,24 @@ namespace p2engine {
 	std::string convert_to_native(std::string const& s);
 	std::string convert_from_native(std::string const& s);
 
+	inline bool is_ascii(const char* s, std::size_t len)
+	{
+		return asciiPrefixLength((const UTF8*)s,(const UTF8*)s+len)==len;
+	}
+	inline bool is_ascii(std::string const& s)
+	{
+		return is_ascii(s.data(),s.size());
+	}
+
+	inline bool is_valid_utf8(const char* s, std::size_t len)
+	{
+		return isLegalUTF8String((const UTF8*)s,(const UTF8*)s+len)!=0;
+	}
+	inline bool is_valid_utf8(std::string const& s)
+	{
+		return is_valid_utf8(s.data(),s.size());
+	}
+
 }
 
 #endif//p2engine_utf8_hpp__
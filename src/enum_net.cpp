@@ -76,6 +76,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <boost/asio/posix/stream_descriptor.hpp>
 #endif
 
 #if P2ENGINE_USE_IFADDRS
@@ -295,6 +296,49 @@ namespace p2engine { namespace
 	}
 #endif
 
+	address default_gateway_of(std::vector<ip_route>& routes)
+	{
+#if defined WINDOWS_OS || defined MINGW_OS
+		std::vector<ip_route>::iterator i = std::find_if(routes.begin(), routes.end()
+			, boost::bind(&is_loopback, boost::bind(&ip_route::destination, _1)));
+#else
+		std::vector<ip_route>::iterator i = std::find_if(routes.begin(), routes.end()
+			, boost::bind(&ip_route::destination, _1) == address());
+#endif
+		if (i == routes.end()) return address();
+		return i->gateway;
+	}
+
+	bool same_interfaces(std::vector<ip_interface> const& a
+		, std::vector<ip_interface> const& b)
+	{
+		if (a.size() != b.size()) return false;
+		for (std::size_t i = 0; i < a.size(); ++i)
+		{
+			if (a[i].interface_address != b[i].interface_address
+				|| a[i].netmask != b[i].netmask
+				|| a[i].mtu != b[i].mtu
+				|| strcmp(a[i].name, b[i].name) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	bool same_routes(std::vector<ip_route> const& a, std::vector<ip_route> const& b)
+	{
+		if (a.size() != b.size()) return false;
+		for (std::size_t i = 0; i < a.size(); ++i)
+		{
+			if (a[i].destination != b[i].destination
+				|| a[i].netmask != b[i].netmask
+				|| a[i].gateway != b[i].gateway
+				|| a[i].mtu != b[i].mtu
+				|| strcmp(a[i].name, b[i].name) != 0)
+				return false;
+		}
+		return true;
+	}
+
 }} // <anonymous>
 
 namespace p2engine
@@ -325,16 +369,14 @@ namespace p2engine
 			== (a2.to_v4().to_ulong() & mask.to_v4().to_ulong());
 	}
 
+	bool in_subnet(address const& addr, ip_interface const& iface)
+	{
+		return match_addr_mask(addr, iface.interface_address, iface.netmask);
+	}
+
 	bool in_local_network(io_service& ios, address const& addr, error_code& ec)
 	{
-		std::vector<ip_interface> net = enum_net_interfaces(ios, ec);
-		if (ec) return false;
-		for (std::vector<ip_interface>::iterator i = net.begin()
-			, end(net.end()); i != end; ++i)
-		{
-			if (match_addr_mask(addr, i->interface_address, i->netmask)) return true;
-		}
-		return false;
+		return network_topology_service::get(ios).in_local_network(addr, ec);
 	}
 
 #if P2ENGINE_USE_GETIPFORWARDTABLE
@@ -640,16 +682,7 @@ namespace p2engine
 
 	address get_default_gateway(io_service& ios, error_code& ec)
 	{
-		std::vector<ip_route> ret = enum_routes(ios, ec);
-#if defined WINDOWS_OS || defined MINGW_OS
-		std::vector<ip_route>::iterator i = std::find_if(ret.begin(), ret.end()
-			, boost::bind(&is_loopback, boost::bind(&ip_route::destination, _1)));
-#else
-		std::vector<ip_route>::iterator i = std::find_if(ret.begin(), ret.end()
-			, boost::bind(&ip_route::destination, _1) == address());
-#endif
-		if (i == ret.end()) return address();
-		return i->gateway;
+		return network_topology_service::get(ios).default_gateway(ec);
 	}
 
 	std::vector<ip_route> enum_routes(io_service& ios, error_code& ec)
@@ -1062,4 +1095,245 @@ namespace p2engine
 			tcpSocket.close(ec);
 		}
 	}
-}
\ No newline at end of file
+
+	struct network_topology_service::watcher
+	{
+#if P2ENGINE_USE_NETLINK
+		explicit watcher(io_service& ios)
+			: descriptor(ios)
+		{
+		}
+
+		boost::asio::posix::stream_descriptor descriptor;
+		char buf[8192];
+#else
+		explicit watcher(io_service&)
+		{
+		}
+#endif
+	};
+
+	network_topology_service::network_topology_service(io_service& ios)
+		: boost::asio::detail::service_base<network_topology_service>(ios)
+		, load_time_(0)
+		, loaded_(false)
+		, stale_(true)
+		, reload_posted_(false)
+		, notify_posted_(false)
+	{
+#if P2ENGINE_USE_NETLINK
+		int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+		if (fd < 0)
+			return;
+		sockaddr_nl sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.nl_family = AF_NETLINK;
+		sa.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE
+#if P2ENGINE_USE_IPV6
+			| RTMGRP_IPV6_IFADDR | RTMGRP_IPV6_ROUTE
+#endif
+			;
+		if (bind(fd, (sockaddr*)&sa, sizeof(sa)) < 0)
+		{
+			close(fd);
+			return;
+		}
+		error_code ec;
+		watcher_.reset(new watcher(ios));
+		watcher_->descriptor.assign(fd, ec);
+		if (ec)
+		{
+			close(fd);
+			watcher_.reset();
+			return;
+		}
+		__async_watch();
+#endif
+	}
+
+	network_topology_service::~network_topology_service()
+	{
+	}
+
+	void network_topology_service::shutdown_service()
+	{
+		fast_mutex::scoped_lock lock(mutex_);
+		watcher_.reset();
+	}
+
+	std::vector<ip_interface> network_topology_service::interfaces(error_code& ec)
+	{
+		fast_mutex::scoped_lock lock(mutex_);
+		__load_if_stale();
+		ec = interfaces_ec_;
+		return interfaces_;
+	}
+
+	std::vector<ip_route> network_topology_service::routes(error_code& ec)
+	{
+		fast_mutex::scoped_lock lock(mutex_);
+		__load_if_stale();
+		ec = routes_ec_;
+		return routes_;
+	}
+
+	bool network_topology_service::in_local_network(address const& addr, error_code& ec)
+	{
+		fast_mutex::scoped_lock lock(mutex_);
+		__load_if_stale();
+		ec = interfaces_ec_;
+		for (std::size_t i = 0; i < interfaces_.size(); ++i)
+		{
+			if (match_addr_mask(addr, interfaces_[i].interface_address
+				, interfaces_[i].netmask))
+				return true;
+		}
+		return false;
+	}
+
+	bool network_topology_service::find_interface(address const& addr
+		, ip_interface& iface, error_code& ec)
+	{
+		fast_mutex::scoped_lock lock(mutex_);
+		__load_if_stale();
+		ec = interfaces_ec_;
+		for (std::size_t i = 0; i < interfaces_.size(); ++i)
+		{
+			if (in_subnet(addr, interfaces_[i]))
+			{
+				iface = interfaces_[i];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	address network_topology_service::default_gateway(error_code& ec)
+	{
+		fast_mutex::scoped_lock lock(mutex_);
+		__load_if_stale();
+		ec = routes_ec_;
+		return default_gateway_;
+	}
+
+	int network_topology_service::mtu_to(address const& addr, error_code& ec)
+	{
+		fast_mutex::scoped_lock lock(mutex_);
+		__load_if_stale();
+		ec = interfaces_ec_;
+		for (std::size_t i = 0; i < interfaces_.size(); ++i)
+		{
+			if (in_subnet(addr, interfaces_[i]))
+				return interfaces_[i].mtu;
+		}
+		if (is_any(default_gateway_))
+			return 0;
+		for (std::size_t i = 0; i < routes_.size(); ++i)
+		{
+			if (routes_[i].gateway == default_gateway_)
+				return routes_[i].mtu;
+		}
+		return 0;
+	}
+
+	int network_topology_service::max_mtu(error_code& ec)
+	{
+		fast_mutex::scoped_lock lock(mutex_);
+		__load_if_stale();
+		ec = interfaces_ec_;
+		int mtu = 0;
+		for (std::size_t i = 0; i < interfaces_.size(); ++i)
+		{
+			if (!is_loopback(interfaces_[i].interface_address))
+				mtu = (std::max)(mtu, interfaces_[i].mtu);
+		}
+		return mtu;
+	}
+
+	void network_topology_service::invalidate()
+	{
+		fast_mutex::scoped_lock lock(mutex_);
+		stale_ = true;
+	}
+
+	//mutex_ must be held
+	void network_topology_service::__load_if_stale()
+	{
+		tick_type now = system_time::tick_count();
+		if (!stale_ && (watcher_ || now - load_time_ < REFRESH_INTERVAL))
+			return;
+
+		error_code ifec, rtec;
+		std::vector<ip_interface> ifs = enum_net_interfaces(this->get_io_service(), ifec);
+		std::vector<ip_route> rts = enum_routes(this->get_io_service(), rtec);
+		bool changed = loaded_
+			&& (!same_interfaces(ifs, interfaces_) || !same_routes(rts, routes_));
+
+		interfaces_.swap(ifs);
+		routes_.swap(rts);
+		interfaces_ec_ = ifec;
+		routes_ec_ = rtec;
+		default_gateway_ = default_gateway_of(routes_);
+		load_time_ = now;
+		loaded_ = true;
+		stale_ = false;
+
+		if (changed && !notify_posted_)
+		{
+			notify_posted_ = true;
+			this->get_io_service().post(boost::bind(&this_type::__notify_changed, this));
+		}
+	}
+
+	void network_topology_service::__async_watch()
+	{
+#if P2ENGINE_USE_NETLINK
+		watcher_->descriptor.async_read_some(
+			asio::buffer(watcher_->buf, sizeof(watcher_->buf))
+			, boost::bind(&this_type::__handle_watch, this, _1, _2));
+#endif
+	}
+
+	void network_topology_service::__handle_watch(const error_code& ec, std::size_t len)
+	{
+		if (ec == asio::error::operation_aborted)
+			return;
+
+		fast_mutex::scoped_lock lock(mutex_);
+		if (!watcher_)
+			return;
+		stale_ = true;
+		//ENOBUFS means the kernel dropped events, the tables are stale
+		//anyway. any other error: give up and fall back to polling.
+		if (ec && ec != error_code(ENOBUFS, asio::error::get_system_category()))
+		{
+			watcher_.reset();
+			return;
+		}
+		//events come in bursts, reload once after the queued ones
+		if (!reload_posted_)
+		{
+			reload_posted_ = true;
+			this->get_io_service().post(boost::bind(&this_type::__reload, this));
+		}
+		__async_watch();
+	}
+
+	void network_topology_service::__reload()
+	{
+		fast_mutex::scoped_lock lock(mutex_);
+		reload_posted_ = false;
+		if (loaded_)
+			__load_if_stale();
+	}
+
+	void network_topology_service::__notify_changed()
+	{
+		{
+			fast_mutex::scoped_lock lock(mutex_);
+			notify_posted_ = false;
+		}
+		changed_signal_();
+	}
+
+}
@@ -31,7 +31,9 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "p2engine/gzip.hpp"
-#include "p2engine/puff.hpp"
+#include <cstring>
+#include <algorithm>
+#include <boost/detail/endian.hpp>
 
 namespace
 {
@@ -48,6 +50,360 @@ namespace
 		GZIP_MAGIC1 = 0x8b
 	};
 
+	// table driven raw inflate (RFC 1951). it replaces the bit-at-a-time
+	// decoder of puff: codes up to FAST_BITS long are resolved by a single
+	// table lookup on a 64 bit bit buffer, longer codes use the canonical
+	// first-code search. the whole input and output are in memory, so
+	// stored blocks and matches are copied with memcpy/memset.
+	enum
+	{
+		FAST_BITS = 9,
+		FAST_MASK = (1 << FAST_BITS) - 1,
+		MAX_BITS = 15,
+		MAX_LCODES = 286,
+		MAX_DCODES = 30,
+		FIX_LCODES = 288,
+
+		INFLATE_OK = 0,
+		INFLATE_OUTPUT_FULL = 1,
+		INFLATE_NEED_INPUT = 2,
+		INFLATE_INVALID = -1
+	};
+
+	const boost::uint16_t lbase[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+	const boost::uint8_t lext[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+	const boost::uint16_t dbase[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+		8193, 12289, 16385, 24577};
+	const boost::uint8_t dext[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+	const boost::uint8_t clen_order[19] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+	struct huffman_table
+	{
+		// (code length << FAST_BITS) | symbol, 0 if the code is longer
+		boost::uint16_t fast[1 << FAST_BITS];
+		boost::uint16_t firstcode[MAX_BITS + 1];
+		// first code not of this length, left aligned to 16 bits
+		boost::uint32_t maxcode[MAX_BITS + 2];
+		boost::uint16_t firstsymbol[MAX_BITS + 1];
+		boost::uint8_t size[FIX_LCODES];
+		boost::uint16_t value[FIX_LCODES];
+	};
+
+	struct inflate_state
+	{
+		const unsigned char* in;
+		const unsigned char* in_end;
+		boost::uint64_t bitbuf;
+		int bitcnt;
+		// zero bytes shifted in after the end of input
+		int overrun;
+
+		unsigned char* out_begin;
+		unsigned char* out;
+		unsigned char* out_end;
+
+		huffman_table lencode;
+		huffman_table distcode;
+	};
+
+	inline int bit_reverse(int v, int bits)
+	{
+		v = ((v & 0xAAAA) >> 1) | ((v & 0x5555) << 1);
+		v = ((v & 0xCCCC) >> 2) | ((v & 0x3333) << 2);
+		v = ((v & 0xF0F0) >> 4) | ((v & 0x0F0F) << 4);
+		v = ((v & 0xFF00) >> 8) | ((v & 0x00FF) << 8);
+		return v >> (16 - bits);
+	}
+
+	// keep at least 56 bits in the bit buffer
+	inline void refill(inflate_state& s)
+	{
+#if defined(BOOST_LITTLE_ENDIAN)
+		if (s.in_end - s.in >= 8)
+		{
+			// load a whole word and advance by the bytes that fit. the
+			// bits above bitcnt are the next input byte, so or-ing it
+			// again later does not change them.
+			boost::uint64_t w;
+			std::memcpy(&w, s.in, 8);
+			s.bitbuf |= w << s.bitcnt;
+			s.in += (63 - s.bitcnt) >> 3;
+			s.bitcnt |= 56;
+			return;
+		}
+#endif
+		while (s.bitcnt <= 56)
+		{
+			if (s.in < s.in_end)
+				s.bitbuf |= boost::uint64_t(*s.in++) << s.bitcnt;
+			else
+				++s.overrun;
+			s.bitcnt += 8;
+		}
+	}
+
+	inline int get_bits(inflate_state& s, int n)
+	{
+		if (s.bitcnt < n) refill(s);
+		int v = int(s.bitbuf & ((boost::uint64_t(1) << n) - 1));
+		s.bitbuf >>= n;
+		s.bitcnt -= n;
+		return v;
+	}
+
+	// return false if the code lengths are over-subscribed
+	bool build_huffman(huffman_table& h, const boost::uint8_t* length, int n)
+	{
+		int count[MAX_BITS + 1] = {0};
+		int next_code[MAX_BITS + 1];
+
+		std::memset(h.fast, 0, sizeof(h.fast));
+		for (int i = 0; i < n; ++i)
+			++count[length[i]];
+		count[0] = 0;
+
+		int code = 0;
+		int k = 0;
+		for (int i = 1; i <= MAX_BITS; ++i)
+		{
+			next_code[i] = code;
+			h.firstcode[i] = boost::uint16_t(code);
+			h.firstsymbol[i] = boost::uint16_t(k);
+			code += count[i];
+			if (code > (1 << i)) return false;
+			h.maxcode[i] = boost::uint32_t(code) << (16 - i);
+			code <<= 1;
+			k += count[i];
+		}
+		h.maxcode[MAX_BITS + 1] = 0x10000;
+
+		for (int i = 0; i < n; ++i)
+		{
+			int len = length[i];
+			if (len == 0) continue;
+			int c = next_code[len] - h.firstcode[len] + h.firstsymbol[len];
+			h.size[c] = boost::uint8_t(len);
+			h.value[c] = boost::uint16_t(i);
+			if (len <= FAST_BITS)
+			{
+				boost::uint16_t entry = boost::uint16_t((len << FAST_BITS) | i);
+				for (int j = bit_reverse(next_code[len], len); j < (1 << FAST_BITS)
+					; j += (1 << len))
+					h.fast[j] = entry;
+			}
+			++next_code[len];
+		}
+		return true;
+	}
+
+	int decode_slow(inflate_state& s, const huffman_table& h)
+	{
+		int k = bit_reverse(int(s.bitbuf & 0xffff), 16);
+		int len;
+		for (len = FAST_BITS + 1; ; ++len)
+			if (boost::uint32_t(k) < h.maxcode[len]) break;
+		if (len > MAX_BITS) return -1;
+		int c = (k >> (16 - len)) - h.firstcode[len] + h.firstsymbol[len];
+		if (c >= FIX_LCODES || h.size[c] != len) return -1;
+		s.bitbuf >>= len;
+		s.bitcnt -= len;
+		return h.value[c];
+	}
+
+	inline int decode(inflate_state& s, const huffman_table& h)
+	{
+		if (s.bitcnt < 16) refill(s);
+		int entry = h.fast[s.bitbuf & FAST_MASK];
+		if (entry)
+		{
+			int len = entry >> FAST_BITS;
+			s.bitbuf >>= len;
+			s.bitcnt -= len;
+			return entry & FAST_MASK;
+		}
+		return decode_slow(s, h);
+	}
+
+	int inflate_stored(inflate_state& s)
+	{
+		// skip to byte boundary
+		get_bits(s, s.bitcnt & 7);
+		int len = get_bits(s, 16);
+		int nlen = get_bits(s, 16);
+		if (len != (~nlen & 0xffff)) return INFLATE_INVALID;
+		if (s.out_end - s.out < len) return INFLATE_OUTPUT_FULL;
+		int buffered = (s.bitcnt - s.overrun * 8) >> 3;
+		if (buffered < 0 || buffered + (s.in_end - s.in) < len)
+			return INFLATE_NEED_INPUT;
+
+		// bytes already in the bit buffer
+		while (len > 0 && s.bitcnt >= 8)
+		{
+			*s.out++ = (unsigned char)(s.bitbuf & 0xff);
+			s.bitbuf >>= 8;
+			s.bitcnt -= 8;
+			--len;
+		}
+		if (len == 0) return INFLATE_OK;
+
+		s.bitbuf = 0;
+		std::memcpy(s.out, s.in, len);
+		s.out += len;
+		s.in += len;
+		return INFLATE_OK;
+	}
+
+	int inflate_codes(inflate_state& s)
+	{
+		for (;;)
+		{
+			int symbol = decode(s, s.lencode);
+			if (symbol < 256)
+			{
+				if (symbol < 0) return INFLATE_INVALID;
+				if (s.out == s.out_end) return INFLATE_OUTPUT_FULL;
+				*s.out++ = (unsigned char)symbol;
+				continue;
+			}
+			if (symbol == 256) return INFLATE_OK;
+
+			symbol -= 257;
+			if (symbol >= 29) return INFLATE_INVALID;
+			int len = lbase[symbol] + get_bits(s, lext[symbol]);
+
+			symbol = decode(s, s.distcode);
+			if (symbol < 0 || symbol >= MAX_DCODES) return INFLATE_INVALID;
+			int dist = dbase[symbol] + get_bits(s, dext[symbol]);
+			if (s.overrun * 8 > s.bitcnt) return INFLATE_NEED_INPUT;
+
+			if (s.out - s.out_begin < dist) return INFLATE_INVALID;
+			if (s.out_end - s.out < len) return INFLATE_OUTPUT_FULL;
+
+			const unsigned char* from = s.out - dist;
+			if (dist == 1)
+			{
+				std::memset(s.out, *from, len);
+			}
+			else if (dist >= len)
+			{
+				std::memcpy(s.out, from, len);
+			}
+			else
+			{
+				// overlapping copy repeats the last dist bytes
+				for (int i = 0; i < len; ++i)
+					s.out[i] = from[i];
+			}
+			s.out += len;
+		}
+	}
+
+	int inflate_fixed(inflate_state& s)
+	{
+		boost::uint8_t length[FIX_LCODES];
+		int i = 0;
+		for (; i < 144; ++i) length[i] = 8;
+		for (; i < 256; ++i) length[i] = 9;
+		for (; i < 280; ++i) length[i] = 7;
+		for (; i < FIX_LCODES; ++i) length[i] = 8;
+		build_huffman(s.lencode, length, FIX_LCODES);
+		for (i = 0; i < MAX_DCODES; ++i) length[i] = 5;
+		build_huffman(s.distcode, length, MAX_DCODES);
+		return inflate_codes(s);
+	}
+
+	int inflate_dynamic(inflate_state& s)
+	{
+		int nlen = get_bits(s, 5) + 257;
+		int ndist = get_bits(s, 5) + 1;
+		int ncode = get_bits(s, 4) + 4;
+		if (nlen > MAX_LCODES || ndist > MAX_DCODES) return INFLATE_INVALID;
+
+		boost::uint8_t length[MAX_LCODES + MAX_DCODES];
+		std::memset(length, 0, 19);
+		for (int i = 0; i < ncode; ++i)
+			length[clen_order[i]] = boost::uint8_t(get_bits(s, 3));
+		if (!build_huffman(s.lencode, length, 19)) return INFLATE_INVALID;
+
+		int index = 0;
+		while (index < nlen + ndist)
+		{
+			int symbol = decode(s, s.lencode);
+			if (symbol < 0) return INFLATE_INVALID;
+			if (symbol < 16)
+			{
+				length[index++] = boost::uint8_t(symbol);
+				continue;
+			}
+			int repeat;
+			boost::uint8_t value = 0;
+			if (symbol == 16)
+			{
+				if (index == 0) return INFLATE_INVALID;
+				value = length[index - 1];
+				repeat = 3 + get_bits(s, 2);
+			}
+			else if (symbol == 17)
+				repeat = 3 + get_bits(s, 3);
+			else
+				repeat = 11 + get_bits(s, 7);
+			if (index + repeat > nlen + ndist) return INFLATE_INVALID;
+			std::memset(length + index, value, repeat);
+			index += repeat;
+		}
+		if (length[256] == 0) return INFLATE_INVALID;
+
+		if (!build_huffman(s.lencode, length, nlen)
+			|| !build_huffman(s.distcode, length + nlen, ndist))
+			return INFLATE_INVALID;
+		return inflate_codes(s);
+	}
+
+	// same contract as puff(): on return destlen and sourcelen hold the
+	// bytes written and consumed.
+	int inflate_raw(unsigned char* dest, boost::uint32_t* destlen
+		, const unsigned char* source, boost::uint32_t* sourcelen)
+	{
+		inflate_state s;
+		s.in = source;
+		s.in_end = source + *sourcelen;
+		s.bitbuf = 0;
+		s.bitcnt = 0;
+		s.overrun = 0;
+		s.out_begin = s.out = dest;
+		s.out_end = dest + *destlen;
+
+		int ret;
+		int last;
+		do
+		{
+			last = get_bits(s, 1);
+			int type = get_bits(s, 2);
+			if (type == 0) ret = inflate_stored(s);
+			else if (type == 1) ret = inflate_fixed(s);
+			else if (type == 2) ret = inflate_dynamic(s);
+			else ret = INFLATE_INVALID;
+
+			// every bit consumed must come from real input
+			if (s.overrun * 8 > s.bitcnt)
+				ret = INFLATE_NEED_INPUT;
+		} while (!last && ret == INFLATE_OK);
+
+		*destlen = boost::uint32_t(s.out - s.out_begin);
+		int unused = (std::max)(s.bitcnt - s.overrun * 8, 0) / 8;
+		*sourcelen = boost::uint32_t(s.in - source) - unused;
+		return ret;
+	}
+
 }
 
 namespace p2engine
@@ -149,9 +505,10 @@ namespace p2engine
 		boost::uint32_t destlen = buffer.size();
 		boost::uint32_t srclen = size - header_len;
 		in += header_len;
-		int ret = puff((unsigned char*)&buffer[0], &destlen, (unsigned char*)in, &srclen);
+		int ret = inflate_raw((unsigned char*)&buffer[0], &destlen
+			, (const unsigned char*)in, &srclen);
 
-		if (ret == -1)
+		if (ret == INFLATE_OUTPUT_FULL)
 		{
 			error = "inflated data too big";
 			return false;
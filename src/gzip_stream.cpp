@@ -0,0 +1,772 @@
+//
+// gzip_stream.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009, GuangZhu Wu  <guangzhuwu@gmail.com>
+//
+//This program is free software; you can redistribute it and/or modify it
+//under the terms of the GNU General Public License or any later version.
+//
+//This program is distributed in the hope that it will be useful, but
+//WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+//or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//for more details.
+//
+//You should have received a copy of the GNU General Public License along
+//with this program; if not, contact <guangzhuwu@gmail.com>.
+//
+// The decoding steps follow puff.c by Mark Adler, see puff.cpp and RFC 1951.
+//
+#include "p2engine/gzip_stream.hpp"
+
+namespace p2engine{
+
+	namespace{
+		enum
+		{
+			FTEXT = 0x01,
+			FHCRC = 0x02,
+			FEXTRA = 0x04,
+			FNAME = 0x08,
+			FCOMMENT = 0x10,
+			FRESERVED = 0xe0,
+
+			GZIP_MAGIC0 = 0x1f,
+			GZIP_MAGIC1 = 0x8b
+		};
+
+		//size base and extra bits for length codes 257..285
+		const short s_lbase[29] = {
+			3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+		const short s_lext[29] = {
+			0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+		//offset base and extra bits for distance codes 0..29
+		const short s_dbase[30] = {
+			1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+			8193, 12289, 16385, 24577};
+		const short s_dext[30] = {
+			0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+			7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+			12, 12, 13, 13};
+		//permutation of code length codes
+		const short s_order[19] = {
+			16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+		inline boost::uint32_t reverse_bits(boost::uint32_t code, int n)
+		{
+			boost::uint32_t v=0;
+			for (int i=0;i<n;++i)
+			{
+				v=(v<<1)|(code&1);
+				code>>=1;
+			}
+			return v;
+		}
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//gzip_inflater
+	gzip_inflater::gzip_inflater()
+		:window_(WINDOW_SIZE)
+	{
+		reset();
+	}
+
+	void gzip_inflater::reset()
+	{
+		state_=GZIP_HEADER;
+		error_="";
+		last_block_=false;
+		stored_remain_=0;
+		total_out_=0;
+		in_=in_end_=NULL;
+		bitbuf_=0;
+		bitcnt_=0;
+		pending_.clear();
+		wpos_=0;
+		flush_pos_=0;
+		out_=NULL;
+		crc_.reset();
+	}
+
+	bool gzip_inflater::inflate(const char* in, std::size_t len, safe_buffer& out,
+		std::string& error)
+	{
+		if (state_==BAD)
+		{
+			error=error_;
+			return false;
+		}
+
+		out_=&out;
+		const unsigned char* p=reinterpret_cast<const unsigned char*>(in);
+
+		//an unfinished step is in pending_, feed it with a small slice of the
+		//input until the step is done, then go on with the caller's buffer.
+		while(!pending_.empty()&&len>0&&state_!=DONE)
+		{
+			std::size_t n=(std::min)(len,(std::size_t)STEP_INPUT_SIZE);
+			std::string buf;
+			buf.swap(pending_);
+			buf.append((const char*)p,n);
+			p+=n;
+			len-=n;
+			if (!__run((const unsigned char*)buf.data(),buf.size(),error))
+			{
+				out_=NULL;
+				return false;
+			}
+			if (pending_.size()<=n)
+			{
+				p-=pending_.size();
+				len+=pending_.size();
+				pending_.clear();
+			}
+		}
+
+		bool ok=true;
+		if (len>0&&state_!=DONE)
+			ok=__run(p,len,error);
+		out_=NULL;
+		return ok;
+	}
+
+	bool gzip_inflater::__run(const unsigned char* in, std::size_t len,
+		std::string& error)
+	{
+		in_=in;
+		in_end_=in+len;
+		for (;;)
+		{
+			if (state_==DONE)
+			{
+				//data after the gzip member is ignored
+				pending_.clear();
+				break;
+			}
+
+			const unsigned char* saved_in=in_;
+			boost::uint32_t saved_bitbuf=bitbuf_;
+			int saved_bitcnt=bitcnt_;
+
+			step_result rst=__step();
+			if (rst==STEP_OK)
+				continue;
+			if (rst==STEP_ERROR)
+			{
+				__flush();
+				state_=BAD;
+				error=error_;
+				return false;
+			}
+
+			//roll back to the beginning of this step and keep the input
+			in_=saved_in;
+			bitbuf_=saved_bitbuf;
+			bitcnt_=saved_bitcnt;
+			pending_.assign((const char*)in_,in_end_-in_);
+			break;
+		}
+		__flush();
+		in_=in_end_=NULL;
+		return true;
+	}
+
+	gzip_inflater::step_result gzip_inflater::__step()
+	{
+		switch(state_)
+		{
+		case GZIP_HEADER:
+			return __header();
+		case BLOCK_HEADER:
+			return __block_header();
+		case STORED_BLOCK:
+			return __stored();
+		case HUFFMAN_BLOCK:
+			return __codes();
+		case GZIP_TRAILER:
+			return __trailer();
+		default:
+			BOOST_ASSERT(0);
+			return __error("invalid inflate state");
+		}
+	}
+
+	gzip_inflater::step_result gzip_inflater::__header()
+	{
+		BOOST_ASSERT(bitcnt_==0);
+
+		const unsigned char* begin=in_;
+#define READ_BYTE(v) \
+	do{\
+		if (in_-begin>MAX_HEADER_SIZE)\
+			return __error("invalid gzip header");\
+		if (!__need(8))\
+			return STEP_NEED_MORE;\
+		v=__bits(8);\
+	}while(0)
+
+		int id1,id2,method,flags,v;
+		READ_BYTE(id1);
+		READ_BYTE(id2);
+		READ_BYTE(method);
+		READ_BYTE(flags);
+		if (id1!=GZIP_MAGIC0||id2!=GZIP_MAGIC1
+			||method!=8||(flags&FRESERVED)!=0)
+			return __error("invalid gzip header");
+
+		// skip time, xflags, OS code
+		for (int i=0;i<6;++i)
+			READ_BYTE(v);
+
+		if (flags&FEXTRA)
+		{
+			int lo,hi;
+			READ_BYTE(lo);
+			READ_BYTE(hi);
+			for (int extra_len=(hi<<8)|lo;extra_len>0;--extra_len)
+				READ_BYTE(v);
+		}
+		if (flags&FNAME)
+		{
+			do{READ_BYTE(v);}while(v);
+		}
+		if (flags&FCOMMENT)
+		{
+			do{READ_BYTE(v);}while(v);
+		}
+		if (flags&FHCRC)
+		{
+			READ_BYTE(v);
+			READ_BYTE(v);
+		}
+#undef READ_BYTE
+
+		state_=BLOCK_HEADER;
+		return STEP_OK;
+	}
+
+	gzip_inflater::step_result gzip_inflater::__block_header()
+	{
+		if (!__need(3))
+			return STEP_NEED_MORE;
+		bool last=(__bits(1)!=0);
+		int type=__bits(2);
+		switch(type)
+		{
+		case 0:
+			{
+				// discard leftover bits of current byte
+				__bits(bitcnt_&7);
+				if (!__need(16))
+					return STEP_NEED_MORE;
+				unsigned len=(unsigned)__bits(16);
+				if (!__need(16))
+					return STEP_NEED_MORE;
+				unsigned nlen=(unsigned)__bits(16);
+				if (len!=(~nlen&0xffff))
+					return __error("invalid stored block length");
+				stored_remain_=len;
+				state_=STORED_BLOCK;
+			}
+			break;
+		case 1:
+			{
+				short lengths[FIX_LCODES];
+				int symbol=0;
+				for (;symbol<144;++symbol)
+					lengths[symbol]=8;
+				for (;symbol<256;++symbol)
+					lengths[symbol]=9;
+				for (;symbol<280;++symbol)
+					lengths[symbol]=7;
+				for (;symbol<FIX_LCODES;++symbol)
+					lengths[symbol]=8;
+				__construct(lencode_,lengths,FIX_LCODES);
+				for (symbol=0;symbol<MAX_DCODES;++symbol)
+					lengths[symbol]=5;
+				__construct(distcode_,lengths,MAX_DCODES);
+				state_=HUFFMAN_BLOCK;
+			}
+			break;
+		case 2:
+			{
+				step_result rst=__dynamic_tables();
+				if (rst!=STEP_OK)
+					return rst;
+				state_=HUFFMAN_BLOCK;
+			}
+			break;
+		default:
+			return __error("invalid block type");
+		}
+		last_block_=last;
+		return STEP_OK;
+	}
+
+	gzip_inflater::step_result gzip_inflater::__dynamic_tables()
+	{
+		short lengths[MAX_LCODES+MAX_DCODES];
+
+		if (!__need(14))
+			return STEP_NEED_MORE;
+		int nlen=__bits(5)+257;
+		int ndist=__bits(5)+1;
+		int ncode=__bits(4)+4;
+		if (nlen>MAX_LCODES||ndist>MAX_DCODES)
+			return __error("bad counts");
+
+		int index=0;
+		for (;index<ncode;++index)
+		{
+			if (!__need(3))
+				return STEP_NEED_MORE;
+			lengths[s_order[index]]=(short)__bits(3);
+		}
+		for (;index<19;++index)
+			lengths[s_order[index]]=0;
+
+		//build huffman table for code lengths codes, must be complete
+		if (__construct(lencode_,lengths,19)!=0)
+			return __error("complete code set required");
+
+		index=0;
+		while(index<nlen+ndist)
+		{
+			int symbol=__decode(lencode_);
+			if (symbol==-1)
+				return STEP_NEED_MORE;
+			if (symbol<0)
+				return __error("invalid code length code");
+			if (symbol<16)
+			{
+				lengths[index++]=(short)symbol;
+				continue;
+			}
+
+			short len=0;
+			if (symbol==16)
+			{
+				if (index==0)
+					return __error("repeat lengths with no first length");
+				len=lengths[index-1];
+				if (!__need(2))
+					return STEP_NEED_MORE;
+				symbol=3+__bits(2);
+			}
+			else if (symbol==17)
+			{
+				if (!__need(3))
+					return STEP_NEED_MORE;
+				symbol=3+__bits(3);
+			}
+			else
+			{
+				if (!__need(7))
+					return STEP_NEED_MORE;
+				symbol=11+__bits(7);
+			}
+			if (index+symbol>nlen+ndist)
+				return __error("too many lengths");
+			while(symbol--)
+				lengths[index++]=len;
+		}
+
+		if (lengths[256]==0)
+			return __error("no end-of-block code");
+
+		//incomplete code ok only for single length 1 code
+		int err=__construct(lencode_,lengths,nlen);
+		if (err<0||(err>0&&nlen-lencode_.count[0]!=1))
+			return __error("incomplete literal/length code");
+		err=__construct(distcode_,lengths+nlen,ndist);
+		if (err<0||(err>0&&ndist-distcode_.count[0]!=1))
+			return __error("incomplete distance code");
+		return STEP_OK;
+	}
+
+	gzip_inflater::step_result gzip_inflater::__stored()
+	{
+		bool progress=false;
+		//whole bytes may have been loaded into bit buffer
+		while(stored_remain_>0&&bitcnt_>=8)
+		{
+			__put((unsigned char)__bits(8));
+			--stored_remain_;
+			progress=true;
+		}
+		while(stored_remain_>0&&in_!=in_end_)
+		{
+			__put(*in_++);
+			--stored_remain_;
+			progress=true;
+		}
+		if (stored_remain_==0)
+		{
+			state_=(last_block_?GZIP_TRAILER:BLOCK_HEADER);
+			return STEP_OK;
+		}
+		return progress?STEP_OK:STEP_NEED_MORE;
+	}
+
+	gzip_inflater::step_result gzip_inflater::__codes()
+	{
+		int symbol=__decode(lencode_);
+		if (symbol==-1)
+			return STEP_NEED_MORE;
+		if (symbol<0)
+			return __error("invalid literal/length code");
+		if (symbol<256)
+		{
+			__put((unsigned char)symbol);
+			return STEP_OK;
+		}
+		if (symbol==256)
+		{
+			state_=(last_block_?GZIP_TRAILER:BLOCK_HEADER);
+			return STEP_OK;
+		}
+
+		symbol-=257;
+		if (symbol>=29)
+			return __error("invalid fixed code");
+		if (!__need(s_lext[symbol]))
+			return STEP_NEED_MORE;
+		int len=s_lbase[symbol]+__bits(s_lext[symbol]);
+
+		symbol=__decode(distcode_);
+		if (symbol==-1)
+			return STEP_NEED_MORE;
+		if (symbol<0||symbol>=30)
+			return __error("invalid distance code");
+		if (!__need(s_dext[symbol]))
+			return STEP_NEED_MORE;
+		std::size_t dist=s_dbase[symbol]+__bits(s_dext[symbol]);
+		if (dist>total_out_)
+			return __error("distance too far back");
+
+		while(len--)
+			__put(window_[(wpos_+WINDOW_SIZE-dist)&(WINDOW_SIZE-1)]);
+		return STEP_OK;
+	}
+
+	gzip_inflater::step_result gzip_inflater::__trailer()
+	{
+		__bits(bitcnt_&7);
+
+		boost::uint32_t v[2]={0,0};
+		for (int i=0;i<8;++i)
+		{
+			if (!__need(8))
+				return STEP_NEED_MORE;
+			v[i/4]|=(boost::uint32_t)__bits(8)<<((i%4)*8);
+		}
+		__flush();
+		if (v[0]!=crc_.checksum())
+			return __error("crc32 mismatch");
+		if (v[1]!=(boost::uint32_t)(total_out_&0xffffffff))
+			return __error("length mismatch");
+		state_=DONE;
+		return STEP_OK;
+	}
+
+	int gzip_inflater::__decode(const huffman& h)
+	{
+		int code=0;
+		int first=0;
+		int index=0;
+		for (int len=1;len<=MAX_BITS;++len)
+		{
+			if (!__need(1))
+				return -1;
+			code|=__bits(1);
+			int count=h.count[len];
+			if (code-count<first)
+				return h.symbol[index+(code-first)];
+			index+=count;
+			first+=count;
+			first<<=1;
+			code<<=1;
+		}
+		return -2;
+	}
+
+	int gzip_inflater::__construct(huffman& h, const short* length, int n)
+	{
+		short offs[MAX_BITS+1];
+
+		for (int len=0;len<=MAX_BITS;++len)
+			h.count[len]=0;
+		for (int symbol=0;symbol<n;++symbol)
+			h.count[length[symbol]]++;
+		if (h.count[0]==n)
+			return 0;
+
+		//check for an over-subscribed or incomplete set of lengths
+		int left=1;
+		for (int len=1;len<=MAX_BITS;++len)
+		{
+			left<<=1;
+			left-=h.count[len];
+			if (left<0)
+				return left;
+		}
+
+		offs[1]=0;
+		for (int len=1;len<MAX_BITS;++len)
+			offs[len+1]=offs[len]+h.count[len];
+		for (int symbol=0;symbol<n;++symbol)
+		{
+			if (length[symbol]!=0)
+				h.symbol[offs[length[symbol]]++]=(boost::int16_t)symbol;
+		}
+		return left;
+	}
+
+	void gzip_inflater::__flush()
+	{
+		if (wpos_>flush_pos_)
+		{
+			BOOST_ASSERT(out_);
+			const unsigned char* p=&window_[flush_pos_];
+			std::size_t n=wpos_-flush_pos_;
+			crc_.process_bytes(p,n);
+			safe_buffer_io io(out_);
+			io.write(p,n);
+			flush_pos_=wpos_;
+		}
+		if (wpos_==WINDOW_SIZE)
+			wpos_=flush_pos_=0;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	//gzip_deflater
+	gzip_deflater::gzip_deflater()
+		:window_(2*WINDOW_SIZE)
+		,head_(HASH_SIZE)
+		,prev_(WINDOW_SIZE)
+	{
+		reset();
+	}
+
+	void gzip_deflater::reset()
+	{
+		window_len_=0;
+		pos_=0;
+		std::fill(head_.begin(),head_.end(),-1);
+		std::fill(prev_.begin(),prev_.end(),-1);
+		obuf_.clear();
+		bitbuf_=0;
+		bitcnt_=0;
+		header_written_=false;
+		total_in_=0;
+		crc_.reset();
+	}
+
+	void gzip_deflater::deflate(const char* in, std::size_t len, safe_buffer& out)
+	{
+		if (!header_written_)
+			__put_header();
+		if (len>0)
+		{
+			crc_.process_bytes(in,len);
+			total_in_+=len;
+
+			//BFINAL=0, BTYPE=01(fixed huffman)
+			__put_bits(2,3);
+			while(len>0)
+			{
+				if (window_len_==window_.size())
+					__slide();
+				std::size_t n=(std::min)(len,window_.size()-window_len_);
+				memcpy(&window_[window_len_],in,n);
+				window_len_+=n;
+				in+=n;
+				len-=n;
+				//keep MAX_MATCH bytes of lookahead while more input follows
+				__compress(len>0?window_len_-MAX_MATCH:window_len_);
+			}
+			//end-of-block
+			__put_code(0,7);
+		}
+		__flush_to(out);
+	}
+
+	void gzip_deflater::finish(safe_buffer& out)
+	{
+		if (!header_written_)
+			__put_header();
+
+		//an empty final block: BFINAL=1, BTYPE=01 and end-of-block
+		__put_bits(3,3);
+		__put_code(0,7);
+		if (bitcnt_>0)
+			__put_bits(0,8-bitcnt_);
+
+		boost::uint32_t crc=crc_.checksum();
+		boost::uint32_t isize=(boost::uint32_t)(total_in_&0xffffffff);
+		for (int i=0;i<4;++i)
+			obuf_.push_back((char)((crc>>(i*8))&0xff));
+		for (int i=0;i<4;++i)
+			obuf_.push_back((char)((isize>>(i*8))&0xff));
+		__flush_to(out);
+		reset();
+	}
+
+	void gzip_deflater::__compress(std::size_t end)
+	{
+		while(pos_<end)
+		{
+			std::size_t dist=0;
+			std::size_t len=__longest_match(pos_,dist);
+			if (len>=MIN_MATCH)
+			{
+				__put_match(len,dist);
+				for (std::size_t i=0;i<len;++i)
+					__insert_hash(pos_+i);
+				pos_+=len;
+			}
+			else
+			{
+				__insert_hash(pos_);
+				__put_literal(window_[pos_]);
+				++pos_;
+			}
+		}
+	}
+
+	void gzip_deflater::__slide()
+	{
+		BOOST_ASSERT(pos_>=WINDOW_SIZE);
+		memmove(&window_[0],&window_[WINDOW_SIZE],WINDOW_SIZE);
+		window_len_-=WINDOW_SIZE;
+		pos_-=WINDOW_SIZE;
+		for (std::size_t i=0;i<head_.size();++i)
+			head_[i]=(head_[i]>=WINDOW_SIZE?head_[i]-WINDOW_SIZE:-1);
+		for (std::size_t i=0;i<prev_.size();++i)
+			prev_[i]=(prev_[i]>=WINDOW_SIZE?prev_[i]-WINDOW_SIZE:-1);
+	}
+
+	std::size_t gzip_deflater::__hash(std::size_t pos)const
+	{
+		boost::uint32_t v=((boost::uint32_t)window_[pos]<<16)
+			|((boost::uint32_t)window_[pos+1]<<8)
+			|(boost::uint32_t)window_[pos+2];
+		return (v*2654435761U)>>(32-HASH_BITS);
+	}
+
+	void gzip_deflater::__insert_hash(std::size_t pos)
+	{
+		if (pos+MIN_MATCH>window_len_)
+			return;
+		std::size_t h=__hash(pos);
+		prev_[pos&WINDOW_MASK]=head_[h];
+		head_[h]=(int)pos;
+	}
+
+	std::size_t gzip_deflater::__longest_match(std::size_t pos,
+		std::size_t& dist)const
+	{
+		if (pos+MIN_MATCH>window_len_)
+			return 0;
+
+		std::size_t max_len=(std::min)((std::size_t)MAX_MATCH,window_len_-pos);
+		std::size_t limit=(pos>WINDOW_SIZE?pos-WINDOW_SIZE:0);
+		std::size_t best=0;
+		int cand=head_[__hash(pos)];
+		for (int chain=MAX_CHAIN;chain>0&&cand>=0&&(std::size_t)cand>=limit;--chain)
+		{
+			const unsigned char* a=&window_[cand];
+			const unsigned char* b=&window_[pos];
+			if (a[best]==b[best])
+			{
+				std::size_t len=0;
+				while(len<max_len&&a[len]==b[len])
+					++len;
+				if (len>best)
+				{
+					best=len;
+					dist=pos-cand;
+					if (best==max_len)
+						break;
+				}
+			}
+			//prev_ is a ring, a stale link points forward
+			int next=prev_[cand&WINDOW_MASK];
+			if (next>=cand)
+				break;
+			cand=next;
+		}
+		return best>=MIN_MATCH?best:0;
+	}
+
+	void gzip_deflater::__put_literal(int c)
+	{
+		if (c<144)
+			__put_code(0x30+c,8);
+		else
+			__put_code(0x190+(c-144),9);
+	}
+
+	void gzip_deflater::__put_match(std::size_t len, std::size_t dist)
+	{
+		BOOST_ASSERT(len>=MIN_MATCH&&len<=MAX_MATCH);
+		BOOST_ASSERT(dist>=1&&dist<=WINDOW_SIZE);
+
+		int i=28;
+		while(s_lbase[i]>(int)len)
+			--i;
+		int symbol=257+i;
+		if (symbol<280)
+			__put_code(symbol-256,7);
+		else
+			__put_code(0xc0+(symbol-280),8);
+		__put_bits((boost::uint32_t)(len-s_lbase[i]),s_lext[i]);
+
+		i=29;
+		while(s_dbase[i]>(int)dist)
+			--i;
+		__put_code(i,5);
+		__put_bits((boost::uint32_t)(dist-s_dbase[i]),s_dext[i]);
+	}
+
+	void gzip_deflater::__put_bits(boost::uint32_t v, int n)
+	{
+		bitbuf_|=v<<bitcnt_;
+		bitcnt_+=n;
+		while(bitcnt_>=8)
+		{
+			obuf_.push_back((char)(bitbuf_&0xff));
+			bitbuf_>>=8;
+			bitcnt_-=8;
+		}
+	}
+
+	void gzip_deflater::__put_code(boost::uint32_t code, int n)
+	{
+		__put_bits(reverse_bits(code,n),n);
+	}
+
+	void gzip_deflater::__put_header()
+	{
+		//no file name, mtime=0, OS=unknown
+		static const char header[10]={
+			(char)GZIP_MAGIC0,(char)GZIP_MAGIC1,8,0,0,0,0,0,0,(char)0xff};
+		obuf_.insert(obuf_.end(),header,header+sizeof(header));
+		header_written_=true;
+	}
+
+	void gzip_deflater::__flush_to(safe_buffer& out)
+	{
+		if (!obuf_.empty())
+		{
+			safe_buffer_io io(&out);
+			io.write(&obuf_[0],obuf_.size());
+			obuf_.clear();
+		}
+	}
+
+}
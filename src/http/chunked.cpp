@@ -0,0 +1,169 @@
+//
+// chunked.cpp
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2009, GuangZhu Wu  <guangzhuwu@gmail.com>
+//
+//This program is free software; you can redistribute it and/or modify it
+//under the terms of the GNU General Public License or any later version.
+//
+//This program is distributed in the hope that it will be useful, but
+//WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+//or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//for more details.
+//
+//You should have received a copy of the GNU General Public License along
+//with this program; if not, contact <guangzhuwu@gmail.com>.
+//
+#include "p2engine/http/chunked.hpp"
+
+namespace p2engine { namespace http{
+
+	namespace{
+		inline int hex_value(char c)
+		{
+			if (c>='0'&&c<='9')
+				return c-'0';
+			if (c>='a'&&c<='f')
+				return c-'a'+10;
+			if (c>='A'&&c<='F')
+				return c-'A'+10;
+			return -1;
+		}
+	}
+
+	void chunked_decoder::reset()
+	{
+		state_=CHUNK_SIZE;
+		chunk_remain_=0;
+		line_len_=0;
+		digit_num_=0;
+	}
+
+	int chunked_decoder::decode(const char* begin, std::size_t len, safe_buffer& body)
+	{
+		const char* readPtr=begin;
+		const char* readEndPtr=begin+len;
+		while (readPtr!=readEndPtr&&state_!=DONE)
+		{
+			switch (state_)
+			{
+			case CHUNK_SIZE:
+				{
+					int v=hex_value(*readPtr);
+					if (v>=0)
+					{
+						//more than 15 hex digits will overflow
+						if (++digit_num_>15)
+							return -1;
+						chunk_remain_=(chunk_remain_<<4)+v;
+					}
+					else if (digit_num_==0)
+						return -1;
+					else if (*readPtr==';'||*readPtr==' '||*readPtr=='\t')
+						state_=CHUNK_EXT;
+					else if (*readPtr=='\r')
+						state_=CHUNK_SIZE_LF;
+					else if (*readPtr=='\n')
+						state_=(chunk_remain_>0?CHUNK_DATA:TRAILER_LINE_BEGIN);
+					else
+						return -1;
+					++readPtr;
+				}
+				break;
+			case CHUNK_EXT:
+				//chunk-extension is ignored
+				if (*readPtr=='\r')
+					state_=CHUNK_SIZE_LF;
+				else if (*readPtr=='\n')
+					state_=(chunk_remain_>0?CHUNK_DATA:TRAILER_LINE_BEGIN);
+				else if (++line_len_>MAX_LINE_LENGTH)
+					return -1;
+				++readPtr;
+				break;
+			case CHUNK_SIZE_LF:
+				if (*readPtr!='\n')
+					return -1;
+				state_=(chunk_remain_>0?CHUNK_DATA:TRAILER_LINE_BEGIN);
+				++readPtr;
+				break;
+			case CHUNK_DATA:
+				{
+					std::size_t n=(std::size_t)(std::min)(chunk_remain_,
+						(uint64_t)(readEndPtr-readPtr));
+					safe_buffer_io bio(&body);
+					bio.write(readPtr,n);
+					readPtr+=n;
+					chunk_remain_-=n;
+					if (chunk_remain_==0)
+						state_=CHUNK_DATA_CR;
+				}
+				break;
+			case CHUNK_DATA_CR:
+			case CHUNK_DATA_LF:
+				if (*readPtr=='\r'&&state_==CHUNK_DATA_CR)
+					state_=CHUNK_DATA_LF;
+				else if (*readPtr=='\n')
+				{
+					state_=CHUNK_SIZE;
+					line_len_=0;
+					digit_num_=0;
+				}
+				else
+					return -1;
+				++readPtr;
+				break;
+			case TRAILER_LINE_BEGIN:
+				//an empty line ends the body
+				if (*readPtr=='\r')
+					state_=TRAILER_LF;
+				else if (*readPtr=='\n')
+					state_=DONE;
+				else
+				{
+					line_len_=0;
+					state_=TRAILER_LINE;
+				}
+				++readPtr;
+				break;
+			case TRAILER_LINE:
+				//trailer fields are ignored
+				if (*readPtr=='\n')
+					state_=TRAILER_LINE_BEGIN;
+				else if (++line_len_>MAX_LINE_LENGTH)
+					return -1;
+				++readPtr;
+				break;
+			case TRAILER_LF:
+				if (*readPtr!='\n')
+					return -1;
+				state_=DONE;
+				++readPtr;
+				break;
+			default:
+				BOOST_ASSERT(0);
+				return -1;
+			}
+		}
+		return int(readPtr-begin);
+	}
+
+	safe_buffer chunked_encoder::chunk_header(std::size_t len)
+	{
+		char buf[32]={0};
+		int n=snprintf(buf,sizeof(buf),"%llx\r\n",(unsigned long long)len);
+		return safe_buffer(buf,n);
+	}
+
+	safe_buffer chunked_encoder::chunk_tailer()
+	{
+		return safe_buffer("\r\n",2);
+	}
+
+	safe_buffer chunked_encoder::last_chunk()
+	{
+		return safe_buffer("0\r\n\r\n",5);
+	}
+
+}
+}
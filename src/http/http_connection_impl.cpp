@@ -16,6 +16,7 @@ namespace p2engine { namespace http { namespace detail {
 		,is_passive_(passive)
 		,enable_ssl_(enable_ssl)
 		,is_gzip_(false)
+		,is_inflating_(false)
 	{
 		set_obj_desc("basic_http_connection_impl");
 		__init();
@@ -144,26 +145,67 @@ namespace p2engine { namespace http { namespace detail {
 		BOOST_ASSERT(connection_);
 
 		send_bufs_len_+=buf.length();
+		send_bufs_.push_back(buf);
+		connection_->check_send_high_watermark(send_bufs_len_);
+		if (!sending_)
+			__do_async_send(op_stamp());
+	}
+
+	void basic_http_connection_impl::async_send_chunk(const safe_buffer& buf)
+	{
+		if (state_!=CONNECTED||buf.length()==0)
+			return;
+
+		BOOST_ASSERT(connection_);
 
-		if (sending_)
+		if (connection_->deflate_chunked_body())
 		{
-			send_bufs_.push(buf);
+			if (!deflater_)
+				deflater_.reset(new gzip_deflater);
+			safe_buffer zbuf;
+			deflater_->deflate(buf,zbuf);
+			__async_send_chunk(zbuf);
 		}
 		else
 		{
-			BOOST_ASSERT(send_bufs_len_==buf.length());
-			sending_=true;
-			asio::async_write(*socket_impl_,
-				buf.to_asio_const_buffers_1(),
-				asio::transfer_all(),
-				make_alloc_handler(
-				boost::bind(&this_type::__async_send_handler,
-				SHARED_OBJ_FROM_THIS,_1,_2,op_stamp())
-				)
-				);
+			__async_send_chunk(buf);
 		}
 	}
 
+	void basic_http_connection_impl::async_send_last_chunk()
+	{
+		if (state_!=CONNECTED)
+			return;
+
+		BOOST_ASSERT(connection_);
+
+		if (deflater_&&connection_->deflate_chunked_body())
+		{
+			//finish() resets the deflater for next body
+			safe_buffer zbuf;
+			deflater_->finish(zbuf);
+			__async_send_chunk(zbuf);
+		}
+		async_send(chunked_encoder::last_chunk());
+	}
+
+	void basic_http_connection_impl::__async_send_chunk(const safe_buffer& buf)
+	{
+		if (buf.length()==0)
+			return;
+
+		//[header,data,tailer] are gathered in one write, data is not copied
+		safe_buffer header=chunked_encoder::chunk_header(buf.length());
+		safe_buffer tailer=chunked_encoder::chunk_tailer();
+		send_bufs_len_+=header.length()+buf.length()+tailer.length();
+		send_bufs_.push_back(header);
+		send_bufs_.push_back(buf);
+		send_bufs_.push_back(tailer);
+		connection_->check_send_high_watermark(send_bufs_len_);
+		if (!sending_)
+			__do_async_send(op_stamp());
+	}
+
 	void basic_http_connection_impl::keep_async_receiving()
 	{
 		BOOST_ASSERT(connection_);
@@ -171,7 +213,7 @@ namespace p2engine { namespace http { namespace detail {
 		if (is_recv_blocked_&&recv_state_!=RECVING)
 		{
 			is_recv_blocked_=false;
-			if (is_header_recvd_&&recv_buf_.size()>0)
+			if (recv_buf_.size()>0)
 			{
 				get_io_service().post(make_alloc_handler(
 					boost::bind(&this_type::__async_recv_handler,
@@ -218,7 +260,7 @@ namespace p2engine { namespace http { namespace detail {
 			conn_retry_timer_.reset();
 		}
 		connection_=NULL;
-		if (greaceful&&!send_bufs_.empty())
+		if (greaceful&&(sending_||!send_bufs_.empty()))
 		{
 			state_=CLOSING;
 		}
@@ -238,16 +280,19 @@ namespace p2engine { namespace http { namespace detail {
 		sending_=false;
 		is_recv_blocked_=true;
 		is_header_recvd_=false;
+		is_chunked_=false;
+		is_inflating_=false;
+		chunked_decoder_.reset();
+		if (deflater_)//a body closed before its last chunk
+			deflater_->reset();
 		recv_state_=RECVED;
 		state_=INIT;
 		recv_buf_.consume(recv_buf_.size());
 		if(!socket_impl_)
 			socket_impl_.reset(new ssl_stream_wrapper<tcp::socket>(
 			connection_->get_io_service(), enable_ssl_));
-		while(!send_bufs_.empty())
-		{
-			send_bufs_.pop();
-		}
+		send_bufs_.clear();
+		sending_bufs_.clear();
 		if (conn_timeout_timer_)
 		{
 			conn_timeout_timer_->cancel();
@@ -458,6 +503,27 @@ namespace p2engine { namespace http { namespace detail {
 		conn_retry_timer_->async_wait(milliseconds(100));
 	}
 
+	void basic_http_connection_impl::__do_async_send(op_stamp_t stamp)
+	{
+		BOOST_ASSERT(!sending_&&!send_bufs_.empty());
+
+		sending_bufs_.clear();
+		while(!send_bufs_.empty()&&sending_bufs_.size()<MAX_GATHER_BUF_CNT)
+		{
+			if (send_bufs_.front().length()>0)
+				sending_bufs_.push_back(send_bufs_.front().to_asio_const_buffer());
+			send_bufs_.pop_front();
+		}
+		sending_=true;
+		asio::async_write(*socket_impl_,
+			sending_bufs_,
+			asio::transfer_all(),
+			make_alloc_handler(
+			boost::bind(&this_type::__async_send_handler,
+			SHARED_OBJ_FROM_THIS,_1,_2,stamp))
+			);
+	}
+
 	void basic_http_connection_impl::__async_send_handler(
 		error_code ec, std::size_t len,op_stamp_t stamp)
 	{
@@ -466,21 +532,18 @@ namespace p2engine { namespace http { namespace detail {
 			return;
 
 		sending_=false;
+		sending_bufs_.clear();
 		if (!ec)
 		{
 			BOOST_ASSERT(send_bufs_len_>=len);
 			send_bufs_len_-=len;
 			if(!send_bufs_.empty())
 			{
-				asio::async_write(*socket_impl_,
-					send_bufs_.front().to_asio_const_buffers_1(),
-					asio::transfer_all(),
-					make_alloc_handler(
-					boost::bind(&this_type::__async_send_handler,
-					SHARED_OBJ_FROM_THIS,_1,_2,stamp))
-					);
-				send_bufs_.pop();
-				sending_=true;
+				__do_async_send(stamp);
+				//drained to low watermark, let the sender refill
+				if(connection_&&connection_->check_send_low_watermark(send_bufs_len_)
+					&&!is_canceled_op(stamp))
+					connection_->dispatch_sendout();
 			}
 			else if(state_==CLOSING)
 			{
@@ -489,13 +552,15 @@ namespace p2engine { namespace http { namespace detail {
 			else
 			{
 				if(!is_canceled_op(stamp)&&connection_)
+				{
+					connection_->check_send_low_watermark(0);
 					connection_->dispatch_sendout();
+				}
 			}
 		}
 		else
 		{
-			while(!send_bufs_.empty())
-				send_bufs_.pop();
+			send_bufs_.clear();
 			send_bufs_len_=0;
 			__to_close_state(ec,stamp);
 		}
@@ -509,17 +574,21 @@ namespace p2engine { namespace http { namespace detail {
 
 		if (ec)
 		{
-			while(!send_bufs_.empty())
-				send_bufs_.pop();
+			send_bufs_.clear();
 			__to_close_state(ec,stamp);
 			return;
 		}
 
 		recv_state_=RECVED;
-		if (is_recv_blocked_)
-			return;
-		if (!is_header_recvd_)
+		while (!is_recv_blocked_&&recv_buf_.size()>0)
 		{
+			if (is_header_recvd_)
+			{
+				if (!__dispatch_body(stamp))
+					return;
+				continue;
+			}
+
 			http::request  req;
 			http::response res;
 			http::header* h=(is_passive_?(http::header*)(&req):(http::header*)(&res));
@@ -529,14 +598,12 @@ namespace p2engine { namespace http { namespace detail {
 			int parseRst=h->parse(s,recv_buf_.size());
 			if(parseRst>0)
 			{
+				//the body left in recv_buf_ is dispatched in next loop, or 
+				//in keep_async_receiving if receiving is blocked by handler
 				is_header_recvd_=true;
-				safe_buffer buf;
-				if (std::size_t(parseRst)<recv_buf_.size())
-				{
-					safe_buffer_io bio(&buf);
-					bio.write(s+parseRst,recv_buf_.size()-parseRst);
-				}
-				recv_buf_.consume(recv_buf_.size());
+				recv_buf_.consume(parseRst);
+				is_chunked_=h->chunked_transfer_encoding();
+				chunked_decoder_.reset();
 				if (connection_)
 				{
 					const std::string&encoding=h->get(HTTP_ATOM_Content_Encoding);
@@ -544,29 +611,24 @@ namespace p2engine { namespace http { namespace detail {
 						is_gzip_=true;
 					else
 						is_gzip_=false;
+					is_inflating_=(is_gzip_&&connection_->auto_inflate_gzip());
+					if (is_inflating_)
+					{
+						if (!inflater_)
+							inflater_.reset(new gzip_inflater);
+						inflater_->reset();
+					}
 					if(is_passive_)
 						connection_->dispatch_request(req);
 					else
 						connection_->dispatch_response(res);
 				}
-				if(buf.length()>0&&!(is_canceled_op(stamp)||state_==CLOSED))
-				{
-					if (is_recv_blocked_)
-					{
-						memcpy(asio::buffer_cast<char*>(recv_buf_.prepare(buf.length())),
-							p2engine::buffer_cast<char*>(buf),buf.size());
-						recv_buf_.commit(buf.length());
-						return;
-					}
-					else 
-					{
-						__dispatch_packet(buf,stamp);
-					}
-				}
+				if(is_canceled_op(stamp)||state_==CLOSED||!connection_)
+					return;
 			}
 			else if(parseRst==0)
 			{
-				recv_state_=RECVING;
+				break;
 			}
 			else
 			{
@@ -574,17 +636,10 @@ namespace p2engine { namespace http { namespace detail {
 				__to_close_state(asio::error::message_size,stamp);
 				return;
 			}
-
-		}
-		else
-		{
-			safe_buffer buf;
-			safe_buffer_io bio(&buf);
-			const char* s=asio::buffer_cast<const char*>(recv_buf_.data());
-			bio.write(s,recv_buf_.size());
-			recv_buf_.consume(recv_buf_.size());
-			__dispatch_packet(buf,stamp);
 		}
+		if (is_recv_blocked_&&recv_buf_.size()>0)
+			return;
+
 		recv_state_=RECVING;
 		asio::async_read(*socket_impl_,
 			recv_buf_,
@@ -594,6 +649,60 @@ namespace p2engine { namespace http { namespace detail {
 			);
 	}
 
+	bool basic_http_connection_impl::__dispatch_body(op_stamp_t stamp)
+	{
+		BOOST_ASSERT(is_header_recvd_);
+
+		safe_buffer buf;
+		const char* s=asio::buffer_cast<const char*>(recv_buf_.data());
+		if (!is_chunked_)
+		{
+			safe_buffer_io bio(&buf);
+			bio.write(s,recv_buf_.size());
+			recv_buf_.consume(recv_buf_.size());
+		}
+		else
+		{
+			int len=chunked_decoder_.decode(s,recv_buf_.size(),buf);
+			if (len<0)
+			{
+				recv_buf_.consume(recv_buf_.size());
+				__to_close_state(asio::error::invalid_argument,stamp);
+				return false;
+			}
+			recv_buf_.consume(len);
+		}
+		if (is_inflating_&&buf.length()>0)
+		{
+			safe_buffer plain;
+			std::string err;
+			if (!inflater_->inflate(buf,plain,err))
+			{
+				LOG(LogError("inflate http body error: %s",err.c_str()););
+				__to_close_state(asio::error::invalid_argument,stamp);
+				return false;
+			}
+			buf=plain;
+		}
+		if (buf.length()>0)
+		{
+			__dispatch_packet(buf,stamp);
+			if(is_canceled_op(stamp)||state_==CLOSED||!connection_)
+				return false;
+		}
+		if (is_chunked_&&chunked_decoder_.is_done())
+		{
+			//body finished, the following data is a new message
+			is_chunked_=false;
+			is_header_recvd_=false;
+			if (connection_)
+				connection_->dispatch_data_end();
+			if(is_canceled_op(stamp)||state_==CLOSED||!connection_)
+				return false;
+		}
+		return true;
+	}
+
 
 	void basic_http_connection_impl::__allert_connected(error_code ec, 
 		op_stamp_t stamp)
@@ -2,6 +2,7 @@
 #include "p2engine/utilities.hpp"
 #include "p2engine/safe_buffer_io.hpp"
 #include "p2engine/broadcast_socket.hpp"
+#include "p2engine/enum_net.hpp"
 #include "p2engine/rdp/urdp_visitor.hpp"
 #include "p2engine/rdp/basic_shared_udp_layer.hpp"
 
@@ -12,6 +13,72 @@ typedef urdp_packet_basic_format packet_format_type;
 
 void __dummy_callback(const error_code&, size_t){}
 
+#if defined IP_MTU_DISCOVER
+	/* Linux */
+# define IP_OPT_DONT_FRAG IP_MTU_DISCOVER
+# ifdef IP_PMTUDISC_PROBE
+	//set DF but ignore the cached path mtu, what a probe wants
+#  define DONT_FRAG_VALUE IP_PMTUDISC_PROBE
+# else
+#  define DONT_FRAG_VALUE IP_PMTUDISC_DO
+# endif
+# define DO_FRAG_VALUE IP_PMTUDISC_DONT
+#elif defined IP_DONTFRAG
+	/* FreeBSD */
+# define IP_OPT_DONT_FRAG IP_DONTFRAG
+# define DONT_FRAG_VALUE 1
+# define DO_FRAG_VALUE 0
+#elif defined IP_DONTFRAGMENT
+	/* Winsock2 */
+# define IP_OPT_DONT_FRAG IP_DONTFRAGMENT
+# define DONT_FRAG_VALUE 1
+# define DO_FRAG_VALUE 0
+#endif
+
+#if defined IPV6_MTU_DISCOVER
+# define IPV6_OPT_DONT_FRAG IPV6_MTU_DISCOVER
+# ifdef IPV6_PMTUDISC_PROBE
+#  define DONT_FRAG_VALUE_V6 IPV6_PMTUDISC_PROBE
+# else
+#  define DONT_FRAG_VALUE_V6 IPV6_PMTUDISC_DO
+# endif
+# define DO_FRAG_VALUE_V6 IPV6_PMTUDISC_DONT
+#elif defined IPV6_DONTFRAG
+# define IPV6_OPT_DONT_FRAG IPV6_DONTFRAG
+# define DONT_FRAG_VALUE_V6 1
+# define DO_FRAG_VALUE_V6 0
+#endif
+
+static void set_dont_fragment(basic_shared_udp_layer::udp_socket_type& s, bool on, error_code& ec)
+{
+	error_code err;
+	bool v6=s.local_endpoint(err).address().is_v6();
+	if (v6)
+	{
+#ifdef IPV6_OPT_DONT_FRAG
+		typedef boost::asio::detail::socket_option::integer<IPPROTO_IPV6, IPV6_OPT_DONT_FRAG> 
+			do_not_fragment_v6;
+		s.set_option(do_not_fragment_v6(on?DONT_FRAG_VALUE_V6:DO_FRAG_VALUE_V6),ec);
+#endif
+		return;
+	}
+#ifdef IP_OPT_DONT_FRAG
+	typedef boost::asio::detail::socket_option::integer<IPPROTO_IP, IP_OPT_DONT_FRAG> 
+		do_not_fragment;
+	s.set_option(do_not_fragment(on?DONT_FRAG_VALUE:DO_FRAG_VALUE),ec);
+#endif
+}
+
+//datagrams are never bigger than the largest interface mtu allows
+static std::size_t max_recv_size(io_service& ios, std::size_t least)
+{
+	error_code ec;
+	int mtu=network_topology_service::get(ios).max_mtu(ec);
+	std::size_t n=(mtu>(int)IPV4_UDP_HEADER_SIZE)?std::size_t(mtu)-IPV4_UDP_HEADER_SIZE:0;
+	n=(std::min)(n,MAX_UDP_PAYLOAD_SIZE);
+	return (std::max)(n,least);
+}
+
 basic_shared_udp_layer::this_type_container 
 	basic_shared_udp_layer::s_shared_this_type_pool_;
 fast_mutex basic_shared_udp_layer::s_shared_this_type_pool_mutex_;
@@ -142,6 +209,8 @@ basic_shared_udp_layer::basic_shared_udp_layer(io_service& ios,
 	, flows_cnt_(0)
 	, state_(INIT)
 	, continuous_recv_cnt_(0)
+	, recv_size_(max_recv_size(ios,mtu_size))
+	, socket_recv_buf_size_(0)
 {
 	this->set_obj_desc("basic_shared_udp_layer");
 	socket_.open(local_edp.protocol(), ec);
@@ -154,24 +223,7 @@ basic_shared_udp_layer::basic_shared_udp_layer(io_service& ios,
 		socket_.close(ec);
 		return;
 	}
-#if defined IP_MTU_DISCOVER
-	/* Linux */
-# define IP_OPT_DONT_FRAG IP_MTU_DISCOVER
-# define DONT_FRAG_VALUE IP_PMTUDISC_DO
-#elif defined IP_DONTFRAG
-	/* FreeBSD */
-# define IP_OPT_DONT_FRAG IP_DONTFRAG
-# define DONT_FRAG_VALUE 1
-#elif defined IP_DONTFRAGMENT
-	/* Winsock2 */
-# define IP_OPT_DONT_FRAG IP_DONTFRAGMENT
-# define DONT_FRAG_VALUE 1
-#endif
-#ifdef IP_OPT_DONT_FRAG
-	typedef boost::asio::detail::socket_option::boolean<IPPROTO_IP, IP_OPT_DONT_FRAG> 
-		do_not_fragment;
-	socket_.set_option(do_not_fragment(!DONT_FRAG_VALUE),ec);
-#endif
+	set_dont_fragment(socket_,false,ec);
 #ifndef IPTOS_THROUGHPUT
 #	define	IPTOS_TOS_MASK		0x1E
 #	define	IPTOS_TOS(tos)		((tos)&IPTOS_TOS_MASK)
@@ -195,11 +247,15 @@ basic_shared_udp_layer::basic_shared_udp_layer(io_service& ios,
 	socket_.native_non_blocking(true, ec);
 	disable_icmp_unreachable(socket_.native());
 	socket_.set_option(asio::socket_base::reuse_address(false),ec);
-	socket_.set_option(do_not_fragment(false),ec);
+	set_dont_fragment(socket_,false,ec);
 	ec.clear();
 	socket_.set_option(asio::socket_base::receive_buffer_size(1024*1024),ec);
+	socket_recv_buf_size_=1024*1024;
 	if (ec)
+	{
 		socket_.set_option(asio::socket_base::receive_buffer_size(512*1024),ec);
+		socket_recv_buf_size_=512*1024;
+	}
 	ec.clear();
 	socket_.set_option(asio::socket_base::send_buffer_size(2*1024*1024),ec);
 	if (ec)
@@ -237,7 +293,7 @@ basic_shared_udp_layer::basic_shared_udp_layer(io_service& ios,
 			s_shared_this_type_pool_.insert(std::make_pair(local_endpoint_, this));
 		}
 	}
-	recv_buffer_.recreate(mtu_size);
+	recv_buffer_.recreate(recv_size_);
 #ifdef RUDP_SCRAMBLE
 	zero_8_bytes_.resize(8);
 	memset(buffer_cast<char*>(zero_8_bytes_),0,zero_8_bytes_.size());
@@ -310,7 +366,7 @@ void basic_shared_udp_layer::handle_receive(const error_code& ec,
 		{
 			global_remote_to_local_speed_meter()+=bytes_transferred;
 			do_handle_received(recv_buffer_.buffer_ref(0,bytes_transferred));
-			recv_buffer_.recreate(mtu_size);
+			recv_buffer_.recreate(recv_size_);
 		}
 		async_receive();
 	}
@@ -341,7 +397,7 @@ void basic_shared_udp_layer::handle_receive(const error_code& ec,
 			}
 			else if(len>0)
 			{
-				if (len<2*mtu_size)
+				if (len<2*recv_size_)
 				{
 					recv_buffer_.recreate(len);
 					bytes_transferred =socket_.receive(
@@ -349,7 +405,7 @@ void basic_shared_udp_layer::handle_receive(const error_code& ec,
 					global_remote_to_local_speed_meter()+=bytes_transferred;
 					if (!err)
 						do_handle_received(recv_buffer_.buffer_ref(0,bytes_transferred));
-					recv_buffer_.recreate(mtu_size);
+					recv_buffer_.recreate(recv_size_);
 				}
 				else
 				{
@@ -539,6 +595,42 @@ void  basic_shared_udp_layer::unregister_acceptor(const void*acptor)
 	}
 }
 
+basic_shared_udp_layer::remote_path::smart_ptr 
+	basic_shared_udp_layer::path_to(const endpoint_type& remote_edp, int32_t now)
+{
+	//no reference may be dropped under the lock, release_path takes it
+	remote_path::smart_ptr path;
+	fast_mutex::scoped_lock lock(path_mutex_);
+	path_container::iterator itr=paths_.find(remote_edp);
+	if (itr!=paths_.end())
+	{
+		path=itr->second;
+	}
+	else
+	{
+		path=new remote_path(remote_edp,SHARED_OBJ_FROM_THIS,now);
+		paths_.insert(std::make_pair(remote_edp,path.get()));
+	}
+	lock.unlock();
+	return path;
+}
+
+void basic_shared_udp_layer::remote_path::release()const
+{
+	//path_to adds a reference under path_mutex_ too, so once the count
+	//drops to zero here nobody can get the path again
+	shared_layer_sptr layer=shared_layer;
+	{
+		fast_mutex::scoped_lock lock(layer->path_mutex_);
+		if (--ref_count_!=0)
+			return;
+		path_container::iterator itr=layer->paths_.find(remote_endpoint);
+		if (itr!=layer->paths_.end()&&itr->second==this)
+			layer->paths_.erase(itr);
+	}
+	shared_access_destroy<remote_path>()(const_cast<remote_path*>(this));
+}
+
 std::size_t basic_shared_udp_layer::async_send_to(const safe_buffer& safebuffer,
 	const endpoint_type& ep, error_code& ec)
 {
@@ -600,6 +692,61 @@ std::size_t basic_shared_udp_layer::async_send_to(const safe_buffer& safebuffer,
 #endif
 }
 
+void basic_shared_udp_layer::reserve_receive_buffer(std::size_t n)
+{
+	if (n<=socket_recv_buf_size_)
+		return;
+	error_code ec;
+	socket_.set_option(asio::socket_base::receive_buffer_size((int)n),ec);
+	if (!ec)
+		socket_recv_buf_size_=n;
+}
+
+std::size_t basic_shared_udp_layer::send_probe_to(const safe_buffer& header,
+	const safe_buffer& padding, const endpoint_type& ep, error_code& ec)
+{
+	fast_mutex::scoped_lock lock(probe_mutex_);
+	if (!probe_socket_)
+	{
+		endpoint_type localEdp(local_endpoint_.address(), 0);
+		probe_socket_.reset(new udp_socket_type(get_io_service()));
+		probe_socket_->open(localEdp.protocol(), ec);
+		if (!ec)
+			probe_socket_->bind(localEdp, ec);
+		if (!ec)
+		{
+			asio::socket_base::non_blocking_io nonblock_command(true);
+			probe_socket_->io_control(nonblock_command, ec);
+			disable_icmp_unreachable(probe_socket_->native());
+		}
+		if (!ec)
+			set_dont_fragment(*probe_socket_, true, ec);
+		if (ec)
+		{
+			error_code err;
+			probe_socket_->close(err);
+			probe_socket_.reset();
+			return 0;
+		}
+	}
+#ifdef RUDP_SCRAMBLE
+	boost::array<asio::const_buffer,3> sndbufs={{
+		zero_8_bytes_.to_asio_const_buffer(),
+			header.to_asio_const_buffer(),
+			padding.to_asio_const_buffer()
+	}};
+#else
+	boost::array<asio::const_buffer,2> sndbufs={{
+		header.to_asio_const_buffer(),
+			padding.to_asio_const_buffer()
+	}};
+#endif
+	std::size_t len=probe_socket_->send_to(sndbufs,ep,0,ec);
+	if (!ec)
+		global_local_to_remote_speed_meter()+=len;
+	return len;
+}
+
 void basic_shared_udp_layer::do_handle_received(const safe_buffer& buffer)
 {
 #ifdef RUDP_SCRAMBLE
@@ -659,12 +806,32 @@ void basic_shared_udp_layer::do_handle_received_urdp_msg(safe_buffer& buffer)
 			BOOST_ASSERT(std::find(released_id_catch_.begin(),released_id_catch_.end(),id.flow_id)==released_id_catch_.end());
 			request_uuid_keeper_.try_keep(id,seconds(60));
 			dstPeerID=id.flow_id;
+			if (urdpHeaderDef.get_bandwidth_recving()&SYN_OPT_EARLY_DATA)
+			{
+				early_data_uuid earlyID;
+				earlyID.remoteEndpoint=id.remoteEndpoint;
+				earlyID.session=id.session;
+				earlyID.flow_id=id.flow_id;
+				early_data_uuid_keeper_.try_keep(earlyID,seconds(60));
+			}
 		}
 		BOOST_ASSERT(dstPeerID!=INVALID_FLOWID);
 	}
 	else
 	{
 		dstPeerID=get_dst_peer_id_vistor<packet_format_type>()(urdpHeaderDef);
+		if (dstPeerID==INVALID_FLOWID)
+		{
+			fast_mutex::scoped_lock lockAcceptor(acceptor_mutex_);
+
+			early_data_uuid id;
+			id.remoteEndpoint=sender_endpoint_;
+			id.session=get_session_vistor<packet_format_type>()(urdpHeaderDef);
+			BOOST_AUTO(keeperItr,early_data_uuid_keeper_.find(id));
+			if (keeperItr==early_data_uuid_keeper_.end())
+				return;//it is ahead of its CONNECT, it will be resent
+			dstPeerID=keeperItr->flow_id;
+		}
 	}
 
 	fast_mutex::scoped_lock lockFlow(flow_mutex_);
@@ -63,6 +63,7 @@ void trdp_flow::__init()
 	connection_=NULL;
 	sending_=false;
 	qued_sending_size_=0;
+	sending_size_=0;
 	while(!send_bufs_.empty())
 		send_bufs_.pop();
 	//can_send_=false;
@@ -428,6 +429,8 @@ void trdp_flow::__close(bool greacful)
 	{
 		send_bufs_.pop();
 	}
+	qued_sending_size_=0;
+	sending_size_=0;
 
 	if (conn_timer_)
 	{
@@ -859,12 +862,7 @@ void trdp_flow::__send(const safe_buffer& buffer, char type, bool alertWritable,
 		else
 			elm.outTime=now+250;//un-reliable packets, will be discard if they could not be sent with 250ms
 		send_bufs_.push(elm);
-
-		if (send_bufs_.size()>4096)
-		{
-
-		}
-
+		qued_sending_size_+=buffer.length();
 		return;
 	}
 
@@ -878,6 +876,9 @@ void trdp_flow::__send(const safe_buffer& buffer, char type, bool alertWritable,
 	if (msgType)
 		io<<uint16_t(*msgType);
 
+	sending_size_=buffer.length();
+	qued_sending_size_+=sending_size_;
+
 	out_speed_meter_+=len.length()+buffer.length();
 	global_local_to_remote_speed_meter()+=len.length()+buffer.length();
 	__local_to_remote_lost_rate(&id_for_lost_rate_);
@@ -918,6 +919,9 @@ void trdp_flow::__handle_sent_packet(const error_code& ec, std::size_t bytes_tra
 	if(is_canceled_op(stamp)||state_==CLOSED)
 		return;
 
+	qued_sending_size_-=sending_size_;
+	sending_size_=0;
+
 	if (ec)
 	{
 		if (connection_)
@@ -925,7 +929,9 @@ void trdp_flow::__handle_sent_packet(const error_code& ec, std::size_t bytes_tra
 		return;
 	}
 
-	if (connection_&&allertWritable)
+	//the connection checks the low watermark
+	(void)(allertWritable);
+	if (connection_)
 		connection_->on_writeable();
 	if(is_canceled_op(stamp)||state_==CLOSED)
 		return;
@@ -935,6 +941,7 @@ void trdp_flow::__handle_sent_packet(const error_code& ec, std::size_t bytes_tra
 	{
 		send_emlment elm=send_bufs_.front();
 		send_bufs_.pop();
+		qued_sending_size_-=elm.buf.length();
 		if (elm.outTime>=now)
 		{
 			uint16_t*  pMsgType=((elm.msgType==INVALID_MSGTYPE)?NULL:&elm.msgType);
@@ -1,5 +1,6 @@
 #include "p2engine/safe_buffer_io.hpp"
 #include "p2engine/atomic.hpp"
+#include "p2engine/enum_net.hpp"
 #include "p2engine/rdp/urdp_visitor.hpp"
 #include "p2engine/rdp/urdp_flow.hpp"
 #include "p2engine/rdp/const_define.hpp"
@@ -25,6 +26,56 @@ namespace
 
 	const time32_type MIN_CLOCK_CHECK_TIME=30;
 
+	// Path mtu discovery (DPLPMTUD, RFC8899)
+	const uint32_t PMTU_BASE_UDP_PAYLOAD=1200;//fits the ipv6 minimum mtu
+	const uint8_t PMTU_MAX_PROBES=3;
+	const uint32_t PMTU_SEARCH_GRANULARITY=16;
+	const time32_type PMTU_RAISE_TIMER=600*1000;
+	const int8_t PMTU_BLACK_HOLE_XMIT=2;//lost twice by RTO
+	const uint32_t PMTU_BASE=PMTU_BASE_UDP_PAYLOAD
+		-urdp_flow::shared_layer_type::datagram_overhead;
+
+	// Window scale, the shift we ask the remote to apply to our window so
+	// that a window of MAX_BUF_SIZE fits the 16 bits field
+	const uint8_t RCV_WINDOW_SHIFT=8;
+	const uint8_t MAX_WINDOW_SHIFT=14;//RFC7323
+
+	// Resends of unreliable segments are due in buckets of this many ms,
+	// the segments of one bucket are sent in order of priority
+	const time32_type UNRELIABLE_SCHEDULE_GRANULARITY=16;
+
+	// Forward error correction, one xor parity for every group of
+	// unreliable and semireliable packets
+	const uint8_t FEC_MAX_GROUP=16;//bits of the semireliable mask
+	const time32_type FEC_FLUSH_DELAY=20;//a group not filled in time
+	const time32_type FEC_HOLD_TIME=1000;//received packets kept for decoding
+	const std::size_t FEC_MAX_PARITY=8;//parities waiting for packets
+	const std::size_t FEC_PARITY_HEADER_SIZE=10;
+
+	//session resumption
+	const std::size_t RESUME_TICKET_CACHE_SIZE=1024;
+
+	//connection migration
+	const uint8_t PATH_CHALLENGE_MAX_XMIT=3;
+
+	//ack frequency, asked of the remote by the sender of data
+	const uint32_t ACK_FREQUENCY_DEFAULT=2;//every second packet
+	const uint32_t ACK_FREQUENCY_MAX=16;
+	const uint32_t ACK_FREQUENCY_PER_WINDOW=8;//ACKs for every cwnd of data
+
+	//multipath
+	const std::size_t SUBPATH_MAX=8;
+	const uint8_t SUBPATH_JOIN_MAX_XMIT=5;
+	const double SUBPATH_LOSS_WINDOW=32.0;//segments the loss rate averages
+	const double SUBPATH_WEIGHT_SCALE=1024.0*1024.0;
+	const time32_type SUBPATH_DEFAULT_RTT=100;
+
+	inline void xor_bytes(char* dst, const char* src, std::size_t len)
+	{
+		for (std::size_t i=0;i<len;++i)
+			dst[i]^=src[i];
+	}
+
 	template<typename Type>
 	inline Type bound(Type lower, Type middle, Type upper) 
 	{	
@@ -35,6 +86,12 @@ namespace
 	{
 		return t? t: ++t;
 	}
+
+	inline time32_type schedule_bucket(time32_type t)
+	{
+		return (time32_type)(((uint32_t)t+UNRELIABLE_SCHEDULE_GRANULARITY-1)
+			&~(uint32_t)(UNRELIABLE_SCHEDULE_GRANULARITY-1));
+	}
 }
 
 DEBUG_SCOPE(
@@ -53,6 +110,9 @@ DEBUG_SCOPE(
 std::set<urdp_flow*> s_urdp_flow_map;
 #endif
 
+urdp_flow::ResumeTicketMap urdp_flow::s_resume_tickets;
+fast_mutex urdp_flow::s_resume_tickets_mutex;
+
 
 boost::shared_ptr<urdp_flow> urdp_flow::create_for_active_connect(connection_sptr sock, 
 																  io_service& ios, 
@@ -85,6 +145,7 @@ boost::shared_ptr<urdp_flow> urdp_flow::create_for_passive_connect(io_service& i
 	obj->m_token=shared_layer_type::create_flow_token(sharedLayer, obj.get(), 
 		boost::move(boost::bind(&this_type::called_by_sharedlayer_on_recvd, obj.get(), _1, _2)), 
 		ec);
+	obj->__attach_path(tick_now());
 	obj->m_timer->async_wait(milliseconds(IDLE_TIMEOUT));//if nothing happened in IDLE_TIMEOUT, close
 	return obj;
 }
@@ -157,25 +218,60 @@ void urdp_flow::__init()
 	m_remote_peer_id=get_invalid_peer_id_vistor<packet_format_type>()();
 	m_ping_interval=DEFAULT_TIMEOUT;
 	m_state = INIT;
-	m_snd_wnd=RECV_BUF_SIZE/2;
-	m_rcv_wnd = RECV_BUF_SIZE;
+	m_rcv_buf_size=DEFAULT_RECV_BUF_SIZE;
+	m_snd_buf_size=DEFAULT_SND_BUF_SIZE;
+	m_rcv_wscale=m_snd_wscale=0;
+	m_snd_wnd=DEFAULT_RECV_BUF_SIZE/2;
+	m_rcv_wnd = m_rcv_buf_size;
 	m_snd_una=m_snd_nxt=random<uint32_t>(0xff, 0x7fffffff);
 	m_slen = 0;
+	m_stream_qlen = 0;
+	m_stream_vtime = 0;
 	//m_rcv_nxt=0;//it will be inited when shakehand
 	m_rlen = 0;
 	m_detect_readable = true;
 	m_detect_writable = false;
 	m_t_ack = 0;
+	m_ack_pending = 0;
+	m_ack_frequency = ACK_FREQUENCY_DEFAULT;
+	m_ack_delay = ACK_DELAY;
 
 	//m_msslevel = 0;
 	//m_largest = 0;
 	//m_mtu_advise = MAX_PACKET;
 	m_mss =MTU_SIZE;//DEFAULT_MSS;
 
+	m_remote_syn_options=0;
+	m_pmtu_state=PMTU_DISABLED;
+	m_pmtu_probe_count=0;
+	m_pmtu=m_pmtu_low=m_pmtu_high=m_mss+reliable_packet_format_type::format_size();
+	m_pmtu_probe_size=0;
+	m_pmtu_retry_size=0;
+	m_t_pmtu=0;
+
+	m_path_challenge=0;
+	m_path_challenge_xmit=0;
+	m_t_path_challenge=0;
+
+	m_subpaths.clear();
+	m_t_subpath=0;
+
+	m_fec_enabled=false;
+	m_scatter_delivery=false;
+	m_fec_base=0;
+	m_fec_count=m_fec_group_size=0;
+	m_fec_semi_mask=m_fec_len_xor=m_fec_type_xor=0;
+	m_t_fec_flush=0;
+
+	m_session_resumption=false;
+	m_resume_ticket=0;
+	m_t_resume_ticket=0;
+	m_resume_pmtu=0;
+
 	m_t_rto_base = 0;
 
 	m_cwnd = 2 * m_mss;
-	m_ssthresh = RECV_BUF_SIZE;
+	m_ssthresh = MAX_BUF_SIZE;//arbitrarily high, the window limits slow start
 	m_t_lastrecv = m_t_lastsend = m_t_lasttraffic = now;
 
 	m_dup_acks = 0;
@@ -196,6 +292,8 @@ void urdp_flow::__init()
 	b_close_called_=false;
 	b_timer_posted_=false;
 	b_ignore_all_pkt_=false;
+	b_resuming_=false;
+	b_session_resumed_=false;
 }
 
 void urdp_flow::called_by_sharedlayer_on_recvd(const safe_buffer& buf, 
@@ -252,9 +350,35 @@ void urdp_flow::async_connect(const endpoint_type& remoteEnp,
 	m_remote_endpoint=remoteEnp;
 	b_active_=true;
 	m_state = SYN_SENT;
+	__attach_path(now);
 
-	//send connect request 
-	__queue(domainName.c_str(), domainName.length(), CTRL_CONNECT);
+	//send connect request, a resume ticket follows the domain name
+	std::string connectData(domainName);
+	if (m_session_resumption)
+	{
+		m_resume_domain=domainName;
+		if (__take_resume_ticket(now))
+		{
+			char ticket[RESUME_TICKET_SIZE];
+			char* pTicket=ticket;
+			write_uint64_hton(m_resume_ticket, pTicket);
+			connectData.append(ticket, RESUME_TICKET_SIZE);
+
+			//data may be sent right behind CONNECT, the sequence of the
+			//remote is unknown until CONNECT_ACK. the remote scales the
+			//windows of that data by the shift CONNECT offers, the ticket
+			//shows it knows the option.
+			m_lastack=m_rcv_nxt=0;
+			m_rcv_wscale=RCV_WINDOW_SHIFT;
+			m_state=ESTABLISHED;
+			b_resuming_=true;
+			b_session_resumed_=true;
+			operation_mark_post(SHARED_OBJ_FROM_THIS, 
+				boost::bind(&this_type::__allert_connected, this, error_code())
+				);
+		}
+	}
+	__queue(connectData.c_str(), connectData.length(), CTRL_CONNECT);
 	__attempt_send();
 	__schedule_timer(now);
 }
@@ -312,10 +436,18 @@ void urdp_flow::__async_receive(op_stamp_t mark)
 
 	error_code ec;
 	safe_buffer buf;
-	__recv(buf, ec);
+	safe_buffer_chain bufs;
+	bool scatter=m_scatter_delivery;
+	if (scatter)
+		__recv(bufs, ec);
+	else
+		__recv(buf, ec);
 	if (!ec)
 	{
-		__allert_received(buf);
+		if (scatter)
+			__allert_received(bufs);
+		else
+			__allert_received(buf);
 		__async_receive(mark);
 	}
 	else
@@ -333,15 +465,16 @@ void urdp_flow::__async_receive(op_stamp_t mark)
 }
 
 void urdp_flow::async_send(const safe_buffer& buf, message_type msgType, 
-						   boost::logic::tribool reliable)
+						   boost::logic::tribool reliable, stream_id_type streamId)
 {
 	error_code ec;
-	__send(buf, msgType, reliable, ec);
+	__send(buf, msgType, reliable, streamId, ec);
 	if (ec)
 	{
 		if (ec == asio::error::would_block || ec == asio::error::try_again)
 		{
-			//do nothing? 
+			//the message is queued, the connection blocks its sender on
+			//the send buffer size and acks bring writable back
 		}
 		else
 		{
@@ -374,7 +507,7 @@ safe_buffer urdp_flow::make_punch_packet(error_code& ec, const endpoint& externa
 		writer.set_lostrate_recving(uint32_t(remoteToLocalLostrate/LOST_RATE_PRECISION));
 		writer.set_id_for_lost_detect(id_for_lost_rate_++);
 		writer.set_session_id(m_session_id);
-		writer.set_window((uint16_t)std::min(m_rcv_wnd, (uint32_t)0xffff));//any value
+		writer.set_window(__advertised_window(CTRL_PUNCH));//any value
 		writer.set_time_sending((uint16_t)scape_zero(now));//any value
 		writer.set_time_echo(m_t_recent+((uint16_t)(now)-m_t_recent_now));//any value
 		writer.set_seqno(m_snd_nxt);//any value
@@ -445,7 +578,7 @@ void urdp_flow::__on_clock(VC9_BIND_BUG_PARAM)
 
 	// Check for idle timeout
 	if ((m_state == ESTABLISHED) 
-		&& mod_less_equal(m_t_lastrecv+m_ping_interval+DEFAULT_TIMEOUT, now)
+		&& mod_less_equal(__idle_deadline(), now)
 		) 
 	{
 		__allert_disconnected(asio::error::timed_out);
@@ -462,6 +595,15 @@ void urdp_flow::__on_clock(VC9_BIND_BUG_PARAM)
 		} 
 		else 
 		{
+			//a big segment that keeps getting lost may be eaten by a path
+			//mtu black hole, fall back to the base size before resending.
+			if (m_pmtu_state!=PMTU_DISABLED
+				&&m_retrans_slist.front().xmit>=PMTU_BLACK_HOLE_XMIT
+				&&m_retrans_slist.front().buf.size()+reliable_packet_format_type::format_size()>PMTU_BASE
+				)
+			{
+				__pmtu_black_hole(now);
+			}
 			//send the oldest unacked packet
 			if (!__transmit(m_retrans_slist.begin(), now)) 
 			{
@@ -480,31 +622,28 @@ void urdp_flow::__on_clock(VC9_BIND_BUG_PARAM)
 	}
 
 	//is it time to send next unreliable packet?
-	while(!m_unreliable_slist.empty())
-	{
-		SUnraliableSegmentList::iterator itr=m_unreliable_slist.begin();
-		SUnraliableSegment& seg = const_cast<SUnraliableSegment&>(*itr);
-		if (mod_less_equal(seg.timeout, now))
-		{
-			__packet_as_unreliable_and_sendout(seg, now);
-			if(seg.remainXmit<=0)
-				m_unreliable_slist.erase(itr);
-			else
-			{
-				SUnraliableSegment segcpy=seg;
-				m_unreliable_slist.erase(itr);
-				m_unreliable_slist.insert(segcpy);
-			}
-		}
-		else
-			break;
-	}
+	__send_due_unreliable(now);
+
+	//flush the parity of a group that is not filled in time
+	if (m_t_fec_flush && mod_less_equal(m_t_fec_flush, now))
+		__fec_send_parity(now);
+
+	// path mtu probe lost or time to raise the path mtu again?
+	if (m_t_pmtu && mod_less_equal(m_t_pmtu, now))
+		__pmtu_on_timer(now);
+
+	// path challenge lost?
+	if (m_t_path_challenge && mod_less_equal(m_t_path_challenge, now))
+		__path_on_timer(now);
+
+	// path join lost?
+	if (m_t_subpath && mod_less_equal(m_t_subpath, now))
+		__subpath_on_timer(now);
 
 	// Check for ping timeout 
 	// Do not care about haveSentMsg!!
-	time32_type pingBaseTime=(b_active_?m_t_lastsend:(m_t_lastrecv+5000));
 	if ((m_state == ESTABLISHED) 
-		&&mod_less_equal(pingBaseTime+m_ping_interval, now)
+		&&mod_less_equal(__ping_base_time(now)+m_ping_interval, now)
 		&&m_slist.empty()
 		&&m_retrans_slist.empty()
 		) 
@@ -539,7 +678,7 @@ void urdp_flow::__on_clock(VC9_BIND_BUG_PARAM)
 	}
 
 	// Check if it's time to _send delayed acks
-	if (!haveSentReliableMsg&&m_t_ack&&mod_less_equal(m_t_ack+ACK_DELAY, now)) 
+	if (!haveSentReliableMsg&&m_t_ack&&mod_less_equal(m_t_ack+m_ack_delay, now)) 
 	{
 		__packet_as_reliable_and_sendout(m_snd_nxt, CTRL_ACK, NULL, now);
 		haveSentReliableMsg=true;
@@ -548,6 +687,57 @@ void urdp_flow::__on_clock(VC9_BIND_BUG_PARAM)
 	__schedule_timer(now, true);
 }
 
+void urdp_flow::receive_buffer_size(std::size_t n)
+{
+	m_rcv_buf_size=(uint32_t)bound<std::size_t>(MIN_BUF_SIZE, n, MAX_BUF_SIZE);
+	if (m_token)
+		m_token->shared_layer->reserve_receive_buffer(m_rcv_buf_size);
+	uint32_t rcvSpace=(m_rcv_buf_size>m_rlen)?(m_rcv_buf_size-m_rlen):0;
+	bool opened=rcvSpace>m_rcv_wnd;
+	m_rcv_wnd=rcvSpace;
+	if (opened&&m_state==ESTABLISHED)
+		__attempt_send(sfImmediateAck);//let the remote know now
+}
+
+void urdp_flow::send_buffer_size(std::size_t n)
+{
+	m_snd_buf_size=(uint32_t)bound<std::size_t>(MIN_BUF_SIZE, n, MAX_BUF_SIZE);
+}
+
+void urdp_flow::message_priority(message_type msgType, int priority)
+{
+	m_message_policy[msgType].priority=(int8_t)bound<int>(-128, priority, 127);
+}
+
+int urdp_flow::message_priority(message_type msgType)const
+{
+	MessagePolicyMap::const_iterator itr=m_message_policy.find(msgType);
+	if (itr!=m_message_policy.end())
+		return itr->second.priority;
+	return 0;
+}
+
+void urdp_flow::message_lifetime(message_type msgType, const time_duration& lifetime)
+{
+	m_message_policy[msgType].lifetime=(time32_type)bound<tick_type>(0, 
+		lifetime.total_milliseconds(), (std::numeric_limits<time32_type>::max)()/2);
+}
+
+time_duration urdp_flow::message_lifetime(message_type msgType)const
+{
+	MessagePolicyMap::const_iterator itr=m_message_policy.find(msgType);
+	if (itr!=m_message_policy.end())
+		return milliseconds(itr->second.lifetime);
+	return milliseconds(0);
+}
+
+void urdp_flow::stream_priority(stream_id_type streamId, int priority, int weight)
+{
+	SStream& stream=m_streams[streamId];
+	stream.priority=(int8_t)bound<int>(-128, priority, 127);
+	stream.weight=(uint16_t)bound<int>(1, weight, 0xffff);
+}
+
 void urdp_flow::ping_interval(const time_duration& t)
 {
 	bool scheduTime=m_ping_interval>t.total_milliseconds();
@@ -606,7 +796,7 @@ double urdp_flow::alive_probability()const
 	time32_type rTT=m_srtt;
 	double deadline=std::max<time32_type>(5000, 
 		std::min<time32_type>(10000, std::min(m_ping_interval<<1, rTT<<2)));
-	double a=(double)(mod_minus(now, m_t_lastrecv)-(int)(m_ping_interval+rTT));
+	double a=(double)(mod_minus(now, __idle_deadline()-DEFAULT_TIMEOUT)-(int)rTT);
 	if (a<=0)
 		return 1.0;
 	double p=(deadline-a)/(deadline);
@@ -663,6 +853,7 @@ void urdp_flow::__close(bool graceful)
 	else if (SD_GRACEFUL==m_shutdown)
 	{
 		m_state=CLOSING;
+		__fill_from_streams(m_stream_qlen);
 		if (m_retrans_slist.empty()&&m_slist.empty())
 		{
 			m_t_close_base=now+WAIT_FIN_ACK_TIMEOUT;
@@ -688,7 +879,12 @@ void urdp_flow::__to_closed_state()
 	}
 
 	BOOST_ASSERT(m_self_holder);
+	if (b_active_&&m_resume_ticket&&!b_resuming_)
+		__keep_resume_ticket(true);
 	m_state=CLOSED;
+	m_path.reset();
+	m_subpaths.clear();
+	m_t_subpath=0;
 	m_token.reset();
 	if (m_timer)
 	{
@@ -700,6 +896,8 @@ void urdp_flow::__to_closed_state()
 	m_slist.clear();
 	m_retrans_slist.clear();
 	m_rlist.clear();
+	m_streams.clear();
+	m_stream_qlen=0;
 	m_t_rto_base=0;
 
 	//To close state we must reset self_holder_, otherwise, we cant delete this_ptr
@@ -799,7 +997,7 @@ int urdp_flow::__can_let_transport_read()
 	return maxReadLen;
 }
 
-int urdp_flow::__recv(safe_buffer& buf, error_code& ec) 
+int urdp_flow::__can_recv(error_code& ec) 
 {
 	if (!m_socket||m_state != ESTABLISHED) 
 	{
@@ -818,6 +1016,14 @@ int urdp_flow::__recv(safe_buffer& buf, error_code& ec)
 		return -1;
 	}
 	BOOST_ASSERT(maxReadLen>0);
+	return maxReadLen;
+}
+
+int urdp_flow::__recv(safe_buffer& buf, error_code& ec) 
+{
+	int maxReadLen=__can_recv(ec);
+	if (maxReadLen<0)
+		return -1;
 
 	//read unreliable packet
 	if (!m_unreliable_rlist.empty())
@@ -852,25 +1058,78 @@ int urdp_flow::__recv(safe_buffer& buf, error_code& ec)
 		}
 	}
 	BOOST_ASSERT(maxReadLen==readLen);
+	__update_rcv_wnd();
+
+	uint16_t msgLen;
+	io>>msgLen;//trim tow bytes which are length of this packet
+	BOOST_ASSERT(msgLen+2==(int)buf.length());
+	return maxReadLen-2;
+}
+
+int urdp_flow::__recv(safe_buffer_chain& bufs, error_code& ec) 
+{
+	int maxReadLen=__can_recv(ec);
+	if (maxReadLen<0)
+		return -1;
 
-	if ((RECV_BUF_SIZE - m_rlen - m_rcv_wnd) >=(std::min<uint32_t>)(RECV_BUF_SIZE / 2, m_mss)) 
+	bufs.clear();
+	//read unreliable packet
+	if (!m_unreliable_rlist.empty())
 	{
-		bool bWasClosed = (m_rcv_wnd == 0); // !?! Not sure about this was closed business
+		bufs.push_back(m_unreliable_rlist.front());
+		m_unreliable_rlist.pop_front();
+		return (int)bufs.size();
+	}
 
-		m_rcv_wnd = RECV_BUF_SIZE - m_rlen;
+	//read reliable packet, the segments are referenced as they are
+	int readLen=0;
+	while (maxReadLen-readLen>0)
+	{
+		RSegmentList::iterator itr=m_rlist.begin();
+		RSegment& segment=const_cast<RSegment&>(*itr);
+		int lenth=(std::min<int>)(maxReadLen-readLen, segment.buf.size());
+		bufs.push_back(segment.buf.buffer_ref(0, lenth));
+		segment.buf=segment.buf.buffer_ref(lenth);//consume(lenth);
+		m_rlen -=lenth;
+		readLen+=lenth;
 
-		if (bWasClosed) 
-			__attempt_send(sfImmediateAck);
+		if (segment.buf.size()==0)
+		{
+			m_rlist.erase(m_rlist.begin());
+		}
+		else
+		{
+			segment.seq+=lenth;//the seq+lenth MUST be greater than (++itr)->seq.
+			break;
+		}
 	}
+	BOOST_ASSERT(maxReadLen==readLen);
+	__update_rcv_wnd();
 
 	uint16_t msgLen;
-	io>>msgLen;//trim tow bytes which are length of this packet
-	BOOST_ASSERT(msgLen+2==(int)buf.length());
+	bufs>>msgLen;//trim tow bytes which are length of this packet
+	BOOST_ASSERT(msgLen+2==(int)bufs.length());
 	return maxReadLen-2;
 }
 
+void urdp_flow::__update_rcv_wnd()
+{
+	uint32_t rcvSpace=(m_rcv_buf_size>m_rlen)?(m_rcv_buf_size-m_rlen):0;
+	if (rcvSpace>m_rcv_wnd
+		&&(rcvSpace - m_rcv_wnd) >=(std::min<uint32_t>)(m_rcv_buf_size / 2, m_mss)) 
+	{
+		bool bWasClosed = (m_rcv_wnd == 0); // !?! Not sure about this was closed business
+
+		m_rcv_wnd = rcvSpace;
+
+		if (bWasClosed) 
+			__attempt_send(sfImmediateAck);
+	}
+}
+
 int urdp_flow::__send(safe_buffer buf, uint16_t msgType, 
-					  boost::logic::tribool reliable, error_code& ec)
+					  boost::logic::tribool reliable, stream_id_type streamId,
+					  error_code& ec)
 {
 	if (!m_socket||m_state != ESTABLISHED) 
 	{
@@ -885,30 +1144,31 @@ int urdp_flow::__send(safe_buffer buf, uint16_t msgType,
 	{
 		BOOST_ASSERT(reliable.value==boost::logic::tribool::true_value);
 
-		//write packet chunk header
+		//the message waits in its stream until the window has room for it,
+		//__attempt_send moves it to m_slist
 		uint16_t bufLen=(uint16_t)buf.size();
 		BOOST_ASSERT(bufLen<=(std::numeric_limits<uint16_t>::max)());
-		char header[4];
-		char* ptoHeader=header;
-		write_uint16_hton(bufLen, ptoHeader);
-		write_uint16_hton((uint16_t)msgType, ptoHeader);
-		__queue(header, 4, CTRL_DATA, buf.size());
-		int written = __queue(buffer_cast<char*>(buf), bufLen, CTRL_DATA, 0);//write data
+		SStream& stream=m_streams[streamId];
+		if (stream.msgs.empty())
+			stream.vtime=std::max(stream.vtime, m_stream_vtime);
+		stream.msgs.push_back(SStreamMessage(buf, msgType));
+		m_stream_qlen+=bufLen+4;
 		__attempt_send();
 
-		if (m_slen >= SND_BUF_SIZE) 
+		//acks will notify the connection to check its low watermark
+		m_detect_writable = true;
+		if (m_slen+m_stream_qlen >= m_snd_buf_size) 
 		{
-			m_detect_writable = true;
 			ec=asio::error::would_block;
 			return -1;
 		}
-		return written;
+		return bufLen;
 	}
 	else//semireliable&unreliable
 	{
 		size_t bufLen=buf.size();
-		BOOST_ASSERT(bufLen<=2*m_mss);
-		if (bufLen>2*m_mss||bufLen==0)
+		BOOST_ASSERT(bufLen<=2*MTU_SIZE);
+		if (bufLen>2*MTU_SIZE||bufLen==0)
 			return (int)bufLen;//do not send packet with length>mss
 
 		time32_type now=tick_now();
@@ -917,6 +1177,14 @@ int urdp_flow::__send(safe_buffer buf, uint16_t msgType,
 		seg.buf=buf;
 		seg.msgType=msgType;
 		seg.pktID=++m_unreliable_pktid;
+		bool fec=__fec_active();
+		MessagePolicyMap::const_iterator policy=m_message_policy.find(msgType);
+		if (policy!=m_message_policy.end())
+		{
+			seg.priority=policy->second.priority;
+			if (policy->second.lifetime)
+				seg.deadline=scape_zero(now+policy->second.lifetime);
+		}
 
 		if (!reliable)//unreliable
 		{
@@ -929,7 +1197,14 @@ int urdp_flow::__send(safe_buffer buf, uint16_t msgType,
 			BOOST_ASSERT(reliable.value==boost::logic::tribool::indeterminate_value);
 			seg.control=CTRL_SEMIRELIABLE_DATA;
 			double lostRate=local_to_remote_lost_rate();
-			if (lostRate>0.1)
+			if (fec)
+			{
+				//the parity of its group stands in for the duplicates, 
+				//resend once more only on a lossy path
+				seg.timeout=now+random(10, 30);//resend
+				seg.remainXmit=(lostRate>0.05)?2:1;
+			}
+			else if (lostRate>0.1)
 			{
 				seg.timeout=now+random(10, 30);//resend
 				seg.remainXmit=3;
@@ -945,12 +1220,58 @@ int urdp_flow::__send(safe_buffer buf, uint16_t msgType,
 			}
 		}
 		__packet_as_unreliable_and_sendout(seg, now);
+		if (fec)
+			__fec_add(seg, now);
 		if (seg.remainXmit>0)
-			m_unreliable_slist.insert(seg);
+			__schedule_unreliable(seg);
+		if (seg.remainXmit>0||m_t_fec_flush)
+			__schedule_timer(now);
 		return (int)bufLen;//ȳȴmssֱӶ
 	}
 }
 
+void urdp_flow::__fill_from_streams(uint32_t len)
+{
+	//move whole messages to m_slist until len bytes are moved. the stream
+	//of the highest priority goes first, among one priority the stream
+	//with the least service for its weight.
+	uint32_t moved=0;
+	while (moved<len&&m_stream_qlen>0)
+	{
+		StreamMap::iterator best=m_streams.end();
+		for (StreamMap::iterator itr=m_streams.begin();itr!=m_streams.end();++itr)
+		{
+			const SStream& s=itr->second;
+			if (s.msgs.empty())
+				continue;
+			if (best==m_streams.end()
+				||s.priority>best->second.priority
+				||(s.priority==best->second.priority&&s.vtime<best->second.vtime))
+				best=itr;
+		}
+		BOOST_ASSERT(best!=m_streams.end());
+		SStream& stream=best->second;
+		SStreamMessage& msg=stream.msgs.front();
+
+		//write packet chunk header
+		uint16_t bufLen=(uint16_t)msg.buf.size();
+		char header[4];
+		char* ptoHeader=header;
+		write_uint16_hton(bufLen, ptoHeader);
+		write_uint16_hton(msg.msgType, ptoHeader);
+		__queue(header, 4, CTRL_DATA, bufLen);
+		__queue(buffer_cast<char*>(msg.buf), bufLen, CTRL_DATA, 0);//write data
+
+		m_stream_vtime=stream.vtime;
+		stream.vtime+=((uint64_t)(bufLen+4)<<8)/stream.weight;
+		m_stream_qlen-=bufLen+4;
+		moved+=bufLen+4;
+		stream.msgs.pop_front();
+		if (stream.msgs.empty()&&stream.priority==0&&stream.weight==1)
+			m_streams.erase(best);
+	}
+}
+
 uint32_t urdp_flow::__queue(const char * data, std::size_t len, uint8_t ctrlType, 
 							std::size_t reserveLen) 
 {
@@ -999,22 +1320,28 @@ uint32_t urdp_flow::__queue(const char * data, std::size_t len, uint8_t ctrlType
 	return (uint32_t)writeLen;
 }
 
+void urdp_flow::__fill_unreliable_header(packet<unreliable_packet_format_type>& urdp_header,
+										 uint8_t control)
+{
+	double remoteToLocalLostrate=(remote_to_local_lost_rate_<0.0?0.0:remote_to_local_lost_rate_);
+
+	urdp_header.set_control(control);
+	urdp_header.set_peer_id(control==CTRL_CONNECT?m_token->flow_id:m_remote_peer_id);
+	urdp_header.set_lostrate_recving(uint32_t(remoteToLocalLostrate/LOST_RATE_PRECISION));
+	urdp_header.set_id_for_lost_detect(id_for_lost_rate_++);
+	urdp_header.set_session_id(m_session_id);
+	urdp_header.set_window(__advertised_window(control));
+}
+
 int urdp_flow::__packet_as_unreliable_and_sendout(SUnraliableSegment& seg, time32_type now) 
 {
 	BOOST_ASSERT(m_self_holder);
 
-	double remoteToLocalLostrate=(remote_to_local_lost_rate_<0.0?0.0:remote_to_local_lost_rate_);
-
 	const size_t format_size=unreliable_packet_format_type::format_size();
 	safe_buffer urdp_header_buf(format_size+4);//4 bytes for pktID and msgType
 
 	packet<unreliable_packet_format_type> urdp_header(urdp_header_buf,true);
-	urdp_header.set_control(seg.control);
-	urdp_header.set_peer_id(seg.control==CTRL_CONNECT?m_token->flow_id:m_remote_peer_id);
-	urdp_header.set_lostrate_recving(uint32_t(remoteToLocalLostrate/LOST_RATE_PRECISION));
-	urdp_header.set_id_for_lost_detect(id_for_lost_rate_++);
-	urdp_header.set_session_id(m_session_id);
-	urdp_header.set_window((uint16_t)std::min(m_rcv_wnd, (uint32_t)0xffff));
+	__fill_unreliable_header(urdp_header, seg.control);
 
 	//write packet chunk header
 	char* ptoHeader=buffer_cast<char*>(urdp_header.buffer())+format_size;
@@ -1030,32 +1357,70 @@ int urdp_flow::__packet_as_unreliable_and_sendout(SUnraliableSegment& seg, time3
 
 	seg.remainXmit--;
 	m_t_lasttraffic=m_t_lastsend = now;
+	if (m_path) m_path->t_lastsend=now;
 	seg.timeout=now+random(10, 30);
 
 	return (int)dataLen;
 }
 
+void urdp_flow::__schedule_unreliable(SUnraliableSegment& seg)
+{
+	//round the timeout up to its bucket so that the priority orders the
+	//segments due at about the same time
+	seg.timeout=schedule_bucket(seg.timeout);
+	m_unreliable_sheap.push_back(seg);
+	std::push_heap(m_unreliable_sheap.begin(), m_unreliable_sheap.end(), 
+		SUnraliableSegmentLater());
+}
+
+void urdp_flow::__send_due_unreliable(time32_type now)
+{
+	//the top is moved to the back by pop_heap and sent there, a segment 
+	//to be resent goes back into the heap from the back without a copy
+	while(!m_unreliable_sheap.empty()
+		&&mod_less_equal(m_unreliable_sheap.front().timeout, now))
+	{
+		std::pop_heap(m_unreliable_sheap.begin(), m_unreliable_sheap.end(), 
+			SUnraliableSegmentLater());
+		SUnraliableSegment& seg=m_unreliable_sheap.back();
+		if (seg.deadline&&mod_less(seg.deadline, now))
+		{
+			m_unreliable_sheap.pop_back();//too late to be of any use
+			continue;
+		}
+		__packet_as_unreliable_and_sendout(seg, now);
+		if (seg.remainXmit<=0)
+		{
+			m_unreliable_sheap.pop_back();
+			continue;
+		}
+		seg.timeout=schedule_bucket(seg.timeout);
+		std::push_heap(m_unreliable_sheap.begin(), m_unreliable_sheap.end(), 
+			SUnraliableSegmentLater());
+	}
+}
+
 int urdp_flow::__packet_as_reliable_and_sendout(uint32_t seq, uint8_t control, 
-												const safe_buffer* data, time32_type now) 
+												const safe_buffer* data, time32_type now,
+												std::size_t subpath) 
 {
 	BOOST_ASSERT(m_self_holder);
 
-	double remoteToLocalLostrate=(remote_to_local_lost_rate_<0.0?0.0:remote_to_local_lost_rate_);
-
 	const size_t format_size=reliable_packet_format_type::format_size();
 	packet<reliable_packet_format_type> urdp_header;
-	urdp_header.set_control(control);
-	urdp_header.set_peer_id(control==CTRL_CONNECT?m_token->flow_id:m_remote_peer_id);
-	//TODO:
-	//h.set_bandwidth_recving();
-	urdp_header.set_lostrate_recving(uint32_t(remoteToLocalLostrate/LOST_RATE_PRECISION));
-	urdp_header.set_id_for_lost_detect(id_for_lost_rate_++);
-	urdp_header.set_session_id(m_session_id);
-	urdp_header.set_window((uint16_t)std::min(m_rcv_wnd, (uint32_t)0xffff));
-	urdp_header.set_time_sending((uint16_t)scape_zero(now));
-	urdp_header.set_time_echo(m_t_recent+((uint16_t)(now)-m_t_recent_now));
-	urdp_header.set_seqno(seq);
-	urdp_header.set_ackno(m_rcv_nxt);
+	__fill_reliable_header(urdp_header, seq, control, now);
+
+	shared_layer_type* sharedLayer=m_token->shared_layer.get();
+	const endpoint_type* remoteEdp=&m_remote_endpoint;
+	if (subpath>0)
+	{
+		BOOST_ASSERT(subpath<m_subpaths.size());
+		const SSubpath& sp=m_subpaths[subpath];
+		urdp_header.set_peer_id(sp.remote_peer_id);
+		if (sp.token)
+			sharedLayer=sp.token->shared_layer.get();
+		remoteEdp=&sp.remote_endpoint;
+	}
 
 	size_t dataLen=data?data->size():0;
 	out_speed_meter_+=(format_size+dataLen);
@@ -1064,21 +1429,109 @@ int urdp_flow::__packet_as_reliable_and_sendout(uint32_t seq, uint8_t control,
 	{
 		boost::array<safe_buffer, 2> bufVec={{urdp_header.buffer(),*data}};
 		error_code ec;//FIXMEignor??
-		m_token->shared_layer->async_send_to(bufVec, m_remote_endpoint, ec);
+		sharedLayer->async_send_to(bufVec, *remoteEdp, ec);
 	}
 	else
 	{
 		error_code ec;//FIXMEignor??
-		m_token->shared_layer->async_send_to(urdp_header.buffer(), 
-			m_remote_endpoint, ec);
+		sharedLayer->async_send_to(urdp_header.buffer(), *remoteEdp, ec);
 	}
 
 	m_lastack = m_rcv_nxt;
 	m_t_ack = 0;//we have ACK remote
+	m_ack_pending = 0;
 	m_t_lasttraffic=m_t_lastsend = now;
+	if (m_path&&subpath==0) m_path->t_lastsend=now;
 	return dataLen;
 }
 
+void urdp_flow::__fill_reliable_header(packet<reliable_packet_format_type>& urdp_header,
+									   uint32_t seq, uint8_t control, time32_type now)
+{
+	double remoteToLocalLostrate=(remote_to_local_lost_rate_<0.0?0.0:remote_to_local_lost_rate_);
+
+	urdp_header.set_control(control);
+	urdp_header.set_peer_id(control==CTRL_CONNECT?m_token->flow_id:m_remote_peer_id);
+	//TODO:
+	//h.set_bandwidth_recving();
+	if (control==CTRL_CONNECT||control==CTRL_CONNECT_ACK)
+	{
+		uint16_t options=SYN_OPT_PMTU_PROBE|SYN_OPT_WINDOW_SCALE
+			|(RCV_WINDOW_SHIFT<<SYN_OPT_WINDOW_SHIFT_OFFSET)|SYN_OPT_FEC
+			|SYN_OPT_MIGRATION|SYN_OPT_ACK_FREQUENCY|SYN_OPT_MULTIPATH;
+		if (control==CTRL_CONNECT&&m_session_resumption)
+			options|=SYN_OPT_RESUME;
+		if (control==CTRL_CONNECT&&b_resuming_)
+			options|=SYN_OPT_EARLY_DATA;
+		urdp_header.set_bandwidth_recving(options);
+	}
+	else if (control==CTRL_DATA&&(m_remote_syn_options&SYN_OPT_ACK_FREQUENCY))
+	{
+		urdp_header.set_bandwidth_recving(__ack_frequency_request());
+	}
+	urdp_header.set_lostrate_recving(uint32_t(remoteToLocalLostrate/LOST_RATE_PRECISION));
+	urdp_header.set_id_for_lost_detect(id_for_lost_rate_++);
+	urdp_header.set_session_id(m_session_id);
+	urdp_header.set_window(__advertised_window(control));
+	urdp_header.set_time_sending((uint16_t)scape_zero(now));
+	urdp_header.set_time_echo(m_t_recent+((uint16_t)(now)-m_t_recent_now));
+	urdp_header.set_seqno(seq);
+	urdp_header.set_ackno(m_rcv_nxt);
+}
+
+uint32_t urdp_flow::__ack_frequency_packets()const
+{
+	if (!(m_remote_syn_options&SYN_OPT_ACK_FREQUENCY))
+		return ACK_FREQUENCY_DEFAULT;
+	return bound<uint32_t>(ACK_FREQUENCY_DEFAULT, 
+		m_cwnd/(m_mss*ACK_FREQUENCY_PER_WINDOW), ACK_FREQUENCY_MAX);
+}
+
+uint16_t urdp_flow::__ack_frequency_request()const
+{
+	//a few ACKs for every window of data are enough to clock it, but not
+	//later than a quarter of rtt
+	uint32_t packets=__ack_frequency_packets();
+	time32_type delay=(m_srtt>0)?bound(MIN_CLOCK_CHECK_TIME, m_srtt>>2, ACK_DELAY):ACK_DELAY;
+	uint32_t delayUnits=(delay+ACK_FREQUENCY_DELAY_UNIT-1)/ACK_FREQUENCY_DELAY_UNIT;
+	return (uint16_t)((delayUnits<<8)|packets);
+}
+
+void urdp_flow::__on_ack_frequency(uint16_t request)
+{
+	if (request==0)
+		return;
+	m_ack_frequency=bound<uint32_t>(1, request&0xff, ACK_FREQUENCY_MAX);
+	m_ack_delay=bound<time32_type>(MIN_CLOCK_CHECK_TIME, 
+		(request>>8)*ACK_FREQUENCY_DELAY_UNIT, ACK_DELAY);
+}
+
+void urdp_flow::__on_syn_options(uint16_t options)
+{
+	m_remote_syn_options=options;
+	if (options&SYN_OPT_WINDOW_SCALE)
+	{
+		m_snd_wscale=(uint8_t)std::min<int>(MAX_WINDOW_SHIFT, 
+			(options&SYN_OPT_WINDOW_SHIFT_MASK)>>SYN_OPT_WINDOW_SHIFT_OFFSET);
+		m_rcv_wscale=RCV_WINDOW_SHIFT;
+	}
+}
+
+uint16_t urdp_flow::__advertised_window(uint8_t control)const
+{
+	uint32_t wnd=m_rcv_wnd;
+	if (control!=CTRL_CONNECT&&control!=CTRL_CONNECT_ACK)
+		wnd>>=m_rcv_wscale;
+	return (uint16_t)std::min(wnd, (uint32_t)0xffff);
+}
+
+uint32_t urdp_flow::__remote_window(uint32_t window, uint8_t control)const
+{
+	if (control==CTRL_CONNECT||control==CTRL_CONNECT_ACK)
+		return window;
+	return window<<m_snd_wscale;
+}
+
 bool urdp_flow::__clock_check(time32_type now, long& nTimeout) 
 {
 	if (m_state == CLOSED)
@@ -1090,15 +1543,23 @@ bool urdp_flow::__clock_check(time32_type now, long& nTimeout)
 	if (m_t_close_base)
 		nTimeout = std::min(nTimeout, mod_minus(*m_t_close_base, now));
 	if (m_t_ack)
-		nTimeout = std::min(nTimeout, mod_minus(m_t_ack + ACK_DELAY, now));
+		nTimeout = std::min(nTimeout, mod_minus(m_t_ack + m_ack_delay, now));
 	if (m_t_rto_base) 
 		nTimeout = std::min(nTimeout, mod_minus(m_t_rto_base + m_rto, now));
 	if (m_snd_wnd == 0)
 		nTimeout = std::min(nTimeout, mod_minus(m_t_lastsend + m_rto, now));
 	if (m_state >= ESTABLISHED&&m_slist.empty()&&m_retrans_slist.empty())
-		nTimeout = std::min(nTimeout, mod_minus(m_t_lasttraffic + m_ping_interval, now));
-	if(!m_unreliable_slist.empty())
-		nTimeout = std::min(nTimeout, mod_minus(m_unreliable_slist.begin()->timeout, now));
+		nTimeout = std::min(nTimeout, mod_minus(__ping_base_time(now) + m_ping_interval, now));
+	if(!m_unreliable_sheap.empty())
+		nTimeout = std::min(nTimeout, mod_minus(m_unreliable_sheap.front().timeout, now));
+	if (m_t_fec_flush)
+		nTimeout = std::min(nTimeout, mod_minus(m_t_fec_flush, now));
+	if (m_t_pmtu)
+		nTimeout = std::min(nTimeout, mod_minus(m_t_pmtu, now));
+	if (m_t_path_challenge)
+		nTimeout = std::min(nTimeout, mod_minus(m_t_path_challenge, now));
+	if (m_t_subpath)
+		nTimeout = std::min(nTimeout, mod_minus(m_t_subpath, now));
 
 	long lastCheckElapsed=mod_minus(now, m_t_last_on_clock);
 	BOOST_ASSERT(lastCheckElapsed>=0);
@@ -1138,6 +1599,8 @@ void urdp_flow::__calculate_local_to_remote_lost_rate(
 		double newRate=(oldRate*(1.0-a)+lostRate*a);
 		set_global_local_to_remote_lost_rate(oldRate*0.125+newRate*0.875);
 	}
+	if (m_path)
+		m_path->lost_rate(local_to_remote_lost_rate_);
 }
 
 bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from) 
@@ -1161,14 +1624,20 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 		//check session_id and remote_endpoint
 		if (m_state>=SYN_SENT)
 		{
-			if (urdp_header.get_session_id()!= m_session_id
-				||(m_state>=ESTABLISHED&&m_remote_endpoint!=from)
-				) 
+			if (urdp_header.get_session_id()!= m_session_id) 
 				return false;
+			//the remote may have moved, dropped without RST otherwise
+			if (m_state>=ESTABLISHED&&m_remote_endpoint!=from
+				&&!__path_on_moved_packet(sbuf, from, now)
+				)
+			{
+				return true;
+			}
 		}
 
 		m_t_lasttraffic = m_t_lastrecv = now;
-		m_snd_wnd = urdp_header.get_window();
+		if (m_path) m_path->t_lastrecv=now;
+		m_snd_wnd = __remote_window(urdp_header.get_window(), urdp_header.get_control());
 		in_speed_meter_+=sbuf.length();
 
 		//calculate lost rate
@@ -1187,15 +1656,27 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 				safe_buffer_io sbio(&pkt);
 				uint16_t id;
 				sbio>>id;
-				if (CTRL_UNRELIABLE_DATA==ctrlType||m_unreliable_rkeeper.try_keep(id, seconds(8)))
+				if (__keep_unreliable(pkt, id, (uint8_t)ctrlType, now))
 				{
-					m_unreliable_rlist.push_back(pkt);
+					if (!m_fec_rparity.empty())
+						__fec_try_recover(now);
 					__allert_readable();
 				}
 				return true;
 			}
 			return false;
 		}
+		else if (CTRL_FEC_PARITY==ctrlType)
+		{
+			if (sbuf.size()>unreliable_format_size+FEC_PARITY_HEADER_SIZE
+				&&m_socket&&ESTABLISHED==m_state)
+			{
+				if (__fec_on_parity(sbuf.buffer_ref(unreliable_format_size), now))
+					__allert_readable();
+				return true;
+			}
+			return false;
+		}
 	}while(0);
 
 	if (sbuf.length()<reliable_packet_format_type::format_size())
@@ -1240,24 +1721,53 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 
 			m_remote_peer_id=urdp_header.get_peer_id();
 			m_session_id=urdp_header.get_session_id();
+			__on_syn_options((uint16_t)urdp_header.get_bandwidth_recving());
 			m_lastack=m_rcv_nxt=seqno+rcvdDataLen;
 			m_remote_endpoint=from;
+			__attach_path(now);
 			m_t_recent =urdp_header.get_time_sending();
 			m_t_recent_now=now;
 			m_t_lasttraffic = m_t_lastrecv = now;
+			if (m_path) m_path->t_lastrecv=now;
+
+			//a ticket that has not been used lets the data behind CONNECT
+			//in at once, a replayed CONNECT has to finish the handshake
+			acceptor_sptr acc(m_acceptor.lock());
+			bool resumed=false;
+			if ((m_remote_syn_options&SYN_OPT_EARLY_DATA)
+				&&rcvdDataLen>=RESUME_TICKET_SIZE&&acc
+				)
+			{
+				const char* pTicket=data+rcvdDataLen-RESUME_TICKET_SIZE;
+				resumed=acc->redeem_resume_ticket(read_uint64_ntoh(pTicket));
+			}
 
-			//send ACK imediatelly
-			char myPeerID[4];
+			//send ACK imediatelly, with a new ticket if it is asked for
+			char myPeerID[4+RESUME_TICKET_SIZE];
 			char* pMyPeerID=myPeerID;
 			write_int32_hton(m_token->flow_id, pMyPeerID);
-			__queue(myPeerID, 4, CTRL_CONNECT_ACK);
+			if ((m_remote_syn_options&SYN_OPT_RESUME)&&acc)
+			{
+				uint64_t ticket=acc->issue_resume_ticket();
+				if (ticket)
+					write_uint64_hton(ticket, pMyPeerID);
+			}
+			__queue(myPeerID, pMyPeerID-myPeerID, CTRL_CONNECT_ACK);
+			if (resumed)
+			{
+				b_session_resumed_=true;
+				m_state=ESTABLISHED;
+				__pmtu_start(now);
+			}
 			__attempt_send(sfImmediateAck);
 			__schedule_timer(now);
+			if (resumed)
+				__allert_accepted();
 		}
 		return true;
 
 	case CTRL_CONNECT_ACK:
-		if (m_state == SYN_SENT) 
+		if (m_state == SYN_SENT||b_resuming_) 
 		{
 			if (urdp_header.get_session_id()!=m_session_id)
 				return false;
@@ -1265,7 +1775,24 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 				return false;
 			//const char* pHisPeerID=data;
 			m_remote_peer_id=read_uint32_ntoh(data);
+			__on_syn_options((uint16_t)urdp_header.get_bandwidth_recving());
+			m_resume_ticket=0;
+			if (m_session_resumption&&rcvdDataLen>=4+RESUME_TICKET_SIZE)
+			{
+				m_resume_ticket=read_uint64_ntoh(data);
+				m_t_resume_ticket=now;
+				__keep_resume_ticket(false);
+			}
+			if (b_resuming_)
+			{
+				b_resuming_=false;
+				__pmtu_start(now);
+				m_lastack=m_rcv_nxt=seqno;
+				shouldImediateAck=true;
+				break;
+			}
 			m_state = ESTABLISHED;
+			__pmtu_start(now);
 			m_lastack=m_rcv_nxt=seqno;
 			notifyConnected=true;// !!
 			shouldImediateAck=true;
@@ -1274,7 +1801,9 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 
 	case CTRL_PUNCH:
 		m_remote_endpoint=from;
+		__attach_path(now);
 		m_t_lasttraffic = m_t_lastrecv = now;
+		if (m_path) m_path->t_lastrecv=now;
 		if (m_retrans_slist.size()==1)//must be request pkt
 		{
 			SSegment& seg=m_retrans_slist.front();
@@ -1301,7 +1830,40 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 		__allert_disconnected(error_code());
 		return true;
 
+	case CTRL_PMTU_PROBE:
+		//the active side may probe before our SYN_RCVD has been acked
+		if (m_state==SYN_RCVD||m_state==ESTABLISHED)
+			__pmtu_on_probe(data, rcvdDataLen, len, now);
+		return true;
+
+	case CTRL_PMTU_PROBE_ACK:
+		if (m_state==ESTABLISHED)
+			__pmtu_on_probe_ack(data, rcvdDataLen, now);
+		return true;
+
+	case CTRL_PATH_CHALLENGE:
+		if (m_state==ESTABLISHED)
+			__path_on_challenge(data, rcvdDataLen, from, now);
+		return true;
+
+	case CTRL_PATH_RESPONSE:
+		//the probed endpoint is the one in use already
+		return true;
+
+	case CTRL_PATH_JOIN:
+		//a path joins from another endpoint than the one connected by
+		return true;
+
+	case CTRL_PATH_JOIN_ACK:
+		if (m_state==ESTABLISHED)
+			__subpath_on_join_ack(data, rcvdDataLen, now);
+		return true;
+
 	case CTRL_DATA:
+		if (m_remote_syn_options&SYN_OPT_ACK_FREQUENCY)
+			__on_ack_frequency((uint16_t)urdp_header.get_bandwidth_recving());
+		break;
+
 	case CTRL_ACK:
 		break;
 
@@ -1310,12 +1872,17 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 		break;
 	}
 
-	if (m_state>=SYN_SENT)
+	//the sequence of the remote is unknown before CONNECT_ACK
+	if (b_resuming_)
+		return true;
+
+	if (m_state>=SYN_SENT&&m_state<ESTABLISHED)
 	{
 		if (m_remote_endpoint!=from)
 			return false;//drop it
 	}
 	m_t_lasttraffic = m_t_lastrecv = now;
+	if (m_path) m_path->t_lastrecv=now;
 
 	// Update timestamp //seqno<=ACK<seq+dataLen
 	if (mod_less_equal(seqno, m_lastack) 
@@ -1337,10 +1904,14 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 			__updata_rtt(rtt);
 		}
 
-		m_snd_wnd = urdp_header.get_window();
+		m_snd_wnd = __remote_window(urdp_header.get_window(), urdp_header.get_control());
 		uint32_t nAcked =mod_minus(ackno, m_snd_una);
 		m_snd_una = ackno;
 		m_slen -= nAcked;
+		// If we make room in the _send queue, let the connection check
+		// its low watermark
+		if (nAcked>0 && m_detect_writable)
+			notifyWritable=true;
 		BOOST_ASSERT(mod_less_equal(m_snd_una, m_snd_nxt));
 		if (m_snd_una == m_snd_nxt)
 			m_t_rto_base=0;
@@ -1349,22 +1920,36 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 
 		//printf("acked:------------------------------------------:%d\n", m_snd_una);
 
+		//the newest segment acked at once gives the rtt of its path
+		std::size_t rttSubpath=m_subpaths.size();
+		time32_type subpathRtt=0;
 		while (!m_retrans_slist.empty())
 		{
 			long eraseLen=mod_minus(m_snd_una, m_retrans_slist.front().seq);
 			BOOST_ASSERT(eraseLen>=0);
 			if (eraseLen>0)
+			{
+				const SSegment& seg=m_retrans_slist.front();
+				if (!m_subpaths.empty()&&seg.xmit==1)
+				{
+					__subpath_on_acked(seg.subpath);
+					rttSubpath=seg.subpath;
+					subpathRtt=mod_minus(now, seg.t_sent);
+				}
 				m_retrans_slist.pop_front();
+			}
 			else
 				break;
 		}
+		if (rttSubpath<m_subpaths.size())
+			__subpath_on_rtt(rttSubpath, subpathRtt);
 		if (m_retrans_slist.empty())
 			m_t_rto_base=0;
 
 		BOOST_ASSERT(m_retrans_slist.empty()||m_retrans_slist.front().seq==m_snd_una);
 
 		//fast retrans & fast recover
-		if (m_dup_acks >= 3) 
+		if (m_dup_acks >= __dup_ack_threshold()) 
 		{
 			if (m_snd_una >= m_recover) 
 			{ 
@@ -1388,24 +1973,31 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 		} 
 		else 
 		{
-			// Slow start, congestion avoidance
+			// Slow start, congestion avoidance. an ACK stands for 
+			// ACK_FREQUENCY_DEFAULT packets, the remote may ACK less often.
+			// the growth of one ACK is limited to what the ACKs we ask
+			// for may cover (RFC 3465), a stretch ACK does not burst cwnd.
 			m_dup_acks = 0;
+			uint32_t growth=std::min(std::max(m_mss, nAcked/ACK_FREQUENCY_DEFAULT),
+				m_mss*__ack_frequency_packets()/ACK_FREQUENCY_DEFAULT);
 			if (m_cwnd < m_ssthresh)
-				m_cwnd += m_mss;
+				m_cwnd += growth;
 			else
-				m_cwnd += (uint32_t)std::max((uint64_t)1, (uint64_t)m_mss*(uint64_t)m_mss/m_cwnd);
+				m_cwnd += (uint32_t)std::max((uint64_t)1, (uint64_t)m_mss*(uint64_t)growth/m_cwnd);
+			m_cwnd=std::min(m_cwnd, (uint32_t)MAX_BUF_SIZE);
 		}
 
 		if ((m_state == SYN_RCVD) && !bConnect) 
 		{
 			m_state = ESTABLISHED;
 			notifyAccepet=true;
+			__pmtu_start(now);
 		}
 	} 
 	else if (ackno== m_snd_una) //!(m_snd_una<h.ackno<=m_snd_nxt)
 	{
 		// !?! Note, tcp says don't do this... but otherwise how does a closed window become open?
-		m_snd_wnd =urdp_header.get_window();
+		m_snd_wnd =__remote_window(urdp_header.get_window(), urdp_header.get_control());
 
 		// Check duplicate acks
 		if (rcvdDataLen > 0) 
@@ -1415,8 +2007,8 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 		else if (m_snd_una != m_snd_nxt) 
 		{
 			++m_dup_acks;
-			//3 duplicate ACKs
-			if (m_dup_acks == 3) 
+			//3 duplicate ACKs, more if the segments go by several paths
+			if (m_dup_acks == __dup_ack_threshold()) 
 			{ 
 				uint32_t nInFlight =mod_minus(m_snd_nxt, m_snd_una);
 				m_ssthresh = std::max((nInFlight*3)/4, 3*m_mss);//m_ssthresh = std::max(nInFlight / 2, 2 * m_mss);
@@ -1428,7 +2020,7 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 					return true;
 				}
 			} 
-			else if (m_dup_acks > 3)
+			else if (m_dup_acks > __dup_ack_threshold())
 			{
 				//(Fast Recover)
 				m_cwnd += m_mss;
@@ -1450,7 +2042,10 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 	if (seqno != m_rcv_nxt||shouldImediateAck)
 		sflags = sfImmediateAck; // (Fast Recovery)
 	else if (rcvdDataLen != 0)
+	{
 		sflags = sfDelayedAck;
+		++m_ack_pending;
+	}
 
 	// Adjust the incoming segment to fit our receive buffer
 	if (seqno < m_rcv_nxt) 
@@ -1471,7 +2066,7 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 
 	if (!m_rlist.empty())
 	{
-		if (mod_minus(seqno+rcvdDataLen, m_rcv_nxt)>=RECV_BUF_SIZE)
+		if (mod_minus(seqno+rcvdDataLen, m_rcv_nxt)>=(long)m_rcv_buf_size)
 			rcvdDataLen=0;
 	}
 
@@ -1492,8 +2087,18 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 			//std::cout<<" seqno------:"<< seqno<<"   m_rcv_nxt:"<<m_rcv_nxt<<std::endl;
 			RSegment rseg;
 			rseg.seq=seqno;
-			safe_buffer_io io(&(rseg.buf));
-			io.write(data, rcvdDataLen);
+			//in scatter delivery a segment filling most of its datagram 
+			//keeps it, a small one is copied not to hold a large buffer
+			if (m_scatter_delivery&&sbuf.capacity()<=2*sbuf.size())
+			{
+				rseg.buf=sbuf.buffer_ref(data-buffer_cast<const char*>(sbuf), 
+					rcvdDataLen);
+			}
+			else
+			{
+				safe_buffer_io io(&(rseg.buf));
+				io.write(data, rcvdDataLen);
+			}
 			std::pair<RSegmentList::iterator, bool >insertRst=m_rlist.insert(rseg);
 
 			/*		if (m_rlist.size()>15)
@@ -1530,6 +2135,9 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 					}
 					++it;
 				}
+				//a hole is filled, let the sender leave recovery at once
+				if (mod_less(seqno+rcvdDataLen, m_rcv_nxt))
+					sflags = sfImmediateAck;
 			} 
 		}
 	}
@@ -1547,7 +2155,8 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 	__attempt_send(sflags);
 
 	// If we have new data, notify the user
-	if (bNewData && m_detect_readable) {
+	//the data that comes before the handshake ends waits for the socket
+	if (bNewData && m_detect_readable && m_socket) {
 		//m_detect_readable = false;
 		notifyReadable=true;
 		/*	if (m_connection) {
@@ -1555,19 +2164,6 @@ bool urdp_flow::__process(const safe_buffer& sbuf, const endpoint_type& from)
 		}*/
 		//notify(evRead);
 	}
-	// If we make room in the _send queue, notify the user
-	// The goal it to make sure we always have at least enough data to fill the
-	// window. We'd like to notify the app when we are halfway to that point.
-	const uint32_t kIdealRefillSize = (SND_BUF_SIZE + RECV_BUF_SIZE) / 2;
-	if (m_detect_writable && (m_slen < kIdealRefillSize)) 
-	{
-		//m_detect_writable = false;
-		notifyWritable=true;
-		//if (m_connection)
-		//	m_connection->on_writeable(this);
-		//notify(evWrite);
-	}
-
 	if (notifyConnected)
 	{
 		__allert_connected(error_code());
@@ -1661,11 +2257,8 @@ void urdp_flow::__allert_writeable()
 		return;
 	}
 
-	if (m_slen<SND_BUF_SIZE)
-	{
-		m_detect_writable=false;
-		m_socket->on_writeable();
-	}
+	m_detect_writable=(m_slen+m_stream_qlen>0);
+	m_socket->on_writeable();
 }
 
 void urdp_flow::__allert_accepted()
@@ -1701,6 +2294,17 @@ void urdp_flow::__allert_received(const safe_buffer& buf)
 	m_socket->on_received(buf);
 }
 
+void urdp_flow::__allert_received(const safe_buffer_chain& bufs)
+{
+	if (!m_socket||is_canceled_op(this->op_stamp()))
+	{
+		__close(true);
+		return;
+	}
+
+	m_socket->on_received(bufs);
+}
+
 void urdp_flow::__updata_rtt(long rtt)
 {
 	if (rtt >= 0) 
@@ -1717,6 +2321,8 @@ void urdp_flow::__updata_rtt(long rtt)
 			m_srtt = ((7 * m_srtt + rtt)>>3); // (7 * m_srtt + rtt)/ 8;
 		}
 		m_rto = bound(MIN_RTO, m_srtt + std::max((time32_type)1, m_rttvar<<2), MAX_RTO);
+		if (m_path)
+			m_path->update_rtt((time32_type)rtt);
 #if 0
 		//std::cout<<"cwnd: "<<m_cwnd 
 		<< ", rtt: " << rtt
@@ -1732,6 +2338,120 @@ void urdp_flow::__updata_rtt(long rtt)
 }
 
 
+void urdp_flow::__attach_path(time32_type now)
+{
+	if (!m_token
+		||m_path&&endpoint_type(m_path->remote_endpoint)==m_remote_endpoint
+		)
+	{
+		return;
+	}
+	m_path=m_token->shared_layer->path_to(m_remote_endpoint, now);
+
+	//start from what the other flows to this endpoint have learned
+	int32_t pathSrtt, pathRttvar;
+	m_path->rtt(pathSrtt, pathRttvar);
+	if (m_srtt==0&&pathSrtt>0)
+	{
+		m_srtt=pathSrtt;
+		m_rttvar=pathRttvar;
+		m_rto = bound(MIN_RTO, m_srtt + std::max((time32_type)1, m_rttvar<<2), MAX_RTO);
+	}
+	double pathLostRate=m_path->lost_rate();
+	if (local_to_remote_lost_rate_<0&&pathLostRate>=0)
+		local_to_remote_lost_rate_=pathLostRate;
+}
+
+bool urdp_flow::__take_resume_ticket(time32_type now)
+{
+	fast_mutex::scoped_lock lock(s_resume_tickets_mutex);
+
+	ResumeTicketMap::iterator itr=s_resume_tickets.find(
+		ResumeTicketKey(m_remote_endpoint, m_resume_domain));
+	if (itr==s_resume_tickets.end())
+		return false;
+	SResumeTicket resume=itr->second;
+	s_resume_tickets.erase(itr);//a ticket is used once
+	if (mod_minus(now, resume.time)>=RESUME_TICKET_LIFETIME-DEFAULT_TIMEOUT)
+		return false;//the remote has forgotten it
+
+	m_resume_ticket=resume.ticket;
+	m_resume_pmtu=resume.pmtu;
+	if (m_srtt==0&&resume.srtt>0)
+	{
+		m_srtt=resume.srtt;
+		m_rttvar=resume.rttvar;
+		m_rto = bound(MIN_RTO, m_srtt + std::max((time32_type)1, m_rttvar<<2), MAX_RTO);
+	}
+	//the path may have changed since, start from half of the last cwnd
+	m_cwnd=std::max(m_cwnd, resume.cwnd/2);
+	return true;
+}
+
+void urdp_flow::__keep_resume_ticket(bool refreshOnly)
+{
+	fast_mutex::scoped_lock lock(s_resume_tickets_mutex);
+
+	ResumeTicketKey key(m_remote_endpoint, m_resume_domain);
+	ResumeTicketMap::iterator itr=s_resume_tickets.find(key);
+	if (refreshOnly)
+	{
+		//it may have been used by another flow
+		if (itr==s_resume_tickets.end()||itr->second.ticket!=m_resume_ticket)
+			return;
+	}
+	else if (itr==s_resume_tickets.end())
+	{
+		if (s_resume_tickets.size()>=RESUME_TICKET_CACHE_SIZE)
+			s_resume_tickets.erase(s_resume_tickets.begin());
+		itr=s_resume_tickets.insert(std::make_pair(key, SResumeTicket())).first;
+	}
+	SResumeTicket& resume=itr->second;
+	if (!refreshOnly)
+	{
+		resume.ticket=m_resume_ticket;
+		resume.time=m_t_resume_ticket;
+	}
+	resume.srtt=m_srtt;
+	resume.rttvar=m_rttvar;
+	resume.cwnd=m_cwnd;
+	resume.pmtu=(m_pmtu_state==PMTU_DISABLED?0:m_pmtu);
+}
+
+urdp_flow::time32_type urdp_flow::__ping_base_time(time32_type now)const
+{
+	//the active side pings, the passive side only pings when the active 
+	//side keeps silent. any flow to the same endpoint keeps the path alive,
+	//so a flow only pings for itself when it has heard nothing for IDLE_PING.
+	time32_type baseTime=(b_active_?m_t_lastsend:(m_t_lastrecv+5000));
+	if (m_path&&mod_minus(now, m_t_lastrecv)<IDLE_PING)
+	{
+		time32_type pathBaseTime=m_path->t_lastsend;
+		time32_type pathLastRecv=m_path->t_lastrecv;
+		if (!b_active_&&mod_less(pathBaseTime, pathLastRecv+5000))
+			pathBaseTime=pathLastRecv+5000;
+		if (mod_less(baseTime, pathBaseTime))
+			baseTime=pathBaseTime;
+	}
+	return baseTime;
+}
+
+urdp_flow::time32_type urdp_flow::__idle_deadline()const
+{
+	time32_type lastRecv=m_t_lastrecv;
+	time32_type pathLastRecv=(m_path?(time32_type)m_path->t_lastrecv:lastRecv);
+	if (mod_less(lastRecv, pathLastRecv))
+	{
+		//the remote endpoint is alive, but after IDLE_PING this flow has to
+		//get an answer to its own ping in time
+		if (mod_less(pathLastRecv, m_t_lastrecv+IDLE_PING))
+			lastRecv=pathLastRecv;
+		else
+			lastRecv=m_t_lastrecv+IDLE_PING;
+	}
+	return lastRecv+m_ping_interval+DEFAULT_TIMEOUT;
+}
+
 bool urdp_flow::__transmit(const SSegmentList::iterator& itr, time32_type now)
 {
 	BOOST_ASSERT(!m_slist.empty()||!m_retrans_slist.empty());
@@ -1746,9 +2466,20 @@ bool urdp_flow::__transmit(const SSegmentList::iterator& itr, time32_type now)
 	}
 
 	BOOST_ASSERT(seg.buf.size()<=m_mss);
-	__packet_as_reliable_and_sendout(seg.seq, seg.ctrlType, &seg.buf, now);
+	std::size_t subpath=0;
+	if (!m_subpaths.empty())
+	{
+		//a segment sent again is taken as lost on its path and goes by
+		//the best one
+		if (seg.xmit>0)
+			__subpath_on_lost(seg.subpath);
+		subpath=(seg.xmit>0)?__best_subpath():__select_subpath();
+	}
+	__packet_as_reliable_and_sendout(seg.seq, seg.ctrlType, &seg.buf, now, subpath);
 	if (m_state<ESTABLISHED&&seg.xmit<=1)//try resend fast
 		__packet_as_reliable_and_sendout(seg.seq, seg.ctrlType, &seg.buf, now);
+	seg.subpath=(uint8_t)subpath;
+	seg.t_sent=now;
 
 	if (seg.xmit == 0) 
 		m_snd_nxt += seg.buf.size();
@@ -1778,6 +2509,12 @@ void urdp_flow::__attempt_send(SendFlags sflags)
 		uint32_t nInFlight =mod_minus(m_snd_nxt, m_snd_una);
 		uint32_t nUseable = (nInFlight < nWindow) ? (nWindow - nInFlight) : 0;
 
+		//take the next messages from the streams only when the window can
+		//send them, what waits in the streams can still be reordered
+		uint32_t nUnsent = m_slen - nInFlight;
+		if (m_stream_qlen > 0 && nUnsent < nUseable)
+			__fill_from_streams(nUseable - nUnsent);
+
 		uint32_t nAvailable = std::min(m_slen - nInFlight, m_mss);
 
 		if (nAvailable > nUseable) 
@@ -1789,13 +2526,16 @@ void urdp_flow::__attempt_send(SendFlags sflags)
 		}
 
 		bool immediateAck=(nAvailable == 0||mod_less(m_snd_una, m_snd_nxt) && (nAvailable < m_mss));
-		if (m_slist.empty()) 
+		if (m_slist.empty()||nAvailable == 0) 
 		{
-			// If this is an immediate ack, or the second delayed ack
-			if ((sflags == sfImmediateAck) || immediateAck&&m_t_ack) 
+			// If this is an immediate ack, or the delayed acks are as many
+			// as the remote asks for
+			if ((sflags == sfImmediateAck) 
+				|| immediateAck&&m_t_ack&&m_ack_pending>=m_ack_frequency
+				) 
 				__packet_as_reliable_and_sendout(m_snd_nxt, CTRL_ACK, NULL, now);
-			else if(sflags != sfNone)
-				m_t_ack = scape_zero(now);
+			else if(sflags != sfNone&&!m_t_ack)
+				m_t_ack = scape_zero(now);//counted from the first unacked one
 			return;    
 		}
 
@@ -1831,6 +2571,909 @@ void urdp_flow::__incress_rto()
 	m_rto=bound(MIN_RTO, m_rto, MAX_RTO);
 }
 
+void urdp_flow::__adjust_mtu()
+{
+	uint32_t mss=m_pmtu-(uint32_t)reliable_packet_format_type::format_size();
+	if (mss==m_mss)
+		return;
+	bool shrink=mss<m_mss;
+	m_mss=mss;
+	if (shrink)
+	{
+		__resegment(m_retrans_slist);
+		__resegment(m_slist);
+	}
+	m_cwnd=std::max(m_cwnd, 2*m_mss);
+}
+
+void urdp_flow::__resegment(SSegmentList& slist)
+{
+	//split the segments bigger than m_mss, the pieces keep seq and xmit so
+	//that the receiver just sees the same bytes in smaller packets. they 
+	//also keep the path and the time the bytes were sent last, for the 
+	//rtt and loss samples their acks give.
+	SSegmentList segs;
+	for (SSegmentList::iterator itr=slist.begin(); itr!=slist.end(); ++itr)
+	{
+		const SSegment& seg=*itr;
+		if (seg.buf.size()<=m_mss)
+		{
+			segs.push_back(seg);
+			continue;
+		}
+		const char* p=buffer_cast<const char*>(seg.buf);
+		for (std::size_t offset=0; offset<seg.buf.size(); offset+=m_mss)
+		{
+			std::size_t len=std::min<std::size_t>(m_mss, seg.buf.size()-offset);
+			SSegment piece(seg.seq+(uint32_t)offset, seg.ctrlType);
+			piece.xmit=seg.xmit;
+			piece.subpath=seg.subpath;
+			piece.t_sent=seg.t_sent;
+			safe_buffer_io io(&piece.buf);
+			io.write(p+offset, len);
+			segs.push_back(piece);
+		}
+	}
+	slist.swap(segs);
+}
+
+uint32_t urdp_flow::__pmtu_ceiling()
+{
+	const address& addr=m_remote_endpoint.address();
+	error_code ec;
+	int mtu=network_topology_service::get(get_io_service()).mtu_to(addr, ec);
+	if (mtu<=0)
+		mtu=1500;//ethernet
+	uint32_t overhead=(uint32_t)(addr.is_v6()?IPV6_UDP_HEADER_SIZE:IPV4_UDP_HEADER_SIZE)
+		+(uint32_t)shared_layer_type::datagram_overhead;
+	uint32_t ceiling=((uint32_t)mtu>overhead)?(uint32_t)mtu-overhead:0;
+	ceiling=std::min(ceiling, (uint32_t)MAX_UDP_PAYLOAD_SIZE
+		-(uint32_t)shared_layer_type::datagram_overhead);
+	return std::max(ceiling, PMTU_BASE);
+}
+
+void urdp_flow::__pmtu_start(time32_type now)
+{
+	//an old peer does not answer probes, keep the fixed MTU_SIZE
+	if (m_pmtu_state!=PMTU_DISABLED||!(m_remote_syn_options&SYN_OPT_PMTU_PROBE))
+		return;
+	m_pmtu=PMTU_BASE;
+	//a resumed session starts from the path mtu found last time, a black
+	//hole sends it back to PMTU_BASE
+	if (m_resume_pmtu>PMTU_BASE&&m_resume_pmtu<=__pmtu_ceiling())
+		m_pmtu=m_resume_pmtu;
+	__adjust_mtu();
+	__pmtu_search(m_pmtu, now);
+}
+
+void urdp_flow::__pmtu_search(uint32_t low, time32_type now)
+{
+	m_pmtu_state=PMTU_SEARCHING;
+	m_pmtu_low=low;
+	m_pmtu_high=__pmtu_ceiling();
+	m_pmtu_probe_size=0;
+	m_pmtu_retry_size=0;
+	m_pmtu_probe_count=0;
+	//most paths are as wide as the local link, try it first
+	if (m_pmtu_high>=m_pmtu_low+PMTU_SEARCH_GRANULARITY)
+		__pmtu_send_probe(m_pmtu_high, now);
+	else
+		__pmtu_next_probe(now);
+}
+
+void urdp_flow::__pmtu_next_probe(time32_type now)
+{
+	BOOST_ASSERT(m_pmtu_state==PMTU_SEARCHING);
+	m_pmtu_probe_size=0;
+	m_pmtu_retry_size=0;
+	m_pmtu_probe_count=0;
+	if (m_pmtu_high<m_pmtu_low+PMTU_SEARCH_GRANULARITY)
+	{
+		m_pmtu_state=PMTU_SEARCH_COMPLETE;
+		m_t_pmtu=scape_zero(now+PMTU_RAISE_TIMER);
+		return;
+	}
+	__pmtu_send_probe((m_pmtu_low+m_pmtu_high+1)/2, now);
+}
+
+void urdp_flow::__pmtu_send_probe(uint32_t size, time32_type now)
+{
+	const uint32_t format_size=(uint32_t)reliable_packet_format_type::format_size();
+	BOOST_ASSERT(size>=format_size+2);
+
+	m_pmtu_probe_size=size;
+	packet<reliable_packet_format_type> urdp_header;
+	__fill_reliable_header(urdp_header, m_snd_nxt, CTRL_PMTU_PROBE, now);
+	safe_buffer padding(size-format_size);
+	char* p=buffer_cast<char*>(padding);
+	memset(p, 0, padding.size());
+	write_uint16_hton((uint16_t)size, p);
+
+	error_code ec;
+	m_token->shared_layer->send_probe_to(urdp_header.buffer(), padding, 
+		m_remote_endpoint, ec);
+	if (ec==asio::error::would_block||ec==asio::error::try_again)
+	{
+		//not sent, it says nothing of the size. send the same size later,
+		//the attempt is not counted
+		m_pmtu_probe_size=0;
+		m_pmtu_retry_size=size;
+		m_t_pmtu=scape_zero(now+m_rto);
+		return;
+	}
+	out_speed_meter_+=size;
+	if (ec==asio::error::message_size)
+	{
+		//bigger than the local interface allows, no need to wait
+		m_pmtu_high=size-1;
+		__pmtu_next_probe(now);
+		return;
+	}
+	m_t_pmtu=scape_zero(now+m_rto);
+}
+
+void urdp_flow::__pmtu_on_timer(time32_type now)
+{
+	m_t_pmtu=0;
+	if (m_pmtu_state==PMTU_SEARCHING)
+	{
+		if (m_pmtu_retry_size)
+		{
+			uint32_t size=m_pmtu_retry_size;
+			m_pmtu_retry_size=0;
+			__pmtu_send_probe(size, now);
+		}
+		else if (m_pmtu_probe_size==0)
+		{
+			__pmtu_next_probe(now);
+		}
+		else if (++m_pmtu_probe_count<PMTU_MAX_PROBES)
+		{
+			__pmtu_send_probe(m_pmtu_probe_size, now);
+		}
+		else
+		{
+			//no probe of this size got through
+			m_pmtu_high=m_pmtu_probe_size-1;
+			__pmtu_next_probe(now);
+		}
+	}
+	else if (m_pmtu_state==PMTU_SEARCH_COMPLETE)
+	{
+		//the path may have changed, look for a bigger size again
+		__pmtu_search(m_pmtu, now);
+	}
+}
+
+void urdp_flow::__pmtu_on_probe(const char* data, uint32_t dataLen, 
+								 uint32_t pktLen, time32_type now)
+{
+	//a truncated probe must not be taken for a good one
+	if (dataLen<2||read_uint16_ntoh(data)!=pktLen)
+		return;
+
+	char sizeBuf[2];
+	char* p=sizeBuf;
+	write_uint16_hton((uint16_t)pktLen, p);
+	safe_buffer buf;
+	safe_buffer_io io(&buf);
+	io.write(sizeBuf, sizeof(sizeBuf));
+
+	packet<reliable_packet_format_type> urdp_header;
+	__fill_reliable_header(urdp_header, m_snd_nxt, CTRL_PMTU_PROBE_ACK, now);
+	out_speed_meter_+=(reliable_packet_format_type::format_size()+buf.size());
+	boost::array<safe_buffer, 2> bufVec={{urdp_header.buffer(),buf}};
+	error_code ec;
+	m_token->shared_layer->async_send_to(bufVec, m_remote_endpoint, ec);
+}
+
+void urdp_flow::__pmtu_on_probe_ack(const char* data, uint32_t dataLen, time32_type now)
+{
+	if (dataLen<2)
+		return;
+	uint32_t size=read_uint16_ntoh(data);
+	if (m_pmtu_state!=PMTU_SEARCHING||size!=m_pmtu_probe_size)
+		return;
+	m_t_pmtu=0;
+	m_pmtu_low=size;
+	if (size>m_pmtu)
+	{
+		m_pmtu=size;
+		__adjust_mtu();
+	}
+	__pmtu_next_probe(now);
+}
+
+void urdp_flow::__pmtu_black_hole(time32_type now)
+{
+	//packets of the current size keep getting lost, go back to the base 
+	//size which every path carries and search the path again
+	m_t_pmtu=0;
+	m_pmtu=PMTU_BASE;
+	__adjust_mtu();
+	__pmtu_search(PMTU_BASE, now);
+}
+
+bool urdp_flow::__path_on_moved_packet(const safe_buffer& sbuf, 
+									   const endpoint_type& from, time32_type now)
+{
+	//return true if the packet is to be processed as if from the remote.
+	//what comes from the endpoint being probed is taken, only sending 
+	//there waits for the response.
+	if ((m_remote_syn_options&SYN_OPT_PMTU_PROBE)
+		&&from.address()==m_remote_endpoint.address()
+		&&sbuf.length()>=reliable_packet_format_type::format_size()
+		)
+	{
+		//path mtu probes are sent by a socket of their own, the ack goes
+		//to the endpoint in use
+		packet<reliable_packet_format_type> urdp_header(sbuf);
+		if (urdp_header.get_control()==CTRL_PMTU_PROBE)
+		{
+			uint32_t len=(uint32_t)sbuf.size();
+			uint32_t rcvdDataLen=len-reliable_packet_format_type::format_size();
+			const char* data=buffer_cast<char*>(sbuf)+reliable_packet_format_type::format_size();
+			__pmtu_on_probe(data, rcvdDataLen, len, now);
+			return false;
+		}
+	}
+	if (m_remote_syn_options&SYN_OPT_MULTIPATH)
+	{
+		SSubpath* sp=__find_subpath(from);
+		if (sbuf.length()<reliable_packet_format_type::format_size())
+		{
+			if (sp&&sp->validated)
+				return true;
+		}
+		else
+		{
+			packet<reliable_packet_format_type> urdp_header(sbuf);
+			uint32_t rcvdDataLen=(uint32_t)sbuf.size()-reliable_packet_format_type::format_size();
+			const char* data=buffer_cast<char*>(sbuf)+reliable_packet_format_type::format_size();
+			uint8_t control=(uint8_t)urdp_header.get_control();
+			if (control==CTRL_PATH_JOIN)
+			{
+				//only a peer that knows both sequence spaces may join
+				if (__path_in_window(urdp_header.get_seqno(), urdp_header.get_ackno()))
+					__subpath_on_join(data, rcvdDataLen, from, now);
+				return false;
+			}
+			if (sp)
+			{
+				//the joiner echoes our nonce from the joined endpoint
+				if (control==CTRL_PATH_RESPONSE)
+				{
+					if (!sp->joiner&&rcvdDataLen>=PATH_CHALLENGE_SIZE
+						&&read_uint64_ntoh(data)==sp->nonce
+						)
+					{
+						sp->validated=true;
+						sp->t_join=0;
+					}
+					return false;
+				}
+				//nothing else is taken before our nonce is echoed
+				return sp->validated;
+			}
+		}
+	}
+	if (!(m_remote_syn_options&SYN_OPT_MIGRATION))
+		return false;
+	bool probing=(m_path_challenge&&from==m_probing_endpoint);
+	if (sbuf.length()<reliable_packet_format_type::format_size())
+		return probing;
+
+	packet<reliable_packet_format_type> urdp_header(sbuf);
+	uint32_t rcvdDataLen=(uint32_t)sbuf.size()-reliable_packet_format_type::format_size();
+	const char* data=buffer_cast<char*>(sbuf)+reliable_packet_format_type::format_size();
+	switch (urdp_header.get_control())
+	{
+	case CTRL_PATH_CHALLENGE:
+		//we are the one who moved
+		__path_on_challenge(data, rcvdDataLen, from, now);
+		return false;
+
+	case CTRL_PATH_RESPONSE:
+		if (probing&&rcvdDataLen>=PATH_CHALLENGE_SIZE
+			&&read_uint64_ntoh(data)==m_path_challenge
+			)
+		{
+			__path_migrate(now);
+		}
+		return false;
+
+	case CTRL_DATA:
+	case CTRL_ACK:
+		{
+			//only a peer that knows both sequence spaces is worth probing
+			if (!__path_in_window(urdp_header.get_seqno(), urdp_header.get_ackno()))
+				return false;
+			if (!probing)
+			{
+				m_probing_endpoint=from;
+				do{
+					m_path_challenge=((uint64_t)random()<<32)|random();
+				}while(!m_path_challenge);
+				m_path_challenge_xmit=0;
+				__path_send_challenge(now);
+			}
+		}
+		return true;
+
+	default:
+		return probing;
+	}
+}
+
+bool urdp_flow::__path_in_window(uint32_t seqno, uint32_t ackno)const
+{
+	return mod_less_equal(m_snd_una, ackno)&&mod_less_equal(ackno, m_snd_nxt)
+		&&mod_less_equal(m_rcv_nxt, seqno+m_rcv_buf_size)
+		&&mod_less_equal(seqno, m_rcv_nxt+m_rcv_buf_size);
+}
+
+void urdp_flow::__path_send_challenge(time32_type now)
+{
+	char nonce[PATH_CHALLENGE_SIZE];
+	char* p=nonce;
+	write_uint64_hton(m_path_challenge, p);
+	safe_buffer buf;
+	safe_buffer_io io(&buf);
+	io.write(nonce, sizeof(nonce));
+
+	packet<reliable_packet_format_type> urdp_header;
+	__fill_reliable_header(urdp_header, m_snd_nxt, CTRL_PATH_CHALLENGE, now);
+	out_speed_meter_+=(reliable_packet_format_type::format_size()+buf.size());
+	boost::array<safe_buffer, 2> bufVec={{urdp_header.buffer(),buf}};
+	error_code ec;
+	m_token->shared_layer->async_send_to(bufVec, m_probing_endpoint, ec);
+	++m_path_challenge_xmit;
+	m_t_path_challenge=scape_zero(now+m_rto);
+}
+
+void urdp_flow::__path_on_challenge(const char* data, uint32_t dataLen, 
+									const endpoint_type& from, time32_type now)
+{
+	if (dataLen<PATH_CHALLENGE_SIZE)
+		return;
+
+	//echo it to where it came from, that is where the remote probes
+	safe_buffer buf;
+	safe_buffer_io io(&buf);
+	io.write(data, PATH_CHALLENGE_SIZE);
+
+	packet<reliable_packet_format_type> urdp_header;
+	__fill_reliable_header(urdp_header, m_snd_nxt, CTRL_PATH_RESPONSE, now);
+	out_speed_meter_+=(reliable_packet_format_type::format_size()+buf.size());
+	boost::array<safe_buffer, 2> bufVec={{urdp_header.buffer(),buf}};
+	error_code ec;
+	m_token->shared_layer->async_send_to(bufVec, from, ec);
+}
+
+void urdp_flow::__path_on_timer(time32_type now)
+{
+	m_t_path_challenge=0;
+	if (m_path_challenge_xmit<PATH_CHALLENGE_MAX_XMIT)
+		__path_send_challenge(now);
+	else
+		m_path_challenge=0;//not reachable there, stay on the current path
+}
+
+void urdp_flow::__path_migrate(time32_type now)
+{
+	bool sameHost=(m_probing_endpoint.address()==m_remote_endpoint.address());
+	m_remote_endpoint=m_probing_endpoint;
+	m_path_challenge=0;
+	m_t_path_challenge=0;
+
+	//a nat rebinding keeps the network path, another address does not:
+	//learn rtt, cwnd and path mtu again from the start
+	if (!sameHost)
+	{
+		m_srtt=m_rttvar=0;
+		m_rto=MIN_RTO;
+		m_ssthresh=MAX_BUF_SIZE;
+		m_dup_acks=0;
+		local_to_remote_lost_rate_=-1;
+	}
+	__attach_path(now);
+	if (!sameHost)
+	{
+		m_resume_pmtu=0;
+		if (m_pmtu_state!=PMTU_DISABLED)
+		{
+			m_t_pmtu=0;
+			m_pmtu_state=PMTU_DISABLED;
+			__pmtu_start(now);
+		}
+		m_cwnd=2*m_mss;
+	}
+
+	//what was sent to the old endpoint is lost, resend the oldest at once
+	if (!m_retrans_slist.empty())
+	{
+		m_t_rto_base=scape_zero(now);
+		if (!__transmit(m_retrans_slist.begin(), now))
+		{
+			__allert_disconnected(asio::error::timed_out);
+			return;
+		}
+	}
+	__attempt_send(sfImmediateAck);
+	__schedule_timer(now);
+}
+
+void urdp_flow::add_local_path(const endpoint_type& localEdp, error_code& ec)
+{
+	ec.clear();
+	if (m_state!=ESTABLISHED||!m_token)
+	{
+		ec=asio::error::not_connected;
+		return;
+	}
+	if (!(m_remote_syn_options&SYN_OPT_MULTIPATH))
+	{
+		ec=asio::error::operation_not_supported;
+		return;
+	}
+	if (m_subpaths.size()>=SUBPATH_MAX)
+	{
+		ec=asio::error::no_buffer_space;
+		return;
+	}
+	flow_token_sptr token=shared_layer_type::create_flow_token(get_io_service(), 
+		localEdp, this, 
+		boost::bind(&this_type::called_by_sharedlayer_on_recvd, this, _1, _2), 
+		ec);
+	if (ec)
+		return;
+	//a socket in use already adds nothing
+	bool inUse=(token->shared_layer==m_token->shared_layer);
+	for (std::size_t i=1;i<m_subpaths.size();++i)
+	{
+		if (m_subpaths[i].token&&m_subpaths[i].token->shared_layer==token->shared_layer)
+			inUse=true;
+	}
+	if (inUse)
+	{
+		ec=asio::error::already_open;
+		return;
+	}
+
+	if (m_subpaths.empty())
+	{
+		m_subpaths.push_back(SSubpath());
+		m_subpaths.back().validated=true;//the one connected by
+	}
+	SSubpath sp;
+	sp.token=token;
+	sp.remote_endpoint=m_remote_endpoint;
+	sp.remote_peer_id=m_remote_peer_id;
+	do{
+		sp.nonce=((uint64_t)random()<<32)|random();
+	}while(!sp.nonce);
+	sp.joiner=true;
+	m_subpaths.push_back(sp);
+	time32_type now=tick_now();
+	__subpath_send_join(m_subpaths.size()-1, now);
+	__schedule_timer(now);
+}
+
+std::size_t urdp_flow::path_count()const
+{
+	std::size_t n=0;
+	for (std::size_t i=0;i<m_subpaths.size();++i)
+	{
+		if (m_subpaths[i].validated)
+			++n;
+	}
+	return std::max<std::size_t>(n, 1);
+}
+
+std::size_t urdp_flow::__select_subpath()
+{
+	//smooth weighted round robin, the paths take turns in proportion to
+	//their weights without bursts on one of them
+	BOOST_ASSERT(!m_subpaths.empty());
+	int64_t total=0;
+	std::size_t best=0;
+	for (std::size_t i=0;i<m_subpaths.size();++i)
+	{
+		SSubpath& sp=m_subpaths[i];
+		if (!sp.validated)
+			continue;
+		int64_t weight=__subpath_weight(sp);
+		sp.weight_current+=weight;
+		total+=weight;
+		if (sp.weight_current>m_subpaths[best].weight_current)
+			best=i;
+	}
+	m_subpaths[best].weight_current-=total;
+	return best;
+}
+
+std::size_t urdp_flow::__best_subpath()const
+{
+	std::size_t best=0;
+	int64_t bestWeight=0;
+	for (std::size_t i=0;i<m_subpaths.size();++i)
+	{
+		if (!m_subpaths[i].validated)
+			continue;
+		int64_t weight=__subpath_weight(m_subpaths[i]);
+		if (weight>bestWeight)
+		{
+			best=i;
+			bestWeight=weight;
+		}
+	}
+	return best;
+}
+
+int64_t urdp_flow::__subpath_weight(const SSubpath& sp)const
+{
+	//delivered segments per msec, a lost one is paid for twice as it is
+	//sent again
+	time32_type rtt=sp.srtt>0?sp.srtt:(m_srtt>0?m_srtt:SUBPATH_DEFAULT_RTT);
+	double delivery=1.0-sp.lost_rate;
+	return std::max<int64_t>(1, 
+		(int64_t)(SUBPATH_WEIGHT_SCALE*delivery*delivery/std::max<time32_type>(rtt, 1)));
+}
+
+urdp_flow::SSubpath* urdp_flow::__find_subpath(const endpoint_type& remoteEdp)
+{
+	for (std::size_t i=1;i<m_subpaths.size();++i)
+	{
+		if (m_subpaths[i].remote_endpoint==remoteEdp)
+			return &m_subpaths[i];
+	}
+	return NULL;
+}
+
+void urdp_flow::__subpath_send(std::size_t idx, uint8_t control, const char* data,
+							   std::size_t len, time32_type now)
+{
+	safe_buffer buf;
+	safe_buffer_io io(&buf);
+	io.write(data, len);
+	__packet_as_reliable_and_sendout(m_snd_nxt, control, &buf, now, idx);
+}
+
+void urdp_flow::__subpath_send_join(std::size_t idx, time32_type now)
+{
+	SSubpath& sp=m_subpaths[idx];
+	char buf[PATH_JOIN_ACK_SIZE];
+	char* p=buf;
+	if (sp.joiner)
+	{
+		write_uint64_hton(sp.nonce, p);
+		write_uint32_hton(sp.token->flow_id, p);
+		__subpath_send(idx, CTRL_PATH_JOIN, buf, p-buf, now);
+	}
+	else
+	{
+		write_uint64_hton(sp.remote_nonce, p);
+		write_uint64_hton(sp.nonce, p);
+		__subpath_send(idx, CTRL_PATH_JOIN_ACK, buf, p-buf, now);
+	}
+	if (sp.validated)
+		return;
+	++sp.join_xmit;
+	sp.t_join=scape_zero(now+m_rto);
+	if (!m_t_subpath||mod_less(sp.t_join, m_t_subpath))
+		m_t_subpath=sp.t_join;
+}
+
+void urdp_flow::__subpath_on_join(const char* data, uint32_t dataLen, 
+								  const endpoint_type& from, time32_type now)
+{
+	if (dataLen<PATH_JOIN_SIZE||m_state!=ESTABLISHED)
+		return;
+	uint64_t remoteNonce=read_uint64_ntoh(data);
+	uint32_t remotePeerID=read_uint32_ntoh(data);
+
+	std::size_t idx=0;
+	for (std::size_t i=1;i<m_subpaths.size();++i)
+	{
+		if (m_subpaths[i].remote_endpoint==from)
+			idx=i;
+	}
+	if (idx==0)
+	{
+		if (m_subpaths.size()>=SUBPATH_MAX)
+			return;
+		if (m_subpaths.empty())
+		{
+			m_subpaths.push_back(SSubpath());
+			m_subpaths.back().validated=true;//the one connected by
+		}
+		SSubpath sp;
+		sp.remote_endpoint=from;
+		do{
+			sp.nonce=((uint64_t)random()<<32)|random();
+		}while(!sp.nonce);
+		m_subpaths.push_back(sp);
+		idx=m_subpaths.size()-1;
+	}
+	//the joiner may have sent it again or joined again from the same 
+	//endpoint, the ack goes on until our nonce is echoed
+	SSubpath& sp=m_subpaths[idx];
+	if (sp.joiner)
+		return;
+	sp.remote_peer_id=remotePeerID;
+	sp.remote_nonce=remoteNonce;
+	__subpath_send_join(idx, now);
+}
+
+void urdp_flow::__subpath_on_join_ack(const char* data, uint32_t dataLen, time32_type now)
+{
+	if (dataLen<PATH_JOIN_ACK_SIZE)
+		return;
+	uint64_t nonce=read_uint64_ntoh(data);
+	uint64_t remoteNonce=read_uint64_ntoh(data);
+	for (std::size_t i=1;i<m_subpaths.size();++i)
+	{
+		SSubpath& sp=m_subpaths[i];
+		if (!sp.joiner||sp.nonce!=nonce)
+			continue;
+		sp.validated=true;
+		sp.t_join=0;
+		sp.remote_nonce=remoteNonce;
+		//every ack is answered, one of the responses may be lost
+		char buf[PATH_CHALLENGE_SIZE];
+		char* p=buf;
+		write_uint64_hton(remoteNonce, p);
+		__subpath_send(i, CTRL_PATH_RESPONSE, buf, sizeof(buf), now);
+		return;
+	}
+}
+
+void urdp_flow::__subpath_on_timer(time32_type now)
+{
+	m_t_subpath=0;
+	for (std::size_t i=1;i<m_subpaths.size();++i)
+	{
+		SSubpath& sp=m_subpaths[i];
+		if (!sp.t_join)
+			continue;
+		if (mod_less(now, sp.t_join))
+		{
+			if (!m_t_subpath||mod_less(sp.t_join, m_t_subpath))
+				m_t_subpath=sp.t_join;
+		}
+		else if (sp.join_xmit>=SUBPATH_JOIN_MAX_XMIT)
+		{
+			sp.t_join=0;//not reachable that way, it is never used
+		}
+		else
+		{
+			__subpath_send_join(i, now);
+		}
+	}
+}
+
+void urdp_flow::__subpath_on_lost(std::size_t idx)
+{
+	if (idx<m_subpaths.size())
+		m_subpaths[idx].lost_rate+=(1.0-m_subpaths[idx].lost_rate)/SUBPATH_LOSS_WINDOW;
+}
+
+void urdp_flow::__subpath_on_acked(std::size_t idx)
+{
+	if (idx<m_subpaths.size())
+		m_subpaths[idx].lost_rate-=m_subpaths[idx].lost_rate/SUBPATH_LOSS_WINDOW;
+}
+
+void urdp_flow::__subpath_on_rtt(std::size_t idx, time32_type rtt)
+{
+	SSubpath& sp=m_subpaths[idx];
+	if (sp.srtt==0)
+		sp.srtt=std::max<time32_type>(rtt, 1);
+	else
+		sp.srtt=std::max<time32_type>((7*sp.srtt+rtt)>>3, 1);
+}
+
+uint32_t urdp_flow::__dup_ack_threshold()const
+{
+	//segments of different paths arrive out of order without being lost
+	return 3*(uint32_t)path_count();
+}
+
+bool urdp_flow::__keep_unreliable(const safe_buffer& pkt, uint16_t pktID, 
+								  uint8_t control, time32_type now)
+{
+	//a packet recovered from the parity may still arrive later
+	if (__fec_received(pktID, now))
+		return false;
+	RFecPacket& slot=m_fec_rpkts[pktID%FEC_RECV_SLOTS];
+	slot.buf=pkt;
+	slot.time=now;
+	slot.pktID=pktID;
+	slot.control=control;
+	slot.valid=true;
+
+	if (CTRL_UNRELIABLE_DATA==control||m_unreliable_rkeeper.try_keep(pktID, seconds(8)))
+	{
+		m_unreliable_rlist.push_back(pkt);
+		return true;
+	}
+	return false;
+}
+
+bool urdp_flow::__fec_active()const
+{
+	return m_fec_enabled&&(m_remote_syn_options&SYN_OPT_FEC);
+}
+
+uint8_t urdp_flow::__fec_group_size()const
+{
+	//one parity for every group, the more lost the smaller the group
+	double lostRate=local_to_remote_lost_rate();
+	if (lostRate>0.1)
+		return 2;
+	else if (lostRate>0.05||lostRate<0)//<0 means not known
+		return 4;
+	else if (lostRate>0.01)
+		return 8;
+	return FEC_MAX_GROUP;
+}
+
+void urdp_flow::__fec_add(const SUnraliableSegment& seg, time32_type now)
+{
+	//the packets of a group must have consecutive pktIDs
+	if (m_fec_count>0&&(uint16_t)(m_fec_base+m_fec_count)!=seg.pktID)
+		__fec_send_parity(now);
+	if (m_fec_count==0)
+	{
+		m_fec_base=seg.pktID;
+		m_fec_group_size=__fec_group_size();
+		m_fec_semi_mask=m_fec_len_xor=m_fec_type_xor=0;
+		m_fec_xor.clear();
+		m_t_fec_flush=scape_zero(now+FEC_FLUSH_DELAY);
+	}
+
+	std::size_t len=seg.buf.size();
+	if (m_fec_xor.size()<len)
+		m_fec_xor.resize(len, 0);
+	xor_bytes(&m_fec_xor[0], buffer_cast<const char*>(seg.buf), len);
+	m_fec_len_xor^=(uint16_t)len;
+	m_fec_type_xor^=seg.msgType;
+	if (seg.control==CTRL_SEMIRELIABLE_DATA)
+		m_fec_semi_mask|=(1<<m_fec_count);
+	if (++m_fec_count>=m_fec_group_size)
+		__fec_send_parity(now);
+}
+
+void urdp_flow::__fec_send_parity(time32_type now)
+{
+	m_t_fec_flush=0;
+	if (m_fec_count==0)
+		return;
+	BOOST_ASSERT(!m_fec_xor.empty());
+
+	const size_t format_size=unreliable_packet_format_type::format_size();
+	safe_buffer urdp_header_buf(format_size+FEC_PARITY_HEADER_SIZE);
+	packet<unreliable_packet_format_type> urdp_header(urdp_header_buf,true);
+	__fill_unreliable_header(urdp_header, CTRL_FEC_PARITY);
+
+	char* ptoHeader=buffer_cast<char*>(urdp_header.buffer())+format_size;
+	write_uint16_hton(m_fec_base, ptoHeader);
+	write_uint8_hton(m_fec_count, ptoHeader);
+	write_uint8_hton(0, ptoHeader);//reserved
+	write_uint16_hton(m_fec_semi_mask, ptoHeader);
+	write_uint16_hton(m_fec_len_xor, ptoHeader);
+	write_uint16_hton(m_fec_type_xor, ptoHeader);
+
+	safe_buffer parity;
+	safe_buffer_io io(&parity);
+	io.write(&m_fec_xor[0], m_fec_xor.size());
+
+	boost::array<safe_buffer, 2> bufVec={{urdp_header.buffer(),parity}};
+	error_code ec;
+	m_token->shared_layer->async_send_to(bufVec, m_remote_endpoint, ec);
+	out_speed_meter_+=(format_size+FEC_PARITY_HEADER_SIZE+parity.size());
+	m_t_lasttraffic=m_t_lastsend = now;
+	if (m_path) m_path->t_lastsend=now;
+	m_fec_count=0;
+}
+
+bool urdp_flow::__fec_received(uint16_t pktID, time32_type now)const
+{
+	const RFecPacket& slot=m_fec_rpkts[pktID%FEC_RECV_SLOTS];
+	return slot.valid&&slot.pktID==pktID
+		&&mod_minus(now, slot.time)<(long)FEC_HOLD_TIME;
+}
+
+bool urdp_flow::__fec_on_parity(const safe_buffer& body, time32_type now)
+{
+	const char* p=buffer_cast<const char*>(body);
+	RFecParity parity;
+	parity.base=read_uint16_ntoh(p);
+	parity.count=read_uint8_ntoh(p);
+	read_uint8_ntoh(p);//reserved
+	parity.semiMask=read_uint16_ntoh(p);
+	parity.lenXor=read_uint16_ntoh(p);
+	parity.typeXor=read_uint16_ntoh(p);
+	if (parity.count==0||parity.count>FEC_MAX_GROUP)
+		return false;
+	parity.buf=body.buffer_ref(FEC_PARITY_HEADER_SIZE);
+	parity.time=now;
+
+	if (m_fec_rparity.size()>=FEC_MAX_PARITY)
+		m_fec_rparity.pop_front();
+	m_fec_rparity.push_back(parity);
+	return __fec_try_recover(now);
+}
+
+bool urdp_flow::__fec_try_recover(time32_type now)
+{
+	//a parity recovers the only lost packet of its group, it waits for
+	//the late packets while more than one is missing
+	bool recovered=false;
+	RFecParityList::iterator itr=m_fec_rparity.begin();
+	while (itr!=m_fec_rparity.end())
+	{
+		if (mod_minus(now, itr->time)>=(long)FEC_HOLD_TIME)
+		{
+			itr=m_fec_rparity.erase(itr);
+			continue;
+		}
+		uint8_t missing=0;
+		int missingCnt=0;
+		for (uint8_t i=0;i<itr->count&&missingCnt<2;++i)
+		{
+			if (!__fec_received((uint16_t)(itr->base+i), now))
+			{
+				missing=i;
+				++missingCnt;
+			}
+		}
+		if (missingCnt==1&&__fec_recover(*itr, missing, now))
+			recovered=true;
+		if (missingCnt<=1)
+			itr=m_fec_rparity.erase(itr);
+		else
+			++itr;
+	}
+	return recovered;
+}
+
+bool urdp_flow::__fec_recover(const RFecParity& parity, uint8_t missing, 
+							  time32_type now)
+{
+	uint16_t len=parity.lenXor;
+	uint16_t msgType=parity.typeXor;
+	for (uint8_t i=0;i<parity.count;++i)
+	{
+		if (i==missing)
+			continue;
+		const safe_buffer& buf=m_fec_rpkts[(uint16_t)(parity.base+i)%FEC_RECV_SLOTS].buf;
+		const char* p=buffer_cast<const char*>(buf);
+		msgType^=read_uint16_ntoh(p);
+		len^=(uint16_t)(buf.size()-2);
+	}
+	if (len==0||len>parity.buf.size())
+		return false;//not a parity of these packets
+
+	safe_buffer pkt;
+	safe_buffer_io io(&pkt);
+	io.prepare(2+len);
+	io<<msgType;
+	io.write(buffer_cast<const char*>(parity.buf), len);
+	char* data=buffer_cast<char*>(pkt)+2;
+	for (uint8_t i=0;i<parity.count;++i)
+	{
+		if (i==missing)
+			continue;
+		const safe_buffer& buf=m_fec_rpkts[(uint16_t)(parity.base+i)%FEC_RECV_SLOTS].buf;
+		xor_bytes(data, buffer_cast<const char*>(buf)+2, 
+			(std::min<std::size_t>)(len, buf.size()-2));
+	}
+
+	uint8_t control=(parity.semiMask&(1<<missing))?
+		CTRL_SEMIRELIABLE_DATA:CTRL_UNRELIABLE_DATA;
+	return __keep_unreliable(pkt, (uint16_t)(parity.base+missing), control, now);
+}
 
 double urdp_flow::__calc_remote_to_local_lost_rate(time32_type now, 
 												   wrappable_integer<int8_t>* id) const
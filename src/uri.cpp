@@ -131,225 +131,292 @@ namespace p2engine {
 	void uri::from_string(uri& new_url,const char* p, boost::system::error_code& ec)
 	{
 		std::string str=normalize(p);
-		const char* s=str.c_str();
+		uri_view v;
+		if (!v.parse(str))
+		{
+			ec = make_error_code(boost::system::errc::invalid_argument);
+			return;
+		}
 
-		// Protocol.
-		std::size_t length = std::strcspn(s, ":");
-		if (length+2<=str.length()&&
-			(s[length]==':')&&(s[length+1]=='/')&&(s[length+2]=='/'))
+		new_url.protocol_=v.protocol().to_string();
+		//boost::to_lower(new_url.protocol_);
+		//std::local has a bug in msvc stl.It will caush crash. so,...
+		for (size_t i=0;i<new_url.protocol_.size();++i)
+			new_url.protocol_[i]=::tolower(new_url.protocol_[i]);
+		new_url.user_info_=v.user_info().to_string();
+		new_url.user_name_=v.user_name().to_string();
+		new_url.user_password_=v.user_password().to_string();
+		new_url.host_=v.host().to_string();
+		new_url.ipv6_host_=v.ipv6_host();
+		new_url.port_=v.port_piece().to_string();
+		new_url.path_=v.path().to_string();
+		new_url.query_=v.query().to_string();
+		new_url.fragment_=v.fragment().to_string();
+		new_url.query_map_.clear();
+		new_url.query_map_built_=false;
+
+		ec = boost::system::error_code();
+	}
+
+	void uri::build_query_map()const
+	{
+		uri_piece query(query_.data(),query_.data()+query_.size());
+		for (uri_view::query_iterator itr(query),end(uri_piece(query.end(),query.end()));
+			itr!=end;++itr)
 		{
-			new_url.protocol_.assign(s, s + length);
-			boost::trim_if(new_url.protocol_, ::isspace);
-
-			//boost::to_lower(new_url.protocol_);
-			//std::local has a bug in msvc stl.It will caush crash. so,...
-			for (size_t i=0;i<new_url.protocol_.size();++i)
-				new_url.protocol_[i]=::tolower(new_url.protocol_[i]);
-			
-			s += length;
-
-			// "://".
-			if (*s++ != ':')
-			{
-				ec = make_error_code(boost::system::errc::invalid_argument);
-				return;
-			}
-			if (*s++ != '/')
+			//the values have been checked by from_string
+			uri_view::unescape(itr->value,query_map_[itr->name.to_string()]);
+		}
+		query_map_built_=true;
+	}
+
+	uri uri::from_string(const char* s)
+	{
+		boost::system::error_code ec;
+		uri new_url(from_string(s, ec));
+		if (ec)
+		{
+			boost::system::system_error ex(ec);
+			boost::throw_exception(ex);
+		}
+		return new_url;
+	}
+
+	bool uri::unescape_path(const std::string& in, std::string& out)
+	{
+		return uri_view::unescape(uri_piece(in.data(),in.data()+in.size()),out);
+	}
+
+	namespace{
+		inline const char* find_first_of(const char* s, const char* end, const char* set)
+		{
+			for (;s!=end;++s)
 			{
-				ec = make_error_code(boost::system::errc::invalid_argument);
-				return;
+				if (std::strchr(set,*s))
+					return s;
 			}
-			if (*s++ != '/')
+			return end;
+		}
+
+		inline int hex_value(char c)
+		{
+			if (c >= '0' && c <= '9')
+				return c - '0';
+			if (c >= 'a' && c <= 'f')
+				return c - 'a' + 10;
+			if (c >= 'A' && c <= 'F')
+				return c - 'A' + 10;
+			return -1;
+		}
+
+		inline bool iequals(const uri_piece& a, const char* b)
+		{
+			std::size_t n=std::strlen(b);
+			if (a.size()!=n)
+				return false;
+			for (std::size_t i=0;i<n;++i)
 			{
-				ec = make_error_code(boost::system::errc::invalid_argument);
-				return;
+				if (::tolower((unsigned char)a.begin()[i])!=b[i])
+					return false;
 			}
+			return true;
 		}
-		else
+	}
+
+	void uri_view::query_iterator::__load()
+	{
+		while (pos_!=end_&&*pos_=='&')
+			++pos_;
+		const char* paramEnd=find_first_of(pos_,end_,"&");
+		const char* nameEnd=find_first_of(pos_,paramEnd,"=");
+		param_.name=uri_piece(pos_,nameEnd);
+		param_.value=uri_piece(nameEnd==paramEnd?paramEnd:nameEnd+1,paramEnd);
+	}
+
+	bool uri_view::parse(const char* str, std::size_t len)
+	{
+		*this=uri_view();
+		const char* s=str;
+		const char* end=str+len;
+
+		// Protocol.
+		const char* q=find_first_of(s,end,":");
+		if (end-q>=3&&q[1]=='/'&&q[2]=='/')
 		{
-			new_url.protocol_="";
+			const char* b=s;
+			const char* e=q;
+			while (b!=e&&::isspace((unsigned char)*b))
+				++b;
+			while (b!=e&&::isspace((unsigned char)e[-1]))
+				--e;
+			protocol_=uri_piece(b,e);
+			s=q+3;
 		}
+
 		// UserInfo.
-		length = std::strcspn(s, "@:[/?#");
-		if (s[length] == '@')
+		q=find_first_of(s,end,"@:[/?#");
+		if (q!=end&&*q=='@')
 		{
-			new_url.user_info_.assign(s, s + length);
-			s += length + 1;
+			user_info_=uri_piece(s,q);
+			s=q+1;
 		}
-		else if (s[length] == ':')
+		else if (q!=end&&*q==':')
 		{
-			std::size_t length2 = std::strcspn(s + length, "@/?#");
-			if (s[length + length2] == '@')
+			const char* q2=find_first_of(q,end,"@/?#");
+			if (q2!=end&&*q2=='@')
 			{
-				new_url.user_info_.assign(s, s + length + length2);
-				s += length + length2 + 1;
+				user_info_=uri_piece(s,q2);
+				s=q2+1;
 			}
 		}
-		if (!new_url.user_info_.empty())
+		if (!user_info_.empty())
 		{
-			std::string::size_type n=new_url.user_info_.find(':');
-			if (n!=std::string::npos)
+			const char* n=find_first_of(user_info_.begin(),user_info_.end(),":");
+			if (n!=user_info_.end())
 			{
-				new_url.user_name_=new_url.user_info_.substr(0,n);
-				if (n<new_url.user_info_.length())
-					new_url.user_password_=new_url.user_info_.substr(n+1,new_url.user_info_.length()-n);
+				user_name_=uri_piece(user_info_.begin(),n);
+				user_password_=uri_piece(n+1,user_info_.end());
 			}
 		}
 
-
 		// Host.
-		if (*s == '[')
+		if (s!=end&&*s=='[')
 		{
-			length = std::strcspn(++s, "]");
-			if (s[length] != ']')
-			{
-				ec = make_error_code(boost::system::errc::invalid_argument);
-				return;
-			}
-			new_url.host_.assign(s, s + length);
-			new_url.ipv6_host_ = true;
-			s += length + 1;
-			if (std::strcspn(s, ":/?#") != 0)
-			{
-				ec = make_error_code(boost::system::errc::invalid_argument);
-				return;
-			}
+			q=find_first_of(++s,end,"]");
+			if (q==end)
+				return false;
+			host_=uri_piece(s,q);
+			ipv6_host_=true;
+			s=q+1;
+			if (s!=end&&!std::strchr(":/?#",*s))
+				return false;
 		}
 		else
 		{
-			length = std::strcspn(s, ":/?#");
-			new_url.host_.assign(s, s + length);
-			s += length;
+			q=find_first_of(s,end,":/?#");
+			host_=uri_piece(s,q);
+			s=q;
 		}
 
 		// Port.
-		if (*s == ':')
+		if (s!=end&&*s==':')
 		{
-			length = std::strcspn(++s, "/?#");
-			if (length == 0)
-			{
-				ec = make_error_code(boost::system::errc::invalid_argument);
-				return;
-			}
-			new_url.port_.assign(s, s + length);
-			for (std::size_t i = 0; i < new_url.port_.length(); ++i)
+			q=find_first_of(++s,end,"/?#");
+			if (q==s)
+				return false;
+			for (const char* c=s;c!=q;++c)
 			{
-				if (!::isdigit(new_url.port_[i]))
-				{
-					ec = make_error_code(boost::system::errc::invalid_argument);
-					return;
-				}
+				if (!::isdigit((unsigned char)*c))
+					return false;
 			}
-			s += length;
+			port_=uri_piece(s,q);
+			s=q;
 		}
 
 		// Path.
-		if (*s == '/')
+		if (s!=end&&*s=='/')
 		{
-			length = std::strcspn(s, "?#");
-			new_url.path_.assign(s, s + length);
-			std::string tmp_path;
-			if (!unescape_path(new_url.path_, tmp_path))
-			{
-				ec = make_error_code(boost::system::errc::invalid_argument);
-				return;
-			}
-			s += length;
+			q=find_first_of(s,end,"?#");
+			path_=uri_piece(s,q);
+			if (!is_valid_escaped(path_))
+				return false;
+			s=q;
 		}
-		else
-			new_url.path_ = "/";
 
 		// Query.
-		if (*s == '?')
+		if (s!=end&&*s=='?')
 		{
-			length = std::strcspn(++s, "#");
-			new_url.query_.assign(s, s + length);
-			s += length;
-
-			const char* p=new_url.query_.c_str();
-			std::vector<std::string> result;
-			std::vector<std::string> result2;
-			boost::split(result,p,boost::is_any_of("&"));
-			for(std::size_t i=0;i<result.size();++i)
+			q=find_first_of(++s,end,"#");
+			query_=uri_piece(s,q);
+			for (query_iterator itr=query_begin(),e=query_end();itr!=e;++itr)
 			{
-				p=result[i].c_str();
-				result2.clear();
-				boost::split(result2,p,boost::is_any_of("="));
-				if (result2.size()>0)
-				{
-					if(result2.size()>=2)
-					{
-						std::string tem_res;
-						if (!unescape_path(result2[1], tem_res))
-						{
-							ec = make_error_code(boost::system::errc::invalid_argument);
-							return;
-						}
-						new_url.query_map_[result2[0] ]=tem_res;
-					}
-					else
-						new_url.query_map_[result2[0] ]="";
-				}
+				if (!is_valid_escaped(itr->value))
+					return false;
 			}
+			s=q;
 		}
 
 		// Fragment.
-		if (*s == '#')
-			new_url.fragment_.assign(++s);
+		if (s!=end&&*s=='#')
+			fragment_=uri_piece(s+1,end);
 
-		ec = boost::system::error_code();
+		return true;
 	}
 
-	uri uri::from_string(const char* s)
+	unsigned short uri_view::port() const
 	{
-		boost::system::error_code ec;
-		uri new_url(from_string(s, ec));
-		if (ec)
+		if (!port_.empty())
 		{
-			boost::system::system_error ex(ec);
-			boost::throw_exception(ex);
+			unsigned int n=0;
+			for (const char* c=port_.begin();c!=port_.end();++c)
+				n=n*10+(*c-'0');
+			return (unsigned short)n;
 		}
-		return new_url;
+		if (iequals(protocol_,"http"))
+			return 80;
+		if (iequals(protocol_,"https"))
+			return 443;
+		if (iequals(protocol_,"ftp"))
+			return 21;
+		if (iequals(protocol_,"ftpes"))
+			return 21;
+		if (iequals(protocol_,"ftps"))
+			return 990;
+		if (iequals(protocol_,"tftp"))
+			return 69;
+		return 0;
 	}
 
-	bool uri::unescape_path(const std::string& in, std::string& out)
+	bool uri_view::find_query(const char* name, uri_piece& value) const
+	{
+		for (query_iterator itr=query_begin(),e=query_end();itr!=e;++itr)
+		{
+			if (itr->name.equals(name))
+			{
+				value=itr->value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool uri_view::is_valid_escaped(const uri_piece& in)
+	{
+		for (const char* c=in.begin();c!=in.end();++c)
+		{
+			if (*c=='%')
+			{
+				if (in.end()-c<3||hex_value(c[1])<0||hex_value(c[2])<0)
+					return false;
+				c+=2;
+			}
+			else if (!uri::is_uri_char(*c))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool uri_view::unescape(const uri_piece& in, std::string& out)
 	{
 		out.clear();
 		out.reserve(in.size());
-		for (std::size_t i = 0; i < in.size(); ++i)
+		for (const char* c=in.begin();c!=in.end();++c)
 		{
-			switch (in[i])
+			if (*c=='%')
 			{
-			case '%':
-				if (i + 3 <= in.size())
-				{
-					unsigned int value = 0;
-					for (std::size_t j = i + 1; j < i + 3; ++j)
-					{
-						char c=in[j];
-						if (c >= '0' && c <= '9')
-							value += c - '0';
-						else if (c >= 'a' && c <= 'f')
-							value += c - 'a' + 10;
-						else if (c >= 'A' && c <= 'F')
-							value += c - 'A' + 10;
-						else
-							return false;
-						if (j == i + 1)
-							value <<= 4;
-					}
-					out += static_cast<char>(value);
-					i += 2;
-				}
-				else
+				int hi, lo;
+				if (in.end()-c<3||(hi=hex_value(c[1]))<0||(lo=hex_value(c[2]))<0)
 					return false;
-				break;
-
-			default:
-				if (!is_uri_char(in[i]))
+				out += static_cast<char>((hi<<4)|lo);
+				c+=2;
+			}
+			else
+			{
+				if (!uri::is_uri_char(*c))
 					return false;
-				out += in[i];
-				break;
+				out += *c;
 			}
 		}
 		return true;
@@ -264,6 +264,9 @@ namespace p2engine {
 	{
 		if (s.empty())
 			return "";
+		// every native narrow charset we run on is a superset of ASCII
+		if (is_ascii(s))
+			return s;
 
 		std::wstring ws;
 		if(utf8_wchar(s, ws)!=conversionOK)
@@ -281,6 +284,8 @@ namespace p2engine {
 	{
 		if (s.empty())
 			return "";
+		if (is_ascii(s))
+			return s;
 
 		std::wstring ws;
 		ws.resize(s.size());
@@ -327,6 +332,9 @@ namespace p2engine {
 
 	std::string convert_to_native(std::string const& s)
 	{
+		if (is_ascii(s))
+			return s;
+
 		static fast_mutex iconv_mutex;
 		// only one thread can use this handle at a time
 		fast_mutex::scoped_lock l(iconv_mutex);
@@ -339,6 +347,9 @@ namespace p2engine {
 
 	std::string convert_from_native(std::string const& s)
 	{
+		if (is_ascii(s))
+			return s;
+
 		static fast_mutex iconv_mutex;
 		// only one thread can use this handle at a time
 		fast_mutex::scoped_lock l(iconv_mutex);
@@ -0,0 +1,155 @@
+#include <p2engine/push_warning_option.hpp>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <p2engine/pop_warning_option.hpp>
+
+#include <p2engine/p2engine.hpp>
+#include <p2engine/gzip.hpp>
+#include <p2engine/gzip_stream.hpp>
+#include <p2engine/puff.hpp>
+
+using namespace p2engine;
+
+//compare inflate_gzip with the bit-serial puff() on payloads that a
+//client typically receives gziped over http.
+
+std::string json_payload()
+{
+	std::string s="{\"peers\":[";
+	char buf[256];
+	for (int i=0;i<4000;++i)
+	{
+		snprintf(buf,sizeof(buf),
+			"{\"id\":\"%08x%08x\",\"ip\":\"10.%d.%d.%d\",\"port\":%d,\"uploaded\":%d},",
+			i*2654435761u,i*40503u,i%7,(i*13)%256,(i*29)%256,6881+i%64,i*1379);
+		s+=buf;
+	}
+	s+="{}]}";
+	return s;
+}
+
+std::string html_payload()
+{
+	std::string s="<!DOCTYPE html><html><head><title>channel list</title></head><body><table>";
+	char buf[512];
+	for (int i=0;i<3000;++i)
+	{
+		snprintf(buf,sizeof(buf),
+			"<tr class=\"row%d\"><td><a href=\"/channel?id=%d\">channel %d</a></td>"
+			"<td>%d viewers</td><td>%d kbps</td></tr>\n",
+			i%2,i,i,(i*7919)%10000,300+(i*31)%700);
+		s+=buf;
+	}
+	s+="</table></body></html>";
+	return s;
+}
+
+std::string tracker_payload()
+{
+	//bencoded compact peer list, mostly incompressible
+	std::string peers;
+	boost::uint32_t seed=12345;
+	for (int i=0;i<6*5000;++i)
+	{
+		seed=seed*1103515245+12345;
+		peers+=char(seed>>24);
+	}
+	char buf[64];
+	snprintf(buf,sizeof(buf),"d8:completei120e10:incompletei56e8:intervali1800e5:peers%d:",
+		(int)peers.size());
+	return buf+peers+"e";
+}
+
+std::vector<char> compress(const std::string& data)
+{
+	gzip_deflater deflater;
+	safe_buffer out;
+	deflater.deflate(data.c_str(),data.size(),out);
+	deflater.finish(out);
+	const char* p=buffer_cast<const char*>(out);
+	return std::vector<char>(p,p+out.length());
+}
+
+//a file gziped by real gzip, it has dynamic huffman blocks which
+//gzip_deflater never emits
+std::vector<char> load_fixture(const std::string& path)
+{
+	std::ifstream in(path.c_str(),std::ios::binary);
+	return std::vector<char>((std::istreambuf_iterator<char>(in)),
+		std::istreambuf_iterator<char>());
+}
+
+std::string fixture_dir()
+{
+	std::string dir(__FILE__);
+	std::string::size_type n=dir.find_last_of("/\\");
+	dir=(n==std::string::npos)?std::string("."):dir.substr(0,n);
+	return dir+"/../data/";
+}
+
+void bench(const char* name, const std::string& data, std::vector<char> gz)
+{
+	if (gz.empty())
+		gz=compress(data);
+	const int loop=200;
+	int maximum_size=int(data.size())+1024;
+
+	//verify
+	std::vector<char> buffer;
+	std::string error;
+	if (!inflate_gzip(&gz[0],int(gz.size()),buffer,maximum_size,error)
+		||std::string(buffer.begin(),buffer.end())!=data)
+	{
+		std::cout<<name<<": inflate_gzip failed, "<<error<<std::endl;
+		return;
+	}
+
+	int header_len=gzip_header(&gz[0],int(gz.size()));
+	std::vector<unsigned char> out(maximum_size);
+
+	tick_type t0=precise_tick_time::now_tick_count();
+	for (int i=0;i<loop;++i)
+	{
+		boost::uint32_t destlen=out.size();
+		boost::uint32_t srclen=gz.size()-header_len;
+		puff(&out[0],&destlen,(unsigned char*)&gz[header_len],&srclen);
+	}
+	tick_type t1=precise_tick_time::now_tick_count();
+	for (int i=0;i<loop;++i)
+	{
+		inflate_gzip(&gz[0],int(gz.size()),buffer,maximum_size,error);
+	}
+	tick_type t2=precise_tick_time::now_tick_count();
+
+	double mb=double(data.size())*loop/(1024*1024);
+	double puffMs=double((std::max)(t1-t0,tick_type(1)));
+	double inflateMs=double((std::max)(t2-t1,tick_type(1)));
+	std::cout<<std::setw(8)<<name
+		<<"  raw "<<data.size()<<"  gzip "<<gz.size()
+		<<std::fixed<<std::setprecision(1)
+		<<"  puff "<<mb*1000/puffMs<<"MB/s"
+		<<"  inflate_gzip "<<mb*1000/inflateMs<<"MB/s"
+		<<"  x"<<puffMs/inflateMs
+		<<std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	bench("json",json_payload(),std::vector<char>());
+	bench("html",html_payload(),std::vector<char>());
+	bench("tracker",tracker_payload(),std::vector<char>());
+
+	//html.gz is html_payload() by gzip -9n
+	std::string dir=(argc>1)?std::string(argv[1])+"/":fixture_dir();
+	std::vector<char> gz=load_fixture(dir+"html.gz");
+	if (gz.size()<11||((gz[10]>>1)&3)!=2)
+		std::cout<<"html.gz: not found or not dynamic huffman in "<<dir<<std::endl;
+	else
+		bench("html.gz",html_payload(),gz);
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include <p2engine/push_warning_option.hpp>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <p2engine/pop_warning_option.hpp>
+
+#include <p2engine/p2engine.hpp>
+#include <p2engine/keeper.hpp>
+
+using namespace p2engine;
+
+//compare the multi_index timed_keeper_set with the hash + timing wheel
+//timed_wheel_keeper_set, the keys are kept for 8s as urdp_flow does.
+
+template<typename Keeper>
+void run(Keeper& keeper, const std::vector<boost::uint32_t>& keys,
+		 double& keepMs, double& findMs, double& eraseMs)
+{
+	std::size_t hit=0;
+	tick_type t0=precise_tick_time::now_tick_count();
+	for (std::size_t i=0;i<keys.size();++i)
+		keeper.try_keep(keys[i],seconds(8));
+	tick_type t1=precise_tick_time::now_tick_count();
+	for (std::size_t i=0;i<keys.size();++i)
+		hit+=keeper.is_keeped(keys[i]);
+	tick_type t2=precise_tick_time::now_tick_count();
+	for (std::size_t i=0;i<keys.size();++i)
+		keeper.erase(keys[i]);
+	tick_type t3=precise_tick_time::now_tick_count();
+
+	if (hit!=keys.size())
+		std::cout<<"lost keys: "<<keys.size()-hit<<std::endl;
+	keepMs=double(t1-t0);
+	findMs=double(t2-t1);
+	eraseMs=double(t3-t2);
+}
+
+void bench(std::size_t n)
+{
+	std::vector<boost::uint32_t> keys(n);
+	for (std::size_t i=0;i<n;++i)
+		keys[i]=(boost::uint32_t)i*2654435761u;//distinct, scattered
+
+	double keep[2],find[2],erase[2];
+	{
+		timed_keeper_set<boost::uint32_t> keeper;
+		run(keeper,keys,keep[0],find[0],erase[0]);
+	}
+	{
+		timed_wheel_keeper_set<boost::uint32_t> keeper;
+		run(keeper,keys,keep[1],find[1],erase[1]);
+	}
+
+	std::cout<<std::setw(8)<<n<<std::fixed<<std::setprecision(1)
+		<<"  try_keep "<<keep[0]<<"ms/"<<keep[1]<<"ms"
+		<<"  is_keeped "<<find[0]<<"ms/"<<find[1]<<"ms"
+		<<"  erase "<<erase[0]<<"ms/"<<erase[1]<<"ms"
+		<<std::endl;
+}
+
+int main()
+{
+	std::cout<<"entries  multi_index/timing wheel"<<std::endl;
+	bench(10000);
+	bench(100000);
+	bench(1000000);
+	return 0;
+}
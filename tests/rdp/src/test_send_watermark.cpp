@@ -0,0 +1,208 @@
+#include <p2engine/push_warning_option.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+#include <set>
+#include <p2engine/pop_warning_option.hpp>
+
+#include <p2engine/fssignal.hpp>
+#include <p2engine/rdp.hpp>
+
+using namespace p2engine;
+
+//a urdp sender fills its queue past the high watermark a few times, each
+//time it has to be blocked there and get exactly one writable_signal
+//once the queue drains to the low watermark. with the default marks and
+//send buffer the send buffer is the lower limit.
+
+std::string domain="/p2p/watermark";
+
+inline endpoint server_endpoint()
+{
+	return endpoint(address(address_v4::loopback()),8891);
+}
+
+enum{
+	DATA_MSG=1
+};
+
+const std::size_t MSG_SIZE=10000;
+const int CYCLES=3;
+
+int failed=0;
+
+void check(bool ok, const char* what)
+{
+	if (!ok)
+	{
+		++failed;
+		std::cout<<"FAILED: "<<what<<std::endl;
+	}
+}
+
+class server
+	:public fssignal::trackable
+{
+	typedef server this_type;
+public:
+	server(io_service& ios):ios_(ios),recvd_size_(0){}
+	void run()
+	{
+		acceptor_=urdp_acceptor::create(ios_,false);
+		acceptor_->accepted_signal().bind(&this_type::on_accepted,this,_1,_2);
+
+		error_code ec;
+		acceptor_->listen(server_endpoint(),domain,ec);
+		check(!ec,"listen");
+		if (!ec)
+			acceptor_->keep_async_accepting();
+	}
+	std::size_t recvd_size()const
+	{
+		return recvd_size_;
+	}
+
+private:
+	void on_accepted(boost::shared_ptr<basic_connection> socket,const error_code& ec)
+	{
+		check(!ec,"accept");
+		if (ec)
+			return;
+		sockets_.insert(socket);
+		socket->received_signal(DATA_MSG).bind(&this_type::on_received_data,this,_1);
+	}
+
+	void on_received_data(safe_buffer buf)
+	{
+		recvd_size_+=buf.size();
+	}
+
+private:
+	boost::shared_ptr<urdp_acceptor> acceptor_;
+	io_service& ios_;
+	std::set<boost::shared_ptr<basic_connection> > sockets_;
+	std::size_t recvd_size_;
+};
+
+class client
+	:public fssignal::trackable
+{
+	typedef client this_type;
+
+public:
+	client(io_service& ios):ios_(ios),cycles_(0),writables_(0),sent_size_(0){}
+	void run()
+	{
+		timeout_timer_=rough_timer::create(ios_);
+		timeout_timer_->time_signal().bind(&this_type::on_timeout,this);
+		timeout_timer_->async_wait(seconds(30));
+
+		socket_=urdp_connection::create(ios_,false);
+		socket_->connected_signal().bind(&this_type::on_connected,this,_1);
+		socket_->writable_signal().bind(&this_type::on_writable,this);
+		socket_->async_connect(server_endpoint(),domain);
+	}
+	int cycles()const
+	{
+		return cycles_;
+	}
+	int writables()const
+	{
+		return writables_;
+	}
+	std::size_t sent_size()const
+	{
+		return sent_size_;
+	}
+
+private:
+	urdp_connection* conn()const
+	{
+		return static_cast<urdp_connection*>(socket_.get());
+	}
+
+	void on_connected(const error_code& ec)
+	{
+		check(!ec,"connect");
+		if (ec)
+		{
+			ios_.stop();
+			return;
+		}
+		check(conn()->send_buffer_size()<socket_->send_high_watermark(),
+			"the send buffer is below the default high watermark");
+		fill();
+	}
+
+	//send until blocked, it has to happen at the lower of the limits
+	void fill()
+	{
+		++cycles_;
+		std::size_t highMark=conn()->send_high_watermark(conn()->send_queue_limit());
+		while (!socket_->is_send_blocked())
+		{
+			check(socket_->overstocked_send_size()<highMark,"blocked at the high watermark");
+			safe_buffer buf(MSG_SIZE);
+			memset(buffer_cast<char*>(buf),cycles_,MSG_SIZE);
+			socket_->async_send_reliable(buf,DATA_MSG);
+			sent_size_+=MSG_SIZE;
+		}
+		check(socket_->overstocked_send_size()>=highMark,"not blocked before the high watermark");
+	}
+
+	void on_writable()
+	{
+		++writables_;
+		check(writables_==cycles_,"one writable_signal for every time blocked");
+		check(!socket_->is_send_blocked(),"writable while blocked");
+		check(socket_->overstocked_send_size()
+			<=conn()->send_low_watermark(conn()->send_queue_limit()),
+			"writable above the low watermark");
+		if (cycles_<CYCLES)
+		{
+			fill();
+		}
+		else
+		{
+			//give a second writable_signal the time to come wrongly
+			done_timer_=rough_timer::create(ios_);
+			done_timer_->time_signal().bind(&this_type::on_timeout,this);
+			done_timer_->async_wait(seconds(2));
+		}
+	}
+
+	void on_timeout()
+	{
+		socket_->close();
+		ios_.stop();
+	}
+
+private:
+	boost::shared_ptr<basic_connection> socket_;
+	io_service& ios_;
+	boost::shared_ptr<rough_timer> timeout_timer_;
+	boost::shared_ptr<rough_timer> done_timer_;
+	int cycles_;
+	int writables_;
+	std::size_t sent_size_;
+};
+
+int main()
+{
+	io_service ios;
+	client c(ios);
+	server s(ios);
+	s.run();
+	c.run();
+	ios.run();
+
+	check(c.cycles()==CYCLES&&c.writables()==CYCLES,"finished in time");
+	check(s.recvd_size()==c.sent_size(),"all sent data received");
+	if (failed)
+	{
+		std::cout<<failed<<" checks failed"<<std::endl;
+		return 1;
+	}
+	std::cout<<"all checks passed"<<std::endl;
+	return 0;
+}
@@ -0,0 +1,270 @@
+#include <p2engine/push_warning_option.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <iostream>
+#include <set>
+#include <p2engine/pop_warning_option.hpp>
+
+#include <p2engine/fssignal.hpp>
+#include <p2engine/rdp.hpp>
+#include <p2engine/safe_buffer_chain.hpp>
+
+using namespace p2engine;
+
+//exercise the options urdp peers agree on in CONNECT over loopback.
+//the first connection carries a bulk transfer, the server takes it in
+//scatter delivery and the client adds a second path to it. the client
+//then connects again with the resume ticket it got, and sends its first
+//message right behind CONNECT.
+
+std::string domain="/p2p/options";
+
+inline endpoint server_endpoint()
+{
+	return endpoint(address(address_v4::loopback()),8890);
+}
+
+enum{
+	BULK_MSG=1,
+	DONE_MSG,
+	HELLO_MSG
+};
+
+const uint32_t BULK_COUNT=100;
+const std::size_t BULK_SIZE=16000;//more than a datagram
+
+inline char bulk_byte(uint32_t n, std::size_t i)
+{
+	return (char)(n+i*7);
+}
+
+int failed=0;
+
+void check(bool ok, const char* what)
+{
+	if (!ok)
+	{
+		++failed;
+		std::cout<<"FAILED: "<<what<<std::endl;
+	}
+}
+
+class server
+	:public fssignal::trackable
+{
+	typedef server this_type;
+public:
+	server(io_service& ios):ios_(ios),bulk_count_(0),multi_buffer_count_(0){}
+	void run()
+	{
+		acceptor_=urdp_acceptor::create(ios_,false);
+		acceptor_->accepted_signal().bind(&this_type::on_accepted,this,_1,_2);
+
+		error_code ec;
+		acceptor_->listen(server_endpoint(),domain,ec);
+		check(!ec,"listen");
+		if (!ec)
+			acceptor_->keep_async_accepting();
+	}
+	uint32_t multi_buffer_count()const
+	{
+		return multi_buffer_count_;
+	}
+
+private:
+	void on_accepted(boost::shared_ptr<basic_connection> socket,const error_code& ec)
+	{
+		check(!ec,"accept");
+		if (ec)
+			return;
+		sockets_.insert(socket);
+
+		urdp_connection* conn=static_cast<urdp_connection*>(socket.get());
+		conn->scatter_delivery(true);
+		conn->chain_received_signal(BULK_MSG).bind(&this_type::on_received_bulk,this,socket.get(),_1);
+		socket->received_signal(HELLO_MSG).bind(&this_type::on_received_hello,this,socket.get(),_1);
+		socket->disconnected_signal().bind(&this_type::on_disconnected,this,socket.get(),_1);
+	}
+
+	void on_disconnected(basic_connection*sock, const error_code&)
+	{
+		sockets_.erase(sock->shared_obj_from_this<basic_connection>());
+	}
+
+	void on_received_bulk(basic_connection*sock, safe_buffer_chain chain)
+	{
+		check(!static_cast<urdp_connection*>(sock)->session_resumed(),
+			"the first connection has no ticket");
+		check(chain.size()==BULK_SIZE,"bulk message size");
+		if (chain.buffer_count()>1)
+			++multi_buffer_count_;
+
+		//the number in front, then the pattern, both may span buffers
+		uint32_t n=0;
+		chain>>n;
+		check(n==bulk_count_,"bulk message order");
+		bool intact=true;
+		std::size_t i=sizeof(n);
+		char buf[1000];
+		while (!chain.empty())
+		{
+			std::size_t len=chain.read(buf,sizeof(buf));
+			for (std::size_t j=0;j<len;++j,++i)
+				intact&=(buf[j]==bulk_byte(n,i));
+		}
+		check(intact,"bulk message content");
+
+		if (++bulk_count_==BULK_COUNT)
+		{
+			safe_buffer buf;
+			safe_buffer_io io(&buf);
+			io<<(uint32_t)static_cast<urdp_connection*>(sock)->path_count();
+			sock->async_send_reliable(buf,DONE_MSG);
+		}
+	}
+
+	void on_received_hello(basic_connection*sock, safe_buffer buf)
+	{
+		//taken by the ticket, not after a full handshake
+		check(static_cast<urdp_connection*>(sock)->session_resumed(),
+			"the server resumed the session");
+		sock->async_send_reliable(buf,HELLO_MSG);
+	}
+
+private:
+	boost::shared_ptr<urdp_acceptor> acceptor_;
+	io_service& ios_;
+	std::set<boost::shared_ptr<basic_connection> > sockets_;
+	uint32_t bulk_count_;
+	uint32_t multi_buffer_count_;
+};
+
+class client
+	:public fssignal::trackable
+{
+	typedef client this_type;
+
+public:
+	client(io_service& ios):ios_(ios),round_(0),done_(false){}
+	void run()
+	{
+		timeout_timer_=rough_timer::create(ios_);
+		timeout_timer_->time_signal().bind(&this_type::on_timeout,this);
+		timeout_timer_->async_wait(seconds(30));
+		connect();
+	}
+	bool done()const
+	{
+		return done_;
+	}
+
+private:
+	void connect()
+	{
+		++round_;
+		error_code ec;
+		socket_=urdp_connection::create(ios_,false);
+		socket_->open(endpoint(),ec);
+		static_cast<urdp_connection*>(socket_.get())->session_resumption(true);
+
+		socket_->connected_signal().bind(&this_type::on_connected,this,_1);
+		socket_->received_signal(DONE_MSG).bind(&this_type::on_received_done,this,_1);
+		socket_->received_signal(HELLO_MSG).bind(&this_type::on_received_hello,this,_1);
+		socket_->async_connect(server_endpoint(),domain);
+	}
+
+	void on_connected(const error_code& ec)
+	{
+		check(!ec,"connect");
+		if (ec)
+		{
+			ios_.stop();
+			return;
+		}
+		check(static_cast<urdp_connection*>(socket_.get())->session_resumed()==(round_>1),
+			"the client resumes the second connection");
+		if (round_==1)
+		{
+			error_code err;
+			static_cast<urdp_connection*>(socket_.get())->add_local_path(
+				endpoint(address(address_v4::loopback()),0),err);
+			check(!err,"add_local_path");
+
+			for (uint32_t n=0;n<BULK_COUNT;++n)
+			{
+				safe_buffer buf;
+				safe_buffer_io io(&buf);
+				io<<n;
+				for (std::size_t i=sizeof(n);i<BULK_SIZE;++i)
+					io<<bulk_byte(n,i);
+				socket_->async_send_reliable(buf,BULK_MSG);
+			}
+		}
+		else
+		{
+			//connected at once, the message goes with CONNECT
+			safe_buffer buf;
+			safe_buffer_io io(&buf);
+			io.write("hello",strlen("hello"));
+			socket_->async_send_reliable(buf,HELLO_MSG);
+		}
+	}
+
+	void on_received_done(safe_buffer buf)
+	{
+		uint32_t serverPaths=0;
+		safe_buffer_io io(&buf);
+		io>>serverPaths;
+		std::size_t clientPaths=static_cast<urdp_connection*>(socket_.get())->path_count();
+		std::cout<<"bulk done, paths client "<<clientPaths<<" server "<<serverPaths<<std::endl;
+		check(clientPaths==2&&serverPaths==2,"multipath");
+
+		//the ticket is kept when the connection closes
+		socket_->close();
+		rough_timer_=rough_timer::create(ios_);
+		rough_timer_->time_signal().bind(&this_type::connect,this);
+		rough_timer_->async_wait(seconds(1));
+	}
+
+	void on_timeout()
+	{
+		ios_.stop();
+	}
+
+	void on_received_hello(safe_buffer buf)
+	{
+		std::string s(buffer_cast<char*>(buf),buf.size());
+		check(s=="hello","resumed connection echo");
+		done_=true;
+		socket_->close();
+		ios_.stop();
+	}
+
+private:
+	boost::shared_ptr<basic_connection> socket_;
+	io_service& ios_;
+	boost::shared_ptr<rough_timer> rough_timer_;
+	boost::shared_ptr<rough_timer> timeout_timer_;
+	int round_;
+	bool done_;
+};
+
+int main()
+{
+	io_service ios;
+	client c(ios);
+	server s(ios);
+	s.run();
+	c.run();
+	ios.run();
+
+	check(c.done(),"finished in time");
+	check(s.multi_buffer_count()>0,"scatter delivery of more than one buffer");
+	if (failed)
+	{
+		std::cout<<failed<<" checks failed"<<std::endl;
+		return 1;
+	}
+	std::cout<<"all checks passed"<<std::endl;
+	return 0;
+}
@@ -0,0 +1,149 @@
+#include <p2engine/push_warning_option.hpp>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <p2engine/pop_warning_option.hpp>
+
+#include <p2engine/safe_buffer_chain.hpp>
+
+using namespace p2engine;
+
+//safe_buffer_chain holds a message as the buffers it was received in,
+//everything read from the front may span them.
+
+int failed=0;
+
+void check(bool ok, const char* what)
+{
+	if (!ok)
+	{
+		++failed;
+		std::cout<<"FAILED: "<<what<<std::endl;
+	}
+}
+
+safe_buffer make_buffer(const char* s, std::size_t len)
+{
+	safe_buffer buf(len);
+	memcpy(buffer_cast<char*>(buf), s, len);
+	return buf;
+}
+
+safe_buffer make_buffer(const char* s)
+{
+	return make_buffer(s, strlen(s));
+}
+
+std::string as_string(const safe_buffer& buf)
+{
+	return std::string(buffer_cast<const char*>(buf), buf.size());
+}
+
+//"abc" "defgh" "ij"
+safe_buffer_chain make_chain()
+{
+	safe_buffer_chain chain;
+	chain.push_back(make_buffer("abc"));
+	chain.push_back(safe_buffer());//empty ones are not kept
+	chain.push_back(make_buffer("defgh"));
+	chain.push_back(make_buffer("ij"));
+	return chain;
+}
+
+void test_consume()
+{
+	safe_buffer_chain chain=make_chain();
+	check(chain.size()==10&&chain.buffer_count()==3, "push_back");
+
+	chain.consume(4);
+	check(chain.size()==6&&chain.buffer_count()==2, "consume across a buffer");
+	check(as_string(*chain.begin())=="efgh", "consume into a buffer");
+
+	chain.consume(4);
+	check(chain.size()==2&&chain.buffer_count()==1, "consume a whole buffer");
+	check(as_string(*chain.begin())=="ij", "consume a whole buffer");
+
+	chain.consume(100);
+	check(chain.empty()&&chain.buffer_count()==0, "consume more than size");
+}
+
+void test_read()
+{
+	safe_buffer_chain chain=make_chain();
+	char buf[16];
+
+	check(chain.read(buf, 2)==2&&std::string(buf, 2)=="ab", "read in a buffer");
+	check(chain.read(buf, 5)==5&&std::string(buf, 5)=="cdefg", "read across a buffer");
+	check(chain.size()==3&&chain.buffer_count()==2, "read consumes");
+	check(chain.read(buf, sizeof(buf))==3&&std::string(buf, 3)=="hij", "read more than size");
+	check(chain.empty(), "read all");
+}
+
+void test_read_safe_buffer()
+{
+	safe_buffer_chain chain=make_chain();
+	const char* front=buffer_cast<const char*>(*chain.begin());
+	const char* second=buffer_cast<const char*>(*(chain.begin()+1));
+	safe_buffer buf;
+
+	//in the front buffer, it is a reference
+	check(chain.read(buf, 2)==2&&as_string(buf)=="ab", "read safe_buffer in a buffer");
+	check(buffer_cast<const char*>(buf)==front, "read safe_buffer is not copied");
+
+	//across two buffers, it is copied
+	check(chain.read(buf, 4)==4&&as_string(buf)=="cdef", "read safe_buffer across a buffer");
+	check(buffer_cast<const char*>(buf)!=front+2
+		&&buffer_cast<const char*>(buf)!=second, "read safe_buffer is copied");
+	check(chain.size()==4&&as_string(*chain.begin())=="gh", "read safe_buffer consumes");
+
+	check(chain.read(buf, 0)==0, "read safe_buffer of nothing");
+}
+
+void test_read_integer()
+{
+	const char head[]={0x01, 0x02};
+	const char tail[]={0x03, 0x04, 0x05, 0x06, 0x07};
+	safe_buffer_chain chain;
+	chain.push_back(make_buffer(head, sizeof(head)));
+	chain.push_back(make_buffer(tail, sizeof(tail)));
+
+	uint32_t u32=0;
+	chain>>u32;
+	check(u32==0x01020304, "uint32 across a buffer");
+	uint16_t u16=0;
+	chain>>u16;
+	check(u16==0x0506, "uint16 in a buffer");
+	check(chain.size()==1&&chain.buffer_count()==1, "integers consume");
+}
+
+void test_to_safe_buffer()
+{
+	safe_buffer_chain chain=make_chain();
+	check(as_string(chain.to_safe_buffer())=="abcdefghij", "to_safe_buffer");
+
+	safe_buffer one=make_buffer("xyz");
+	safe_buffer_chain single(one);
+	check(buffer_cast<const char*>(single.to_safe_buffer())==buffer_cast<const char*>(one),
+		"to_safe_buffer of one buffer is not copied");
+
+	safe_buffer buf;
+	safe_buffer_io io(&buf);
+	io<<chain;
+	check(as_string(buf)=="abcdefghij", "safe_buffer_io<<");
+}
+
+int main()
+{
+	test_consume();
+	test_read();
+	test_read_safe_buffer();
+	test_read_integer();
+	test_to_safe_buffer();
+	if (failed)
+	{
+		std::cout<<failed<<" checks failed"<<std::endl;
+		return 1;
+	}
+	std::cout<<"all checks passed"<<std::endl;
+	return 0;
+}
@@ -0,0 +1,157 @@
+#include <p2engine/push_warning_option.hpp>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <p2engine/pop_warning_option.hpp>
+
+#include <p2engine/p2engine.hpp>
+#include <p2engine/utf8.hpp>
+
+using namespace p2engine;
+
+//compare is_valid_utf8 with a per sequence isLegalUTF8Sequence() walk,
+//and measure the utf8<->utf16/utf32 converters, on file names of mixed
+//languages and on http payloads that are nearly all ASCII.
+
+std::string file_names_payload()
+{
+	//utf8 encoded words, chinese, japanese, russian, greek and ASCII
+	static const char* words[]={
+		"\xE7\x94\xB5\xE5\xBD\xB1",//movie
+		"\xE9\xAB\x98\xE6\xB8\x85",//hd
+		"\xE3\x82\xA2\xE3\x83\x8B\xE3\x83\xA1",//anime
+		"\xD0\xA4\xD0\xB8\xD0\xBB\xD1\x8C\xD0\xBC",//film
+		"\xCE\xA4\xCE\xB1\xCE\xB9\xCE\xBD\xCE\xAF\xCE\xB1",//movie
+		"season",
+		"1080p",
+		"episode"
+	};
+	std::string s;
+	char buf[64];
+	boost::uint32_t seed=12345;
+	for (int i=0;i<20000;++i)
+	{
+		s+="/share/";
+		for (int j=0;j<3;++j)
+		{
+			seed=seed*1103515245+12345;
+			s+=words[(seed>>16)%(sizeof(words)/sizeof(words[0]))];
+			s+=(j<2?"_":"");
+		}
+		snprintf(buf,sizeof(buf),"_%02d.mkv\n",i%100);
+		s+=buf;
+	}
+	return s;
+}
+
+std::string http_payload()
+{
+	std::string s;
+	char buf[512];
+	for (int i=0;i<3000;++i)
+	{
+		snprintf(buf,sizeof(buf),
+			"GET /channel?id=%d&name=%s HTTP/1.1\r\nHost: tracker%d.example.com\r\n"
+			"User-Agent: p2engine/1.0\r\nAccept-Encoding: gzip\r\n\r\n",
+			i,(i%10==0?"\xE4\xB8\xAD\xE6\x96\x87":"news"),i%8);
+		s+=buf;
+	}
+	return s;
+}
+
+bool legal_per_sequence(const std::string& s)
+{
+	const UTF8* p=(const UTF8*)s.data();
+	const UTF8* end=p+s.size();
+	while (p<end)
+	{
+		int len=(*p<0xC0?1:*p<0xE0?2:*p<0xF0?3:*p<0xF8?4:*p<0xFC?5:6);
+		if (len>end-p||!isLegalUTF8Sequence(p,p+len))
+			return false;
+		p+=len;
+	}
+	return true;
+}
+
+void bench(const char* name, const std::string& data)
+{
+	const int loop=200;
+	if (!is_valid_utf8(data)||!legal_per_sequence(data))
+	{
+		std::cout<<name<<": invalid utf8"<<std::endl;
+		return;
+	}
+
+	std::vector<UTF16> u16(data.size());
+	std::vector<UTF32> u32(data.size());
+	std::vector<UTF8> u8(data.size()*4);
+	std::size_t n16=0,n32=0;
+
+	bool ok=true;
+	tick_type t0=precise_tick_time::now_tick_count();
+	for (int i=0;i<loop;++i)
+		ok&=legal_per_sequence(data);
+	tick_type t1=precise_tick_time::now_tick_count();
+	for (int i=0;i<loop;++i)
+		ok&=is_valid_utf8(data);
+	tick_type t2=precise_tick_time::now_tick_count();
+	for (int i=0;i<loop;++i)
+	{
+		const UTF8* src=(const UTF8*)data.data();
+		UTF16* dst=&u16[0];
+		ConvertUTF8toUTF16(&src,src+data.size(),&dst,dst+u16.size(),strictConversion);
+		n16=dst-&u16[0];
+	}
+	tick_type t3=precise_tick_time::now_tick_count();
+	for (int i=0;i<loop;++i)
+	{
+		const UTF8* src=(const UTF8*)data.data();
+		UTF32* dst=&u32[0];
+		ConvertUTF8toUTF32(&src,src+data.size(),&dst,dst+u32.size(),strictConversion);
+		n32=dst-&u32[0];
+	}
+	tick_type t4=precise_tick_time::now_tick_count();
+	for (int i=0;i<loop;++i)
+	{
+		const UTF16* src=&u16[0];
+		UTF8* dst=&u8[0];
+		ConvertUTF16toUTF8(&src,src+n16,&dst,dst+u8.size(),strictConversion);
+		ok&=(std::size_t(dst-&u8[0])==data.size());
+	}
+	tick_type t5=precise_tick_time::now_tick_count();
+	for (int i=0;i<loop;++i)
+	{
+		const UTF32* src=&u32[0];
+		UTF8* dst=&u8[0];
+		ConvertUTF32toUTF8(&src,src+n32,&dst,dst+u8.size(),strictConversion);
+		ok&=(std::size_t(dst-&u8[0])==data.size());
+	}
+	tick_type t6=precise_tick_time::now_tick_count();
+	if (!ok||memcmp(&u8[0],data.data(),data.size())!=0)
+	{
+		std::cout<<name<<": round trip failed"<<std::endl;
+		return;
+	}
+
+	double mb=double(data.size())*loop/(1024*1024);
+	tick_type one=1;
+	std::cout<<std::setw(8)<<name
+		<<"  bytes "<<data.size()
+		<<std::fixed<<std::setprecision(1)
+		<<"  per_sequence "<<mb*1000/(std::max)(t1-t0,one)<<"MB/s"
+		<<"  is_valid_utf8 "<<mb*1000/(std::max)(t2-t1,one)<<"MB/s"
+		<<"  8to16 "<<mb*1000/(std::max)(t3-t2,one)<<"MB/s"
+		<<"  8to32 "<<mb*1000/(std::max)(t4-t3,one)<<"MB/s"
+		<<"  16to8 "<<mb*1000/(std::max)(t5-t4,one)<<"MB/s"
+		<<"  32to8 "<<mb*1000/(std::max)(t6-t5,one)<<"MB/s"
+		<<std::endl;
+}
+
+int main()
+{
+	bench("names",file_names_payload());
+	bench("http",http_payload());
+	return 0;
+}